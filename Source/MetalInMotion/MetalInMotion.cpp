@@ -13,6 +13,8 @@ Current maintainer: Rob Baker.
 
 IMPLEMENT_PRIMARY_GAME_MODULE( FDefaultGameModuleImpl, MetalInMotion, "MetalInMotion" );
 
+DEFINE_LOG_CATEGORY(LogMetalInMotion);
+
 
 /**
 Demo console variable for extra force controlling player ball bearings.
@@ -25,3 +27,229 @@ static TAutoConsoleVariable<int32> CVarExtraMagnetism(
 	TEXT("  0: no extra magnetism\n")
 	TEXT("  1: extra magnetism\n"),
 	ECVF_Scalability | ECVF_RenderThreadSafe);
+
+
+/**
+Console variables controlling the spatial broadphase used by goals.
+*********************************************************************************/
+
+static TAutoConsoleVariable<int32> CVarSpatialBroadphase(
+	TEXT("OurGame.SpatialBroadphase"),
+	0,
+	TEXT("Defines how goals find their proximate ball bearings, taking effect when the level is loaded.\n")
+	TEXT("  0: trigger overlap events\n")
+	TEXT("  1: spatial hash, with goal overlap events turned off\n"),
+	ECVF_Default);
+
+static TAutoConsoleVariable<float> CVarSpatialBroadphaseCellSize(
+	TEXT("OurGame.SpatialBroadphaseCellSize"),
+	400.0f,
+	TEXT("The size of the cells in the spatial hash used by the spatial broadphase.\n"),
+	ECVF_Default);
+
+
+/**
+Console variables controlling how goal magnetism is spread across threads.
+*********************************************************************************/
+
+static TAutoConsoleVariable<int32> CVarParallelMagnetism(
+	TEXT("OurGame.ParallelMagnetism"),
+	1,
+	TEXT("Defines whether goal magnetism is solved across multiple threads.\n")
+	TEXT("  0: game thread only\n")
+	TEXT("  1: parallel across chunks of goals\n"),
+	ECVF_Default);
+
+static TAutoConsoleVariable<int32> CVarMagnetismGoalsPerChunk(
+	TEXT("OurGame.MagnetismGoalsPerChunk"),
+	32,
+	TEXT("The number of goals in each chunk of magnetism work. Results don't depend on the thread count, but do on this.\n"),
+	ECVF_Default);
+
+
+/**
+Console variables controlling when ball bearings settled in goals are put to sleep.
+*********************************************************************************/
+
+static TAutoConsoleVariable<float> CVarSettleSleepTime(
+	TEXT("OurGame.SettleSleepTime"),
+	1.0f,
+	TEXT("The time a ball bearing must rest in a goal's center before it's put to sleep, or 0 to never do so.\n"),
+	ECVF_Default);
+
+static TAutoConsoleVariable<float> CVarSettleSleepSpeed(
+	TEXT("OurGame.SettleSleepSpeed"),
+	20.0f,
+	TEXT("The speed in centimeters per second below which a ball bearing in a goal's center counts as resting.\n"),
+	ECVF_Default);
+
+
+/**
+Console variables controlling the simulation LOD of passive ball bearings.
+*********************************************************************************/
+
+static TAutoConsoleVariable<int32> CVarSimulationLOD(
+	TEXT("OurGame.SimulationLOD"),
+	0,
+	TEXT("Defines whether passive ball bearings are simulated in tiers by their distance from the camera, taking effect when the level is loaded.\n")
+	TEXT("  0: every ball bearing is simulated in full\n")
+	TEXT("  1: near ball bearings in full, mid-range at a reduced magnetism rate, far ones frozen\n"),
+	ECVF_Default);
+
+static TAutoConsoleVariable<float> CVarSimulationLODMidDistance(
+	TEXT("OurGame.SimulationLODMidDistance"),
+	3000.0f,
+	TEXT("The distance from the camera beyond which passive ball bearings are mid-range.\n"),
+	ECVF_Default);
+
+static TAutoConsoleVariable<float> CVarSimulationLODFarDistance(
+	TEXT("OurGame.SimulationLODFarDistance"),
+	8000.0f,
+	TEXT("The distance from the camera beyond which passive ball bearings are frozen.\n"),
+	ECVF_Default);
+
+static TAutoConsoleVariable<int32> CVarSimulationLODMidInterval(
+	TEXT("OurGame.SimulationLODMidInterval"),
+	4,
+	TEXT("The number of frames between each application of magnetism to mid-range ball bearings.\n"),
+	ECVF_Default);
+
+static TAutoConsoleVariable<int32> CVarSimulationLODMidIterations(
+	TEXT("OurGame.SimulationLODMidIterations"),
+	2,
+	TEXT("The most position solver iterations for the physics bodies of mid-range ball bearings.\n"),
+	ECVF_Default);
+
+
+/**
+Console variables controlling the baking of goal magnetism into a field.
+*********************************************************************************/
+
+static TAutoConsoleVariable<int32> CVarBakedMagnetism(
+	TEXT("OurGame.BakedMagnetism"),
+	0,
+	TEXT("Defines whether ball bearings take their magnetism from a field baked from the goals, taking effect when the level is loaded.\n")
+	TEXT("  0: solve the magnetism exactly for every goal and ball bearing pairing\n")
+	TEXT("  1: look the magnetism up in the baked field, once per ball bearing\n"),
+	ECVF_Default);
+
+static TAutoConsoleVariable<float> CVarBakedMagnetismCellSize(
+	TEXT("OurGame.BakedMagnetismCellSize"),
+	50.0f,
+	TEXT("The size of each cell of the baked magnetism field, taking effect when it's next baked.\n"),
+	ECVF_Default);
+
+static TAutoConsoleVariable<int32> CVarBakedMagnetismErrorSamples(
+	TEXT("OurGame.BakedMagnetismErrorSamples"),
+	1000,
+	TEXT("The number of random locations the baked magnetism field is compared against the exact magnetism at when it's baked, logging the error, or 0 for none.\n"),
+	ECVF_Default);
+
+
+/**
+Console variable controlling whether ball bearings are controlled per physics step.
+*********************************************************************************/
+
+static TAutoConsoleVariable<int32> CVarPhysicsStepControl(
+	TEXT("OurGame.PhysicsStepControl"),
+	0,
+	TEXT("Defines where player control and goal magnetism are applied, taking effect when the level is loaded.\n")
+	TEXT("  0: once per game frame, on the game thread\n")
+	TEXT("  1: once per physics step, from the physics scene, turning on substepping at 120Hz for a fixed rate\n"),
+	ECVF_Default);
+
+
+/**
+Console variables controlling the deterministic fixed step gameplay mode.
+*********************************************************************************/
+
+static TAutoConsoleVariable<int32> CVarDeterministicStep(
+	TEXT("OurGame.DeterministicStep"),
+	0,
+	TEXT("Defines whether gameplay runs deterministically at a fixed step, taking effect when the level is loaded.\n")
+	TEXT("  0: gameplay advances by each frame's delta time\n")
+	TEXT("  1: gameplay advances in fixed steps, iterating goals and bearings in a stable order\n")
+	TEXT("For physics to integrate fixed steps too, use the engine's fixed frame rate, or -UseFixedTimeStep -FPS= for unpaced benchmarks\n"),
+	ECVF_Default);
+
+static TAutoConsoleVariable<float> CVarDeterministicStepRate(
+	TEXT("OurGame.DeterministicStepRate"),
+	60.0f,
+	TEXT("The number of fixed steps per second in deterministic mode.\n"),
+	ECVF_Default);
+
+
+/**
+Console variable controlling how the game is reset once it's been finished.
+*********************************************************************************/
+
+static TAutoConsoleVariable<int32> CVarFastReset(
+	TEXT("OurGame.FastReset"),
+	1,
+	TEXT("Defines how the game is reset once it's been finished.\n")
+	TEXT("  0: restart the game, reloading the map\n")
+	TEXT("  1: restore the initial state of the ball bearings, goals and game mode in place\n"),
+	ECVF_Default);
+
+
+/**
+Console variables controlling the impact audio of ball bearings.
+*********************************************************************************/
+
+static TAutoConsoleVariable<int32> CVarImpactAudio(
+	TEXT("OurGame.ImpactAudio"),
+	1,
+	TEXT("Defines whether ball bearings make a sound when they hit things, taking effect when the level is loaded.\n")
+	TEXT("  0: silent\n")
+	TEXT("  1: play impacts through the voice budget\n"),
+	ECVF_Default);
+
+static TAutoConsoleVariable<int32> CVarImpactAudioVoices(
+	TEXT("OurGame.ImpactAudioVoices"),
+	16,
+	TEXT("The number of impacts that can be playing at once, taking effect when the level is loaded.\n"),
+	ECVF_Default);
+
+static TAutoConsoleVariable<float> CVarImpactAudioMinImpulse(
+	TEXT("OurGame.ImpactAudioMinImpulse"),
+	1000.0f,
+	TEXT("The impulse below which ball bearing hits are too soft to be heard.\n"),
+	ECVF_Default);
+
+static TAutoConsoleVariable<float> CVarImpactAudioFullImpulse(
+	TEXT("OurGame.ImpactAudioFullImpulse"),
+	20000.0f,
+	TEXT("The impulse at which ball bearing hits are played at full volume.\n"),
+	ECVF_Default);
+
+static TAutoConsoleVariable<float> CVarImpactAudioMaxDistance(
+	TEXT("OurGame.ImpactAudioMaxDistance"),
+	5000.0f,
+	TEXT("The distance from the listener beyond which ball bearing hits aren't played.\n"),
+	ECVF_Default);
+
+
+/**
+Console variable controlling client-side prediction of player ball bearings.
+*********************************************************************************/
+
+static TAutoConsoleVariable<int32> CVarPlayerPrediction(
+	TEXT("OurGame.PlayerPrediction"),
+	1,
+	TEXT("Defines whether clients predict the movement of their own ball bearing.\n")
+	TEXT("  0: wait for the server to move it\n")
+	TEXT("  1: predict it, reconciling with the server as its state arrives\n"),
+	ECVF_Default);
+
+
+/**
+Console variable controlling the reporting of network bandwidth.
+*********************************************************************************/
+
+static TAutoConsoleVariable<int32> CVarReportNetBandwidth(
+	TEXT("OurGame.ReportNetBandwidth"),
+	0,
+	TEXT("Defines whether the server logs the bandwidth used by each client connection every second.\n")
+	TEXT("  0: no report\n")
+	TEXT("  1: report\n"),
+	ECVF_Default);
@@ -11,3 +11,5 @@ Current maintainer: Rob Baker.
 
 #include "CoreMinimal.h"
 
+// Log category for Metal in Motion.
+DECLARE_LOG_CATEGORY_EXTERN(LogMetalInMotion, Log, All);
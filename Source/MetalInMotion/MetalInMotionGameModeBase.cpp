@@ -8,13 +8,28 @@ Current maintainer: Rob Baker.
 *********************************************************************************/
 
 #include "MetalInMotionGameModeBase.h"
+#include "MetalInMotion.h"
+#include "MetalInMotionGameState.h"
 #include "BallBearingHUD.h"
 #include "BallBearingGoal.h"
+#include "BallBearingField.h"
+#include "BallBearingPool.h"
+#include "BallBearingImpactAudio.h"
+#include "BallBearingSubsystem.h"
+#include "BallBearingTimings.h"
+#include "BallBearingTrace.h"
+#include "BallBearingStartup.h"
 #include "Kismet/GamePlayStatics.h"
+#include "Components/AudioComponent.h"
+#include "EngineUtils.h"
+#include "Engine/NetConnection.h"
+#include "HAL/IConsoleManager.h"
+#include "TimerManager.h"
+#include "Engine/AssetManager.h"
 
 
 /**
-Construct the game mode, assigning a debugging HUD class.
+Construct the game mode, assigning a debugging HUD class and our game state class.
 *********************************************************************************/
 
 AMetalInMotionGameModeBase::AMetalInMotionGameModeBase()
@@ -22,18 +37,189 @@ AMetalInMotionGameModeBase::AMetalInMotionGameModeBase()
 	PrimaryActorTick.bCanEverTick = true;
 
 	HUDClass = ABallBearingHUD::StaticClass();
+	GameStateClass = AMetalInMotionGameState::StaticClass();
 }
 
 
 /**
-Play the background music at the beginning of the game.
+Start loading our assets asynchronously as the map loads.
+*********************************************************************************/
+
+void AMetalInMotionGameModeBase::InitGame(const FString& mapName, const FString& options, FString& errorMessage)
+{
+	Super::InitGame(mapName, options, errorMessage);
+
+	FBallBearingStartupTimeline::Mark(TEXT("Game initialized"));
+
+	// Gather everything that's held softly, including the HUD's font, so that none of
+	// it is loaded synchronously on first use.
+
+	TArray<FSoftObjectPath> paths;
+
+	auto addPath = [&paths] (const FSoftObjectPath& path)
+	{
+		if (path.IsNull() == false)
+		{
+			paths.AddUnique(path);
+		}
+	};
+
+	addPath(BackgroundMusic.ToSoftObjectPath());
+	addPath(FinishedSound.ToSoftObjectPath());
+	addPath(ImpactSound.ToSoftObjectPath());
+	addPath(PooledBallBearingClass.ToSoftObjectPath());
+
+	for (const TSoftObjectPtr<UObject>& asset : PreloadAssets)
+	{
+		addPath(asset.ToSoftObjectPath());
+	}
+
+	const ADebugHUD* hud = (HUDClass != nullptr) ? Cast<ADebugHUD>(HUDClass->GetDefaultObject()) : nullptr;
+
+	if (hud != nullptr)
+	{
+		addPath(hud->MainFontAsset.ToSoftObjectPath());
+	}
+
+	if (paths.Num() > 0)
+	{
+		PreloadHandle = UAssetManager::GetStreamableManager().RequestAsyncLoad(paths, FStreamableDelegate::CreateUObject(this, &AMetalInMotionGameModeBase::OnPreloadComplete), FStreamableManager::AsyncLoadHighPriority);
+	}
+}
+
+
+/**
+Called when the assets loaded asynchronously from InitGame have all loaded.
+*********************************************************************************/
+
+void AMetalInMotionGameModeBase::OnPreloadComplete()
+{
+	FBallBearingStartupTimeline::Mark(TEXT("Assets preloaded"));
+
+	if (HasActorBegunPlay() == true)
+	{
+		StartWithPreloadedAssets();
+	}
+}
+
+
+/**
+Play the background music, warm up the pool and hand over the impact sound, once play has begun and their assets have loaded.
+*********************************************************************************/
+
+void AMetalInMotionGameModeBase::StartWithPreloadedAssets()
+{
+	if (StartedWithPreloadedAssets == true)
+	{
+		return;
+	}
+
+	StartedWithPreloadedAssets = true;
+
+	// Keep hold of the music's audio component so a fast reset can restart it.
+
+	if (BackgroundMusic.IsNull() == false)
+	{
+		MusicComponent = UGameplayStatics::SpawnSound2D(AActor::GetWorld(), BackgroundMusic.LoadSynchronous(), 1.0f, 1.0f, 0.0f, nullptr, false, false);
+	}
+
+	// Create the pooled ball bearings now, so that spawning them in play doesn't.
+
+	UBallBearingPoolSubsystem* pool = GetWorld()->GetSubsystem<UBallBearingPoolSubsystem>();
+	UClass* pooledBallBearingClass = PooledBallBearingClass.LoadSynchronous();
+
+	if (pool != nullptr &&
+		pooledBallBearingClass != nullptr)
+	{
+		pool->WarmUp(pooledBallBearingClass, PooledBallBearingWarmUp);
+	}
+
+	// The impact audio subsystem creates its voices up front too. Clients are handed
+	// the impact sound through the game state.
+
+	UBallBearingImpactAudioSubsystem* impactAudio = GetWorld()->GetSubsystem<UBallBearingImpactAudioSubsystem>();
+
+	if (impactAudio != nullptr &&
+		ImpactSound.IsNull() == false)
+	{
+		impactAudio->SetImpactSound(ImpactSound.LoadSynchronous());
+	}
+
+	AMetalInMotionGameState* gameState = GetGameState<AMetalInMotionGameState>();
+
+	if (gameState != nullptr)
+	{
+		gameState->ImpactSound = ImpactSound;
+	}
+}
+
+
+/**
+Listen for goal occupancy changes at the beginning of the game, starting the music once it's loaded.
 *********************************************************************************/
 
 void AMetalInMotionGameModeBase::BeginPlay()
 {
 	Super::BeginPlay();
 
-	UGameplayStatics::PlaySound2D(AActor::GetWorld(), BackgroundMusic);
+	FBallBearingStartupTimeline::Mark(TEXT("Play begun"));
+
+	UBallBearingSubsystem* subsystem = GetWorld()->GetSubsystem<UBallBearingSubsystem>();
+
+	if (subsystem != nullptr)
+	{
+		subsystem->OnGoalOccupancyChanged.AddUObject(this, &AMetalInMotionGameModeBase::OnGoalOccupancyChanged);
+
+		FinishedStep = FBallBearingFixedStep(subsystem->GetDeterministicStepSeconds());
+	}
+
+	// Once the preload has completed, loading synchronously just resolves what's
+	// already in memory. Until then, it's left to finish in the background.
+
+	if (IsPreloadComplete() == true)
+	{
+		StartWithPreloadedAssets();
+	}
+
+	if (GetNetMode() != NM_Standalone)
+	{
+		GetWorldTimerManager().SetTimer(NetBandwidthTimer, this, &AMetalInMotionGameModeBase::ReportNetBandwidth, 1.0f, true);
+	}
+}
+
+
+/**
+Stop listening for goal occupancy changes at the end of the game.
+*********************************************************************************/
+
+void AMetalInMotionGameModeBase::EndPlay(const EEndPlayReason::Type endPlayReason)
+{
+	UBallBearingSubsystem* subsystem = GetWorld()->GetSubsystem<UBallBearingSubsystem>();
+
+	if (subsystem != nullptr)
+	{
+		subsystem->OnGoalOccupancyChanged.RemoveAll(this);
+	}
+
+	if (PreloadHandle.IsValid() == true)
+	{
+		PreloadHandle->CancelHandle();
+		PreloadHandle.Reset();
+	}
+
+	Super::EndPlay(endPlayReason);
+}
+
+
+/**
+Track the number of filled goals as goals report changes in their occupancy.
+*********************************************************************************/
+
+void AMetalInMotionGameModeBase::OnGoalOccupancyChanged(ABallBearingGoal* goal, bool filled)
+{
+	NumFilledGoals += (filled == true) ? 1 : -1;
+
+	check(NumFilledGoals >= 0);
 }
 
 
@@ -45,39 +231,65 @@ void AMetalInMotionGameModeBase::Tick(float deltaSeconds)
 {
 	Super::Tick(deltaSeconds);
 
-	// Determine if all the goals have ball bearings at their center.
-	
-	int32 numGoals = 0;
-	bool finished = true;
-	TArray<AActor*> actors;
-	
-	// Note, GetAllActorsOfClass is generally not great for performance, but OK right here.
+	SCOPE_CYCLE_COUNTER(STAT_GameModeTick);
+	FScopedBallBearingTiming timing(EBallBearingTiming::EndGameCheck);
+	BALL_BEARING_TRACE_SCOPE(MetalInMotionEndGameCheck);
 
-	UGameplayStatics::GetAllActorsOfClass(GetWorld(), ABallBearingGoal::StaticClass(), actors);
+	// The first frame ticked with all of our assets loaded is the first playable one.
 
-	for (const AActor* goal : actors)
+	if (FBallBearingStartupTimeline::IsReported() == false &&
+		IsPreloadComplete() == true)
 	{
-		numGoals++;
-
-		if ((Cast<ABallBearingGoal>(goal))->HasBallBearing() == false)
-		{
-			finished = false;
-			break;
-		}
+		FBallBearingStartupTimeline::Report();
 	}
 
-	// If all goals are filled, then record how long that has been the case.
-	
+	// Determine if all the goals have ball bearings at their center. Goals report
+	// changes in their occupancy to the subsystem, so this is just a comparison.
+
+	UBallBearingSubsystem* subsystem = GetWorld()->GetSubsystem<UBallBearingSubsystem>();
+	int32 numGoals = (subsystem != nullptr) ? subsystem->GetNumGoals() : 0;
+	bool finished = (NumFilledGoals == numGoals);
+
+	// If all goals are filled, then record how long that has been the case, in whole
+	// fixed steps if running deterministically.
+
+	float finishedSeconds = FinishedStep.Advance(deltaSeconds);
+
 	if (numGoals > 0 &&
 		finished == true)
 	{
-		FinishedTime += deltaSeconds;
+		FinishedTime += finishedSeconds;
 	}
 	else
 	{
 		FinishedTime = 0.0f;
 	}
 
+	// Replicate the state of the game to any clients.
+
+	AMetalInMotionGameState* gameState = GetGameState<AMetalInMotionGameState>();
+
+	if (gameState != nullptr)
+	{
+		gameState->NumGoals = numGoals;
+		gameState->NumFilledGoals = NumFilledGoals;
+
+		// Only replicate when the game was finished, as it changes, rather than how long
+		// it's been finished for every frame.
+
+		if (FinishedTime > 0.0f)
+		{
+			if (gameState->FinishedStartTime < 0.0f)
+			{
+				gameState->FinishedStartTime = FMath::Max(0.0f, gameState->GetServerWorldTimeSeconds() - FinishedTime);
+			}
+		}
+		else
+		{
+			gameState->FinishedStartTime = -1.0f;
+		}
+	}
+
 	// If all goals have been filled for at least one second, then handle the finishing of the game.
 	// The delay is to avoid ball bearings passing through the goals without stopping.
 	
@@ -89,14 +301,126 @@ void AMetalInMotionGameModeBase::Tick(float deltaSeconds)
 		{
 			FinishedSoundPlayed = true;
 
-			UGameplayStatics::PlaySound2D(GetWorld(), FinishedSound);
+			TRACE_BOOKMARK(TEXT("Game finished"));
+
+			UGameplayStatics::PlaySound2D(GetWorld(), FinishedSound.LoadSynchronous());
 		}
 
 		// If the game has been finished for at least 10 seconds then reset the game ready to go around again.
 		
 		if (FinishedTime > 10.0f)
 		{
-			Super::RestartGame();
+			TRACE_BOOKMARK(TEXT("Game restarting"));
+			BALL_BEARING_TRACE_SCOPE(MetalInMotionRestartGame);
+
+			static const IConsoleVariable* fastReset = IConsoleManager::Get().FindConsoleVariable(TEXT("OurGame.FastReset"));
+
+			if (fastReset == nullptr ||
+				fastReset->GetInt() != 0)
+			{
+				FastResetGame();
+			}
+			else
+			{
+				Super::RestartGame();
+			}
+		}
+	}
+}
+
+
+/**
+Restore the ball bearings, goals and game mode to their initial state in place, rather than reloading the map.
+*********************************************************************************/
+
+void AMetalInMotionGameModeBase::FastResetGame()
+{
+	SCOPE_CYCLE_COUNTER(STAT_GameReset);
+
+	double startTime = FPlatformTime::Seconds();
+	int32 numBallBearings = 0;
+
+	// Ball bearings spawned from the pool weren't there at the start, so park them all.
+
+	UBallBearingPoolSubsystem* pool = GetWorld()->GetSubsystem<UBallBearingPoolSubsystem>();
+
+	if (pool != nullptr)
+	{
+		pool->ReleaseAllBallBearings();
+	}
+
+	// Every other ball bearing snapshotted its initial state when it began play, so
+	// just put them all back where they started.
+
+	for (TActorIterator<ABallBearing> iterator(GetWorld()); iterator; ++iterator)
+	{
+		if (iterator->IsParked() == false)
+		{
+			iterator->ResetToInitialState();
+
+			numBallBearings++;
+		}
+	}
+
+	for (TActorIterator<ABallBearingField> iterator(GetWorld()); iterator; ++iterator)
+	{
+		iterator->ResetToInitialState();
+
+		numBallBearings += iterator->GetNumBallBearings();
+	}
+
+	// Empty the goals, which brings our count of filled goals back down to zero.
+
+	UBallBearingSubsystem* subsystem = GetWorld()->GetSubsystem<UBallBearingSubsystem>();
+
+	if (subsystem != nullptr)
+	{
+		subsystem->ResetGoals();
+		subsystem->ForgetPersistedBallBearings();
+	}
+
+	// Goals streamed out are emptied without telling us, so zero the count ourselves.
+
+	NumFilledGoals = 0;
+
+	FinishedTime = 0.0f;
+	FinishedSoundPlayed = false;
+	FinishedStep.Reset();
+
+	// Start the music again from the beginning.
+
+	if (MusicComponent != nullptr)
+	{
+		MusicComponent->Play();
+	}
+
+	UE_LOG(LogMetalInMotion, Log, TEXT("Fast reset of %d ball bearings took %.2fms"), numBallBearings, (FPlatformTime::Seconds() - startTime) * 1000.0);
+}
+
+
+/**
+Log the bandwidth used by each client connection, called every second.
+*********************************************************************************/
+
+void AMetalInMotionGameModeBase::ReportNetBandwidth()
+{
+	static const IConsoleVariable* reportNetBandwidth = IConsoleManager::Get().FindConsoleVariable(TEXT("OurGame.ReportNetBandwidth"));
+
+	if (reportNetBandwidth == nullptr ||
+		reportNetBandwidth->GetInt() == 0)
+	{
+		return;
+	}
+
+	for (FConstPlayerControllerIterator iterator = GetWorld()->GetPlayerControllerIterator(); iterator; ++iterator)
+	{
+		APlayerController* controller = iterator->Get();
+		UNetConnection* connection = (controller != nullptr) ? controller->GetNetConnection() : nullptr;
+
+		if (connection != nullptr &&
+			controller->IsLocalController() == false)
+		{
+			UE_LOG(LogMetalInMotion, Log, TEXT("Client %s: %d bytes/sec out, %d bytes/sec in, %d bytes/sec limit"), *connection->LowLevelGetRemoteAddress(true), connection->OutBytesPerSecond, connection->InBytesPerSecond, connection->CurrentNetSpeed);
 		}
 	}
 }
@@ -5,6 +5,11 @@ The base game mode for Metal in Motion.
 Original author: Rob Baker.
 Current maintainer: Rob Baker.
 
+The assets the game mode and HUD need only once play is underway are held as
+soft references, and loaded asynchronously from InitGame so they load alongside
+the rest of the map rather than blocking it. Anything depending on them is
+started as soon as both they've loaded and play has begun.
+
 *********************************************************************************/
 
 #pragma once
@@ -12,8 +17,13 @@ Current maintainer: Rob Baker.
 #include "CoreMinimal.h"
 #include "GameFramework/GameMode.h"
 #include "Sound/SoundCue.h"
+#include "Engine/StreamableManager.h"
+#include "BallBearingFixedStep.h"
 #include "MetalInMotionGameModeBase.generated.h"
 
+class UAudioComponent;
+class ABallBearing;
+
 
 /**
 The base game mode for Metal in Motion.
@@ -26,30 +36,92 @@ class METALINMOTION_API AMetalInMotionGameModeBase : public AGameMode
 
 public:
 
-	// Construct the game mode, assigning a debugging HUD class.
+	// Construct the game mode, assigning a debugging HUD class and our game state class.
 	AMetalInMotionGameModeBase();
 
 	// The sound cue to play for the background music.
 	UPROPERTY(EditAnywhere, BlueprintReadOnly, Category = Audio)
-		USoundCue* BackgroundMusic = nullptr;
+		TSoftObjectPtr<USoundCue> BackgroundMusic;
 
 	// The sound cue to play when the game has been finished by the player.
 	UPROPERTY(EditAnywhere, BlueprintReadOnly, Category = Audio)
-		USoundCue* FinishedSound = nullptr;
+		TSoftObjectPtr<USoundCue> FinishedSound;
+
+	// The sound to play when ball bearings hit things, its volume following the force of the impact.
+	UPROPERTY(EditAnywhere, BlueprintReadOnly, Category = Audio)
+		TSoftObjectPtr<USoundBase> ImpactSound;
+
+	// The class of ball bearing to warm the pool up with at load time.
+	UPROPERTY(EditAnywhere, BlueprintReadOnly, Category = Pool)
+		TSoftClassPtr<ABallBearing> PooledBallBearingClass;
+
+	// Any other assets to load asynchronously with the map, such as the meshes and materials of ball bearings spawned during play.
+	UPROPERTY(EditAnywhere, BlueprintReadOnly, Category = Loading)
+		TArray<TSoftObjectPtr<UObject>> PreloadAssets;
+
+	// The number of ball bearings to warm the pool up with at load time.
+	UPROPERTY(EditAnywhere, BlueprintReadOnly, Category = Pool)
+		int32 PooledBallBearingWarmUp = 0;
 
 protected:
 
-	// Play the background music at the beginning of the game.
+	// Start loading our assets asynchronously as the map loads.
+	virtual void InitGame(const FString& mapName, const FString& options, FString& errorMessage) override;
+
+	// Listen for goal occupancy changes at the beginning of the game, starting the music once it's loaded.
 	virtual void BeginPlay() override;
 
+	// Stop listening for goal occupancy changes at the end of the game.
+	virtual void EndPlay(const EEndPlayReason::Type endPlayReason) override;
+
 	// Manage the game mode, mostly detecting and implementing the end-game state.
 	virtual void Tick(float deltaSeconds) override;
 
 private:
 
+	// Called when the assets loaded asynchronously from InitGame have all loaded.
+	void OnPreloadComplete();
+
+	// Have the assets loaded asynchronously from InitGame all loaded?
+	bool IsPreloadComplete() const
+	{
+		return (PreloadHandle.IsValid() == false || PreloadHandle->HasLoadCompleted() == true);
+	}
+
+	// Play the background music, warm up the pool and hand over the impact sound, once play has begun and their assets have loaded.
+	void StartWithPreloadedAssets();
+
+	// Track the number of filled goals as goals report changes in their occupancy.
+	void OnGoalOccupancyChanged(class ABallBearingGoal* goal, bool filled);
+
+	// Restore the ball bearings, goals and game mode to their initial state in place, rather than reloading the map.
+	void FastResetGame();
+
+	// Log the bandwidth used by each client connection, called every second.
+	void ReportNetBandwidth();
+
+	// The handle for the assets being loaded asynchronously from InitGame.
+	TSharedPtr<FStreamableHandle> PreloadHandle;
+
+	// Have the music and the pool been started with the preloaded assets?
+	bool StartedWithPreloadedAssets = false;
+
+	// The audio component playing the background music.
+	UPROPERTY(Transient)
+		UAudioComponent* MusicComponent = nullptr;
+
+	// Timer used to report the network bandwidth.
+	FTimerHandle NetBandwidthTimer;
+
+	// The number of goals that currently have a ball bearing resting in their center.
+	int32 NumFilledGoals = 0;
+
 	// The amount of time that the game has been finished.
 	float FinishedTime = 0.0f;
 
 	// Has the finished sound been played?
 	bool FinishedSoundPlayed = false;
+
+	// Accumulator advancing the finished time in fixed steps in deterministic mode.
+	FBallBearingFixedStep FinishedStep;
 };
@@ -0,0 +1,74 @@
+/**
+
+The game state for Metal in Motion.
+
+Original author: Rob Baker.
+Current maintainer: Rob Baker.
+
+*********************************************************************************/
+
+#include "MetalInMotionGameState.h"
+#include "BallBearingImpactAudio.h"
+#include "Net/UnrealNetwork.h"
+#include "Engine/AssetManager.h"
+
+
+/**
+Establish the properties to be replicated.
+*********************************************************************************/
+
+void AMetalInMotionGameState::GetLifetimeReplicatedProps(TArray<FLifetimeProperty>& outLifetimeProps) const
+{
+	Super::GetLifetimeReplicatedProps(outLifetimeProps);
+
+	DOREPLIFETIME(AMetalInMotionGameState, NumGoals);
+	DOREPLIFETIME(AMetalInMotionGameState, NumFilledGoals);
+	DOREPLIFETIME(AMetalInMotionGameState, FinishedStartTime);
+	DOREPLIFETIME(AMetalInMotionGameState, ImpactSound);
+}
+
+
+/**
+Get the amount of time that the game has been finished.
+*********************************************************************************/
+
+float AMetalInMotionGameState::GetFinishedTime() const
+{
+	// Only the time the game was finished is replicated, once, rather than the time
+	// since changing every frame, so each client works that out for itself.
+
+	if (FinishedStartTime < 0.0f)
+	{
+		return 0.0f;
+	}
+
+	return FMath::Max(0.0f, GetServerWorldTimeSeconds() - FinishedStartTime);
+}
+
+
+/**
+Load the impact sound on a client, handing it to the impact audio subsystem once loaded.
+*********************************************************************************/
+
+void AMetalInMotionGameState::OnRep_ImpactSound()
+{
+	if (ImpactSound.IsNull() == false)
+	{
+		UAssetManager::GetStreamableManager().RequestAsyncLoad(ImpactSound.ToSoftObjectPath(), FStreamableDelegate::CreateUObject(this, &AMetalInMotionGameState::OnImpactSoundLoaded));
+	}
+}
+
+
+/**
+Hand the impact sound, now loaded, to the impact audio subsystem.
+*********************************************************************************/
+
+void AMetalInMotionGameState::OnImpactSoundLoaded()
+{
+	UBallBearingImpactAudioSubsystem* impactAudio = GetWorld()->GetSubsystem<UBallBearingImpactAudioSubsystem>();
+
+	if (impactAudio != nullptr)
+	{
+		impactAudio->SetImpactSound(ImpactSound.Get());
+	}
+}
@@ -0,0 +1,65 @@
+/**
+
+The game state for Metal in Motion.
+
+Original author: Rob Baker.
+Current maintainer: Rob Baker.
+
+The game mode only exists on the server, so the state of the game that clients
+need to see, mainly goal occupancy and when the game was finished, is replicated
+to them from here. So is the impact sound the game mode is configured with, so
+that clients can load it and play impacts of their own.
+
+*********************************************************************************/
+
+#pragma once
+
+#include "CoreMinimal.h"
+#include "GameFramework/GameState.h"
+#include "Sound/SoundBase.h"
+#include "MetalInMotionGameState.generated.h"
+
+
+/**
+The game state for Metal in Motion.
+*********************************************************************************/
+
+UCLASS()
+class METALINMOTION_API AMetalInMotionGameState : public AGameState
+{
+	GENERATED_BODY()
+
+public:
+
+	// The number of goals in the game.
+	UPROPERTY(Replicated, BlueprintReadOnly, Category = Game)
+		int32 NumGoals = 0;
+
+	// The number of goals that currently have a ball bearing resting in their center.
+	UPROPERTY(Replicated, BlueprintReadOnly, Category = Game)
+		int32 NumFilledGoals = 0;
+
+	// The server's world time when the game was finished, or negative if it isn't.
+	UPROPERTY(Replicated, BlueprintReadOnly, Category = Game)
+		float FinishedStartTime = -1.0f;
+
+	// The sound to play when ball bearings hit things.
+	UPROPERTY(ReplicatedUsing = OnRep_ImpactSound, BlueprintReadOnly, Category = Game)
+		TSoftObjectPtr<USoundBase> ImpactSound;
+
+	// Get the amount of time that the game has been finished.
+	UFUNCTION(BlueprintPure, Category = Game)
+		float GetFinishedTime() const;
+
+	// Establish the properties to be replicated.
+	virtual void GetLifetimeReplicatedProps(TArray<FLifetimeProperty>& outLifetimeProps) const override;
+
+private:
+
+	// Load the impact sound on a client, handing it to the impact audio subsystem once loaded.
+	UFUNCTION()
+		void OnRep_ImpactSound();
+
+	// Hand the impact sound, now loaded, to the impact audio subsystem.
+	void OnImpactSoundLoaded();
+};
@@ -8,6 +8,10 @@ Current maintainer: Rob Baker.
 *********************************************************************************/
 
 #include "BallBearing.h"
+#include "BallBearingSubsystem.h"
+#include "BallBearingPool.h"
+#include "BallBearingImpactAudio.h"
+#include "BallBearingTimings.h"
 
 
 /**
@@ -16,17 +20,28 @@ Create a static mesh for this ball bearing on object construction.
 
 ABallBearing::ABallBearing()
 {
- 	// Set this pawn to call Tick() every frame.
+	// Passive ball bearings have nothing to do each frame, contacts are stamped with
+	// the physics frame they happened on rather than being cleared by a tick.
 
-	PrimaryActorTick.bCanEverTick = true;
+	PrimaryActorTick.bCanEverTick = false;
 
 	// Create the ball mesh, turn on its physics and set it as the root component.
 
 	BallMesh = CreateDefaultSubobject<UStaticMeshComponent>(TEXT("BallMesh"));
 	
 	BallMesh->SetSimulatePhysics(true);
+	BallMesh->BodyInstance.bGenerateWakeEvents = true;
 
 	SetRootComponent(BallMesh);
+
+	// Replicate the physics state, at the engine's default quantization of a
+	// centimeter, a centimeter per second and byte rotations.
+
+	bReplicates = true;
+	NetUpdateFrequency = 30.0f;
+	MinNetUpdateFrequency = 2.0f;
+
+	SetReplicatingMovement(true);
 }
 
 
@@ -39,19 +54,322 @@ void ABallBearing::BeginPlay()
 	Super::BeginPlay();
 
 	InitialLocation = BallMesh->GetComponentLocation();
+	InitialTransform = BallMesh->GetComponentTransform();
 
 	BallMesh->SetLinearDamping(0.5f);
 	BallMesh->SetAngularDamping(0.5f);
+
+	// Ball bearings parked by the pool as soon as they were spawned stay out of play.
+
+	UBallBearingSubsystem* subsystem = GetWorld()->GetSubsystem<UBallBearingSubsystem>();
+
+	if (subsystem != nullptr &&
+		Parked == false)
+	{
+		// Pick up where we were if our level has streamed back in.
+
+		subsystem->RestoreBallBearingState(this);
+		subsystem->RegisterBallBearing(this);
+	}
+
+	if (HasAuthority() == true &&
+		GetNetMode() != NM_Standalone)
+	{
+		BallMesh->OnComponentWake.AddDynamic(this, &ABallBearing::OnBallMeshWake);
+		BallMesh->OnComponentSleep.AddDynamic(this, &ABallBearing::OnBallMeshSleep);
+	}
+}
+
+
+/**
+Called when the ball bearing is removed from play.
+*********************************************************************************/
+
+void ABallBearing::EndPlay(const EEndPlayReason::Type endPlayReason)
+{
+	UBallBearingSubsystem* subsystem = GetWorld()->GetSubsystem<UBallBearingSubsystem>();
+
+	if (subsystem != nullptr)
+	{
+		// Keep hold of where we were if our level is streaming out.
+
+		if (endPlayReason == EEndPlayReason::RemovedFromWorld &&
+			Parked == false)
+		{
+			subsystem->PersistBallBearingState(this);
+		}
+
+		subsystem->UnregisterBallBearing(this);
+	}
+
+	// Ball bearings spawned from the pool and destroyed in play, by falling out of the
+	// world for instance, mustn't be left in its in-use list.
+
+	if (PoolIndex != INDEX_NONE)
+	{
+		UBallBearingPoolSubsystem* pool = GetWorld()->GetSubsystem<UBallBearingPoolSubsystem>();
+
+		if (pool != nullptr)
+		{
+			pool->ForgetBallBearing(this);
+		}
+	}
+
+	Super::EndPlay(endPlayReason);
+}
+
+
+/**
+Reset the ball bearing's state, at rest at a given transform.
+*********************************************************************************/
+
+void ABallBearing::ResetToTransform(const FTransform& transform)
+{
+	BallMesh->SetWorldTransform(transform, false, nullptr, ETeleportType::TeleportPhysics);
+	BallMesh->SetPhysicsLinearVelocity(FVector::ZeroVector);
+	BallMesh->SetPhysicsAngularVelocityInDegrees(FVector::ZeroVector);
+
+	// Keep the ball bearing awake so the spatial hash and the goals pick up its move.
+
+	BallMesh->WakeAllRigidBodies();
+
+	ContactPhysicsFrame = INDEX_NONE;
+
+	FrozenLinearVelocity = FVector::ZeroVector;
+	FrozenAngularVelocity = FVector::ZeroVector;
+}
+
+
+/**
+Freeze or thaw the ball bearing for a reason, turning its physics off while keeping its velocities.
+*********************************************************************************/
+
+void ABallBearing::SetFrozen(EBallBearingFreezeReason reason, bool frozen)
+{
+	// Parked ball bearings already have their physics off, and keep it that way.
+
+	if (Parked == true)
+	{
+		return;
+	}
+
+	bool wasFrozen = IsFrozen();
+
+	FrozenReasons = (frozen == true) ? (FrozenReasons | (uint8)reason) : (FrozenReasons & ~(uint8)reason);
+
+	if (IsFrozen() == wasFrozen)
+	{
+		return;
+	}
+
+	// A frozen ball bearing stays in the goals' overlaps and the spatial hash, so the
+	// occupancy of any goal it's sitting in is kept while it's frozen.
+
+	if (IsFrozen() == true)
+	{
+		FrozenLinearVelocity = BallMesh->GetPhysicsLinearVelocity();
+		FrozenAngularVelocity = BallMesh->GetPhysicsAngularVelocityInDegrees();
+
+		BallMesh->SetSimulatePhysics(false);
+	}
+	else
+	{
+		BallMesh->SetSimulatePhysics(true);
+		BallMesh->SetPhysicsLinearVelocity(FrozenLinearVelocity);
+		BallMesh->SetPhysicsAngularVelocityInDegrees(FrozenAngularVelocity);
+	}
+}
+
+
+/**
+Get the linear and angular velocities of the ball bearing, as kept if it's frozen.
+*********************************************************************************/
+
+void ABallBearing::GetVelocities(FVector& linearVelocity, FVector& angularVelocity) const
+{
+	if (IsFrozen() == true)
+	{
+		linearVelocity = FrozenLinearVelocity;
+		angularVelocity = FrozenAngularVelocity;
+	}
+	else
+	{
+		linearVelocity = BallMesh->GetPhysicsLinearVelocity();
+		angularVelocity = BallMesh->GetPhysicsAngularVelocityInDegrees();
+	}
+}
+
+
+/**
+Set the linear and angular velocities of the ball bearing, to be kept until it's thawed if it's frozen.
+*********************************************************************************/
+
+void ABallBearing::SetVelocities(const FVector& linearVelocity, const FVector& angularVelocity)
+{
+	if (IsFrozen() == true)
+	{
+		FrozenLinearVelocity = linearVelocity;
+		FrozenAngularVelocity = angularVelocity;
+	}
+	else
+	{
+		BallMesh->SetPhysicsLinearVelocity(linearVelocity);
+		BallMesh->SetPhysicsAngularVelocityInDegrees(angularVelocity);
+	}
+}
+
+
+/**
+Park the ball bearing in the pool, taking it out of play.
+*********************************************************************************/
+
+void ABallBearing::Park()
+{
+	if (Parked == true)
+	{
+		return;
+	}
+
+	Parked = true;
+	FrozenReasons = 0;
+
+	// Unregistering takes the ball bearing out of the spatial hash and the physics
+	// steps, and turning off collision takes it out of the goals' overlaps. Only its
+	// own magnetism pairings are removed from the physics steps, so the pool parking
+	// ball bearings mid-frame leaves the magnetism of the rest in place.
+
+	UBallBearingSubsystem* subsystem = GetWorld()->GetSubsystem<UBallBearingSubsystem>();
+
+	if (subsystem != nullptr)
+	{
+		subsystem->UnregisterBallBearing(this);
+	}
+
+	BallMesh->SetSimulatePhysics(false);
+
+	SetActorEnableCollision(false);
+	SetActorHiddenInGame(true);
+}
+
+
+/**
+Bring the ball bearing out of the pool and back into play, at rest at a given transform.
+*********************************************************************************/
+
+void ABallBearing::Unpark(const FTransform& transform)
+{
+	if (Parked == false)
+	{
+		return;
+	}
+
+	Parked = false;
+
+	SetActorHiddenInGame(false);
+	SetActorEnableCollision(true);
+
+	BallMesh->SetSimulatePhysics(true);
+
+	ResetToTransform(transform);
+
+	UBallBearingSubsystem* subsystem = GetWorld()->GetSubsystem<UBallBearingSubsystem>();
+
+	if (subsystem != nullptr)
+	{
+		subsystem->RegisterBallBearing(this);
+	}
+}
+
+
+/**
+Receive notification of a collision contact and record the physics frame it happened on.
+*********************************************************************************/
+
+void ABallBearing::NotifyHit(UPrimitiveComponent* myComponent, AActor* other, UPrimitiveComponent* otherComp, bool selfMoved, FVector hitLocation, FVector hitNormal, FVector normalImpulse, const FHitResult& hitResult)
+{
+	SCOPE_CYCLE_COUNTER(STAT_BallBearingHit);
+	INC_DWORD_STAT(STAT_BallBearingHits);
+	FScopedBallBearingTiming timing(EBallBearingTiming::HitNotifications);
+
+	Super::NotifyHit(myComponent, other, otherComp, selfMoved, hitLocation, hitNormal, normalImpulse, hitResult);
+
+	UBallBearingSubsystem* subsystem = GetWorld()->GetSubsystem<UBallBearingSubsystem>();
+
+	if (subsystem != nullptr)
+	{
+		ContactPhysicsFrame = subsystem->GetPhysicsFrame();
+	}
+
+	// Impacts are coalesced and played for the whole world at once, rather than here.
+
+	UBallBearingImpactAudioSubsystem* impactAudio = GetWorld()->GetSubsystem<UBallBearingImpactAudioSubsystem>();
+
+	if (impactAudio != nullptr)
+	{
+		impactAudio->ReportImpact(hitLocation, normalImpulse);
+	}
+}
+
+
+/**
+Is the ball bearing in contact with any other geometry?
+*********************************************************************************/
+
+bool ABallBearing::IsInContact() const
+{
+	// We're in contact if we were hit during the most recently completed physics frame,
+	// which is exactly what clearing a flag each tick and setting it on each hit used
+	// to give, whichever order things before physics happen to tick in.
+
+	UBallBearingSubsystem* subsystem = GetWorld()->GetSubsystem<UBallBearingSubsystem>();
+
+	return (subsystem != nullptr && ContactPhysicsFrame == subsystem->GetCompletedPhysicsFrame());
+}
+
+
+/**
+Get the priority for replicating the ball bearing to a client, by distance from its view target.
+*********************************************************************************/
+
+float ABallBearing::GetNetPriority(const FVector& viewPos, const FVector& viewDir, AActor* viewer, AActor* viewTarget, UActorChannel* inChannel, float time, bool lowBandwidth)
+{
+	// A client's view target is normally its own player ball bearing, which always
+	// comes first. Others are prioritized by how close they are to it, falling from
+	// full priority within 10 meters to a tenth at 100 meters.
+
+	if (viewTarget == this)
+	{
+		return NetPriority * time * 4.0f;
+	}
+
+	FVector origin = (viewTarget != nullptr) ? viewTarget->GetActorLocation() : viewPos;
+	float distance = FVector::Dist(origin, GetActorLocation());
+
+	return NetPriority * time * FMath::GetMappedRangeValueClamped(FVector2D(1000.0f, 10000.0f), FVector2D(1.0f, 0.1f), distance);
+}
+
+
+/**
+Stop the ball bearing going dormant for replication once it wakes up.
+*********************************************************************************/
+
+void ABallBearing::OnBallMeshWake(UPrimitiveComponent* wakingComponent, FName boneName)
+{
+	SetNetDormancy(DORM_Awake);
 }
 
 
 /**
-Control the movement of the ball bearing, called every frame.
+Have the ball bearing go dormant for replication once it goes to sleep.
 *********************************************************************************/
 
-void ABallBearing::Tick(float deltaSeconds)
+void ABallBearing::OnBallMeshSleep(UPrimitiveComponent* sleepingComponent, FName boneName)
 {
-	Super::Tick(deltaSeconds);
+	// The engine sends the final resting state before closing the channel. Controlled
+	// ball bearings stay awake for their input.
 
-	InContact = false;
+	if (IsPawnControlled() == false)
+	{
+		SetNetDormancy(DORM_DormantAll);
+	}
 }
@@ -5,6 +5,13 @@ Main ball bearing implementation.
 Original author: Rob Baker.
 Current maintainer: Rob Baker.
 
+Ball bearings are simulated on the server and their physics state replicated to
+clients through the engine's movement replication, at its default quantization
+of a centimeter, a centimeter per second and byte rotations, and at no more than
+30 updates a second. Sleeping ball bearings go dormant, so only those awake cost
+any bandwidth, and each client gets updates for the ball bearings nearest its
+own first.
+
 *********************************************************************************/
 
 #pragma once
@@ -12,9 +19,22 @@ Current maintainer: Rob Baker.
 #include "CoreMinimal.h"
 #include "GameFramework/Pawn.h"
 #include "Components/StaticMeshComponent.h"
+#include "BallBearingSimulationLOD.h"
 #include "BallBearing.generated.h"
 
 
+/**
+The reasons a ball bearing may be frozen, any one of which keeps it frozen.
+*********************************************************************************/
+
+enum class EBallBearingFreezeReason : uint8
+{
+	Streaming = 1 << 0,
+	SimulationLOD = 1 << 1,
+	Replay = 1 << 2
+};
+
+
 /**
 Main ball bearing class, derived from pawn but with no input and no camera.
 *********************************************************************************/
@@ -46,30 +66,111 @@ public:
 		BallMesh->SetPhysicsAngularVelocityInDegrees(FVector::ZeroVector);
 	}
 
+	// Restore the ball bearing to its state when the game started, as part of a fast reset.
+	void ResetToInitialState()
+	{
+		ResetToTransform(InitialTransform);
+	}
+
+	// Reset the ball bearing's state, at rest at a given transform.
+	virtual void ResetToTransform(const FTransform& transform);
+
+	// Is the ball bearing parked in the pool, out of play?
+	bool IsParked() const
+	{
+		return Parked;
+	}
+
+	// Freeze or thaw the ball bearing for a reason, turning its physics off while keeping its velocities.
+	void SetFrozen(EBallBearingFreezeReason reason, bool frozen);
+
+	// Is the ball bearing frozen, for any reason?
+	bool IsFrozen() const
+	{
+		return FrozenReasons != 0;
+	}
+
+	// Get the linear and angular velocities of the ball bearing, as kept if it's frozen.
+	void GetVelocities(FVector& linearVelocity, FVector& angularVelocity) const;
+
+	// Set the linear and angular velocities of the ball bearing, to be kept until it's thawed if it's frozen.
+	void SetVelocities(const FVector& linearVelocity, const FVector& angularVelocity);
+
 protected:
 
 	// Called when the game starts or when spawned.
 	virtual void BeginPlay() override;
 
-	// Control the movement of the ball bearing, called every frame.
-	virtual void Tick(float deltaSeconds) override;
+	// Called when the ball bearing is removed from play.
+	virtual void EndPlay(const EEndPlayReason::Type endPlayReason) override;
 
-	// Receive notification of a collision contact and record that we're in contact with something.
-	virtual void NotifyHit(UPrimitiveComponent* myComponent, AActor* other, UPrimitiveComponent* otherComp, bool selfMoved, FVector hitLocation, FVector hitNormal, FVector normalImpulse, const FHitResult& hitResult) override
-	{
-		Super::NotifyHit(myComponent, other, otherComp, selfMoved, hitLocation, hitNormal, normalImpulse, hitResult);
+	// Get the priority for replicating the ball bearing to a client, by distance from its view target.
+	virtual float GetNetPriority(const FVector& viewPos, const FVector& viewDir, AActor* viewer, AActor* viewTarget, UActorChannel* inChannel, float time, bool lowBandwidth) override;
 
-		InContact = true;
-	}
+	// Receive notification of a collision contact and record the physics frame it happened on.
+	virtual void NotifyHit(UPrimitiveComponent* myComponent, AActor* other, UPrimitiveComponent* otherComp, bool selfMoved, FVector hitLocation, FVector hitNormal, FVector normalImpulse, const FHitResult& hitResult) override;
 
 	// Is the ball bearing in contact with any other geometry?
-	bool InContact = false;
+	bool IsInContact() const;
+
+	// The physics frame on which the ball bearing last made contact with any other geometry.
+	int64 ContactPhysicsFrame = INDEX_NONE;
 
 private:
 
+	// Stop the ball bearing going dormant for replication once it wakes up.
+	UFUNCTION()
+		void OnBallMeshWake(UPrimitiveComponent* wakingComponent, FName boneName);
+
+	// Have the ball bearing go dormant for replication once it goes to sleep.
+	UFUNCTION()
+		void OnBallMeshSleep(UPrimitiveComponent* sleepingComponent, FName boneName);
+
 	// The initial location of the ball bearing at game start.
 	FVector InitialLocation = FVector::ZeroVector;
 
+	// The initial transform of the ball bearing at game start.
+	FTransform InitialTransform = FTransform::Identity;
+
+	// Park the ball bearing in the pool, taking it out of play.
+	void Park();
+
+	// Bring the ball bearing out of the pool and back into play, at rest at a given transform.
+	void Unpark(const FTransform& transform);
+
+	// The handle of the ball bearing in the subsystem's spatial hash, if any.
+	int32 SpatialHashHandle = INDEX_NONE;
+
+	// The index of the ball bearing in the pool's in-use list, or INDEX_NONE if not spawned from it.
+	int32 PoolIndex = INDEX_NONE;
+
+	// Is the ball bearing parked in the pool, out of play?
+	bool Parked = false;
+
+	// The reasons the ball bearing is frozen, if any.
+	uint8 FrozenReasons = 0;
+
+	// The simulation tier of the ball bearing, if it's subject to simulation LOD.
+	EBallBearingSimulationTier SimulationTier = EBallBearingSimulationTier::Near;
+
+	// The index of the ball bearing in the subsystem's simulation LOD list, or INDEX_NONE if not in it.
+	int32 SimulationLODIndex = INDEX_NONE;
+
+	// The scale of this frame's magnetism on the ball bearing, from its simulation tier.
+	float MagnetismScale = 1.0f;
+
+	// The linear velocity of the ball bearing when it was frozen.
+	FVector FrozenLinearVelocity = FVector::ZeroVector;
+
+	// The angular velocity of the ball bearing when it was frozen, in degrees.
+	FVector FrozenAngularVelocity = FVector::ZeroVector;
+
 	// Allow the ball bearing HUD unfettered access to this class.
 	friend class ABallBearingHUD;
+
+	// Allow the ball bearing subsystem to manage our spatial hash handle.
+	friend class UBallBearingSubsystem;
+
+	// Allow the ball bearing pool to park us.
+	friend class UBallBearingPoolSubsystem;
 };
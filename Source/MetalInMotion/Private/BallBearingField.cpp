@@ -0,0 +1,530 @@
+/**
+
+Fields of passive ball bearings for Metal in Motion.
+
+Original author: Rob Baker.
+Current maintainer: Rob Baker.
+
+*********************************************************************************/
+
+#include "BallBearingField.h"
+#include "BallBearingSubsystem.h"
+#include "BallBearingMagnetismSolver.h"
+#include "PhysicsEngine/BodySetup.h"
+#include "Engine/CollisionProfile.h"
+#include "Engine/StaticMesh.h"
+#include "Engine/World.h"
+#include "HAL/IConsoleManager.h"
+#include "Net/UnrealNetwork.h"
+
+
+/**
+Create the instanced mesh for the field on object construction.
+*********************************************************************************/
+
+ABallBearingField::ABallBearingField()
+{
+	// Tick after physics so the instanced mesh reflects this frame's simulation.
+
+	PrimaryActorTick.bCanEverTick = true;
+	PrimaryActorTick.TickGroup = TG_PostPhysics;
+
+	// The instanced mesh's body instance is used as the template for each ball
+	// bearing's physics body, so set it up as we would a ball bearing's mesh.
+
+	Instances = CreateDefaultSubobject<UInstancedStaticMeshComponent>(TEXT("Instances"));
+
+	Instances->SetMobility(EComponentMobility::Movable);
+	Instances->SetCollisionProfileName(UCollisionProfile::PhysicsActor_ProfileName);
+	Instances->BodyInstance.bSimulatePhysics = true;
+	Instances->BodyInstance.LinearDamping = 0.5f;
+	Instances->BodyInstance.AngularDamping = 0.5f;
+
+	SetRootComponent(Instances);
+
+	// Replicate the ball bearings' states at the same rate as ball bearing actors.
+
+	bReplicates = true;
+	NetUpdateFrequency = 30.0f;
+	MinNetUpdateFrequency = 2.0f;
+}
+
+
+/**
+Point the replicated states at the field, once its properties have been initialized.
+*********************************************************************************/
+
+void ABallBearingField::PostInitProperties()
+{
+	Super::PostInitProperties();
+
+	States.Field = this;
+}
+
+
+/**
+Establish the properties to be replicated.
+*********************************************************************************/
+
+void ABallBearingField::GetLifetimeReplicatedProps(TArray<FLifetimeProperty>& outLifetimeProps) const
+{
+	Super::GetLifetimeReplicatedProps(outLifetimeProps);
+
+	DOREPLIFETIME(ABallBearingField, States);
+}
+
+
+/**
+Create the physics bodies for the ball bearings in the field.
+*********************************************************************************/
+
+void ABallBearingField::BeginPlay()
+{
+	Super::BeginPlay();
+
+	UBodySetup* bodySetup = Instances->GetBodySetup();
+	FPhysScene* physicsScene = GetWorld()->GetPhysicsScene();
+	int32 numInstances = Instances->GetInstanceCount();
+
+	if (Instances->GetStaticMesh() != nullptr)
+	{
+		BallBearingRadius = Instances->GetStaticMesh()->GetBounds().SphereRadius * GetActorScale3D().GetMax();
+	}
+
+	static const IConsoleVariable* cellSize = IConsoleManager::Get().FindConsoleVariable(TEXT("OurGame.SpatialBroadphaseCellSize"));
+
+	SpatialHash = FBallBearingSpatialHash((cellSize != nullptr) ? FMath::Max(cellSize->GetFloat(), 1.0f) : 400.0f);
+
+	// Create a physics body for each instance, copying its properties from the mesh's
+	// body instance, and enter it into the spatial hash. Only the server simulates them,
+	// clients' bodies being kinematic and driven by the states replicated from it.
+
+	bool simulate = HasAuthority();
+
+	Records.SetNum(numInstances);
+
+	if (simulate == true)
+	{
+		States.Items.SetNum(numInstances);
+	}
+
+	for (int32 i = 0; i < numInstances; i++)
+	{
+		FBallBearingFieldRecord& record = Records[i];
+		FTransform transform;
+
+		Instances->GetInstanceTransform(i, transform, true);
+
+		record.Body = new FBodyInstance();
+		record.Body->CopyBodyInstancePropertiesFrom(&Instances->BodyInstance);
+		record.Body->InstanceBodyIndex = i;
+		record.Body->bSimulatePhysics = simulate;
+
+		if (bodySetup != nullptr)
+		{
+			record.Body->InitBody(bodySetup, transform, Instances, physicsScene);
+		}
+
+		record.Location = transform.GetLocation();
+		record.InitialLocation = record.Location;
+		record.InitialRotation = transform.GetRotation();
+		record.Magnetized = Magnetized;
+
+		verify(SpatialHash.Add(record.Location) == i);
+
+		if (simulate == true)
+		{
+			States.Items[i].Index = i;
+			States.Items[i].SetTransform(transform);
+		}
+	}
+
+	// The mesh component itself mustn't collide, or its own static instance bodies
+	// would be fighting with the ones we've just created.
+
+	Instances->SetCollisionEnabled(ECollisionEnabled::NoCollision);
+
+	if (simulate == false)
+	{
+		// Any states replicated before we began play can be applied now there are bodies.
+
+		for (const FBallBearingFieldState& state : States.Items)
+		{
+			ApplyReplicatedState(state);
+		}
+
+		return;
+	}
+
+	States.MarkArrayDirty();
+
+	UBallBearingSubsystem* subsystem = GetWorld()->GetSubsystem<UBallBearingSubsystem>();
+
+	if (subsystem != nullptr)
+	{
+		subsystem->RegisterBallBearingField(this);
+
+		for (const FBallBearingFieldRecord& record : Records)
+		{
+			subsystem->WakeGoalsNear(record.Location);
+		}
+	}
+}
+
+
+/**
+Destroy the physics bodies for the ball bearings in the field.
+*********************************************************************************/
+
+void ABallBearingField::EndPlay(const EEndPlayReason::Type endPlayReason)
+{
+	UBallBearingSubsystem* subsystem = GetWorld()->GetSubsystem<UBallBearingSubsystem>();
+
+	if (subsystem != nullptr)
+	{
+		subsystem->UnregisterBallBearingField(this);
+	}
+
+	for (FBallBearingFieldRecord& record : Records)
+	{
+		record.Body->TermBody();
+
+		delete record.Body;
+	}
+
+	Records.Empty();
+
+	Super::EndPlay(endPlayReason);
+}
+
+
+/**
+Copy the physics body locations into the instanced mesh, called every frame after physics.
+*********************************************************************************/
+
+void ABallBearingField::Tick(float deltaSeconds)
+{
+	Super::Tick(deltaSeconds);
+
+	// Clients' bodies and mesh instances are driven as replicated states arrive, so
+	// the render state just needs dirtying once for them all.
+
+	if (HasAuthority() == false)
+	{
+		if (ReplicatedStateApplied == true)
+		{
+			Instances->MarkRenderStateDirty();
+
+			ReplicatedStateApplied = false;
+		}
+
+		return;
+	}
+
+	// Sleeping bodies haven't moved, so only the awake ones are copied across, and the
+	// render state is only dirtied once for the lot. Bearings moving into a new cell
+	// of the spatial hash may wake up any dormant goals covering it.
+
+	UBallBearingSubsystem* subsystem = GetWorld()->GetSubsystem<UBallBearingSubsystem>();
+	bool replicating = (GetNetMode() != NM_Standalone);
+	bool anyMoved = false;
+
+	for (int32 i = 0; i < Records.Num(); i++)
+	{
+		FBallBearingFieldRecord& record = Records[i];
+
+		if (record.Body->IsInstanceAwake() == true)
+		{
+			FTransform transform = record.Body->GetUnrealWorldTransform();
+
+			record.Location = transform.GetLocation();
+
+			if (SpatialHash.Update(i, record.Location) == true &&
+				subsystem != nullptr)
+			{
+				subsystem->WakeGoalsNear(record.Location);
+			}
+
+			Instances->UpdateInstanceTransform(i, transform, true, false, true);
+
+			// Only states that have changed once quantized are replicated.
+
+			if (replicating == true &&
+				States.Items[i].SetTransform(transform) == true)
+			{
+				States.MarkItemDirty(States.Items[i]);
+			}
+
+			anyMoved = true;
+		}
+	}
+
+	if (anyMoved == true)
+	{
+		Instances->MarkRenderStateDirty();
+	}
+}
+
+
+/**
+Set whether a ball bearing in the field is attractive to magnets.
+*********************************************************************************/
+
+void ABallBearingField::SetMagnetized(int32 index, bool magnetized)
+{
+	if (Records.IsValidIndex(index) == true)
+	{
+		Records[index].Magnetized = magnetized;
+	}
+}
+
+
+/**
+Reset the location of a ball bearing in the field to its initial location when spawned.
+*********************************************************************************/
+
+void ABallBearingField::ResetLocation(int32 index)
+{
+	if (HasAuthority() == true &&
+		Records.IsValidIndex(index) == true)
+	{
+		FBallBearingFieldRecord& record = Records[index];
+		FTransform transform = record.Body->GetUnrealWorldTransform();
+
+		transform.SetLocation(record.InitialLocation + FVector(0.0f, 0.0f, 150.0f));
+
+		record.Body->SetBodyTransform(transform, ETeleportType::TeleportPhysics);
+		record.Body->SetLinearVelocity(FVector::ZeroVector, false);
+		record.Body->SetAngularVelocityInRadians(FVector::ZeroVector, false);
+		record.Body->WakeInstance();
+	}
+}
+
+
+/**
+Reset the locations of all the ball bearings in the field to their initial locations.
+*********************************************************************************/
+
+void ABallBearingField::ResetLocations()
+{
+	for (int32 i = 0; i < Records.Num(); i++)
+	{
+		ResetLocation(i);
+	}
+}
+
+
+/**
+Restore all the ball bearings in the field to their state when the game started, as part of a fast reset.
+*********************************************************************************/
+
+void ABallBearingField::ResetToInitialState()
+{
+	if (HasAuthority() == false)
+	{
+		return;
+	}
+
+	// The bodies are left awake so the next tick copies them into the instanced mesh
+	// and moves them around the spatial hash.
+
+	for (FBallBearingFieldRecord& record : Records)
+	{
+		FTransform transform = record.Body->GetUnrealWorldTransform();
+
+		transform.SetLocation(record.InitialLocation);
+		transform.SetRotation(record.InitialRotation);
+
+		record.Body->SetBodyTransform(transform, ETeleportType::TeleportPhysics);
+		record.Body->SetLinearVelocity(FVector::ZeroVector, false);
+		record.Body->SetAngularVelocityInRadians(FVector::ZeroVector, false);
+		record.Body->WakeInstance();
+		record.Magnetized = Magnetized;
+		record.FrozenLinearVelocity = FVector::ZeroVector;
+		record.FrozenAngularVelocity = FVector::ZeroVector;
+	}
+}
+
+
+/**
+Place each ball bearing in the field in its simulation tier, counting how many are in each.
+*********************************************************************************/
+
+void ABallBearingField::UpdateSimulationLOD(const FBallBearingSimulationLOD& simulationLOD, int32* numInTier)
+{
+	for (int32 i = 0; i < Records.Num(); i++)
+	{
+		FBallBearingFieldRecord& record = Records[i];
+		EBallBearingSimulationTier tier = simulationLOD.GetTier(record.Location);
+
+		// Freeze ball bearings going far away, and thaw those coming back, keeping
+		// their velocities across the freeze, and coarsen the solver for those in
+		// mid-range.
+
+		if (tier != record.SimulationTier)
+		{
+			if (tier == EBallBearingSimulationTier::Far)
+			{
+				record.FrozenLinearVelocity = record.Body->GetUnrealWorldVelocity();
+				record.FrozenAngularVelocity = record.Body->GetUnrealWorldAngularVelocityInRadians();
+				record.Body->SetInstanceSimulatePhysics(false);
+			}
+			else if (record.SimulationTier == EBallBearingSimulationTier::Far)
+			{
+				record.Body->SetInstanceSimulatePhysics(true);
+				record.Body->SetLinearVelocity(record.FrozenLinearVelocity, false);
+				record.Body->SetAngularVelocityInRadians(record.FrozenAngularVelocity, false);
+			}
+
+			record.SimulationTier = tier;
+
+			simulationLOD.SetSolverIterations(record.Body, tier);
+		}
+
+		record.MagnetismScale = simulationLOD.GetMagnetismScale(tier, i);
+
+		numInTier[(int32)tier]++;
+	}
+}
+
+
+/**
+Add the magnetized ball bearings within a goal's radius to the magnetism solver.
+*********************************************************************************/
+
+void ABallBearingField::GatherMagnetism(FBallBearingMagnetismSolver& solver, int32 goalIndex, const FVector& location, float radius)
+{
+	QueryHandles.Reset();
+
+	SpatialHash.QuerySphere(location, radius + BallBearingRadius, QueryHandles);
+
+	for (int32 index : QueryHandles)
+	{
+		const FBallBearingFieldRecord& record = Records[index];
+
+		if (record.Magnetized == true)
+		{
+			solver.AddPair(goalIndex, solver.AddBody(record.Body, record.Location, record.MagnetismScale));
+		}
+	}
+}
+
+
+/**
+Remove all the ball bearings in the field from the magnetism solver.
+*********************************************************************************/
+
+void ABallBearingField::RemoveMagnetism(FBallBearingMagnetismSolver& solver) const
+{
+	for (const FBallBearingFieldRecord& record : Records)
+	{
+		solver.RemoveBody(record.Body);
+	}
+}
+
+
+
+/**
+Drive a ball bearing's kinematic body and mesh instance from its replicated state, on a client.
+*********************************************************************************/
+
+void ABallBearingField::ApplyReplicatedState(const FBallBearingFieldState& state)
+{
+	// States may arrive before we've begun play and created the bodies to drive.
+
+	if (Records.IsValidIndex(state.Index) == false ||
+		Records[state.Index].Body == nullptr)
+	{
+		return;
+	}
+
+	FBallBearingFieldRecord& record = Records[state.Index];
+	FTransform transform = state.GetTransform();
+
+	transform.SetScale3D(record.Body->Scale3D);
+
+	record.Location = transform.GetLocation();
+
+	// Moving a kinematic body without teleporting sets its target, so it pushes anything
+	// it runs into on the way.
+
+	record.Body->SetBodyTransform(transform, ETeleportType::None);
+
+	Instances->UpdateInstanceTransform(state.Index, transform, true, false, true);
+
+	ReplicatedStateApplied = true;
+}
+
+
+/**
+Set the state from a transform, returning whether the quantized state changed.
+*********************************************************************************/
+
+bool FBallBearingFieldState::SetTransform(const FTransform& transform)
+{
+	// Quantize as the replication will, so unchanged states aren't marked dirty.
+
+	FVector location = transform.GetLocation();
+	FRotator rotation = transform.Rotator();
+
+	location.X = FMath::RoundToFloat(location.X * 10.0f) * 0.1f;
+	location.Y = FMath::RoundToFloat(location.Y * 10.0f) * 0.1f;
+	location.Z = FMath::RoundToFloat(location.Z * 10.0f) * 0.1f;
+
+	uint8 pitch = FRotator::CompressAxisToByte(rotation.Pitch);
+	uint8 yaw = FRotator::CompressAxisToByte(rotation.Yaw);
+	uint8 roll = FRotator::CompressAxisToByte(rotation.Roll);
+
+	if (location == Location &&
+		pitch == Pitch &&
+		yaw == Yaw &&
+		roll == Roll)
+	{
+		return false;
+	}
+
+	Location = location;
+	Pitch = pitch;
+	Yaw = yaw;
+	Roll = roll;
+
+	return true;
+}
+
+
+/**
+Get the transform for the state.
+*********************************************************************************/
+
+FTransform FBallBearingFieldState::GetTransform() const
+{
+	FRotator rotation(FRotator::DecompressAxisFromByte(Pitch), FRotator::DecompressAxisFromByte(Yaw), FRotator::DecompressAxisFromByte(Roll));
+
+	return FTransform(rotation, Location);
+}
+
+
+/**
+Have the field drive the ball bearing from its newly replicated state.
+*********************************************************************************/
+
+void FBallBearingFieldState::PostReplicatedAdd(const FBallBearingFieldStates& states)
+{
+	if (states.Field != nullptr)
+	{
+		states.Field->ApplyReplicatedState(*this);
+	}
+}
+
+
+/**
+Have the field drive the ball bearing from its newly replicated state.
+*********************************************************************************/
+
+void FBallBearingFieldState::PostReplicatedChange(const FBallBearingFieldStates& states)
+{
+	if (states.Field != nullptr)
+	{
+		states.Field->ApplyReplicatedState(*this);
+	}
+}
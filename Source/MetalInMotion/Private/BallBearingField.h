@@ -0,0 +1,251 @@
+/**
+
+Fields of passive ball bearings for Metal in Motion.
+
+Original author: Rob Baker.
+Current maintainer: Rob Baker.
+
+A full ball bearing actor is a pawn with its own mesh component, tick function
+and garbage collection overhead, which is overkill for the passive, magnetized
+bearings that make up most of a level. A field instead holds any number of
+passive bearings as plain records, each with its own physics body, rendered
+through a single instanced static mesh component. Place a field in a level and
+add instances to its mesh component to lay out its ball bearings.
+
+Only the server simulates the ball bearings in a field, as it's the server's
+bearings that fill goals. Their states are replicated to clients as a fast array,
+quantized as for ball bearing actors, with only the bearings that have moved being
+sent, and nothing at all while they're all asleep. Clients drive kinematic bodies
+from those states, so that their own ball bearings still collide with them.
+
+*********************************************************************************/
+
+#pragma once
+
+#include "CoreMinimal.h"
+#include "GameFramework/Actor.h"
+#include "Components/InstancedStaticMeshComponent.h"
+#include "Net/Serialization/FastArraySerializer.h"
+#include "BallBearingSpatialHash.h"
+#include "BallBearingSimulationLOD.h"
+#include "BallBearingField.generated.h"
+
+class FBallBearingMagnetismSolver;
+class ABallBearingField;
+struct FBallBearingFieldStates;
+
+
+/**
+A passive ball bearing within a field.
+*********************************************************************************/
+
+struct FBallBearingFieldRecord
+{
+	// The physics body of the ball bearing.
+	FBodyInstance* Body = nullptr;
+
+	// The location of the ball bearing as of the last physics step.
+	FVector Location = FVector::ZeroVector;
+
+	// The initial location of the ball bearing at game start.
+	FVector InitialLocation = FVector::ZeroVector;
+
+	// The initial rotation of the ball bearing at game start.
+	FQuat InitialRotation = FQuat::Identity;
+
+	// Is the ball bearing attractive to magnets?
+	bool Magnetized = true;
+
+	// The simulation tier of the ball bearing.
+	EBallBearingSimulationTier SimulationTier = EBallBearingSimulationTier::Near;
+
+	// The scale of this frame's magnetism on the ball bearing, from its simulation tier.
+	float MagnetismScale = 1.0f;
+
+	// The linear velocity of the ball bearing when it was frozen.
+	FVector FrozenLinearVelocity = FVector::ZeroVector;
+
+	// The angular velocity of the ball bearing when it was frozen, in radians.
+	FVector FrozenAngularVelocity = FVector::ZeroVector;
+};
+
+
+/**
+The replicated state of a passive ball bearing within a field.
+*********************************************************************************/
+
+USTRUCT()
+struct FBallBearingFieldState : public FFastArraySerializerItem
+{
+	GENERATED_BODY()
+
+	// The index of the ball bearing's record in the field.
+	UPROPERTY()
+		int32 Index = INDEX_NONE;
+
+	// The location of the ball bearing, quantized to a millimeter.
+	UPROPERTY()
+		FVector_NetQuantize10 Location = FVector::ZeroVector;
+
+	// The pitch of the ball bearing, quantized to a byte.
+	UPROPERTY()
+		uint8 Pitch = 0;
+
+	// The yaw of the ball bearing, quantized to a byte.
+	UPROPERTY()
+		uint8 Yaw = 0;
+
+	// The roll of the ball bearing, quantized to a byte.
+	UPROPERTY()
+		uint8 Roll = 0;
+
+	// Set the state from a transform, returning whether the quantized state changed.
+	bool SetTransform(const FTransform& transform);
+
+	// Get the transform for the state.
+	FTransform GetTransform() const;
+
+	// Have the field drive the ball bearing from its newly replicated state.
+	void PostReplicatedAdd(const FBallBearingFieldStates& states);
+
+	// Have the field drive the ball bearing from its newly replicated state.
+	void PostReplicatedChange(const FBallBearingFieldStates& states);
+};
+
+
+/**
+The replicated states of all the passive ball bearings within a field.
+*********************************************************************************/
+
+USTRUCT()
+struct FBallBearingFieldStates : public FFastArraySerializer
+{
+	GENERATED_BODY()
+
+	// The state of each ball bearing in the field.
+	UPROPERTY()
+		TArray<FBallBearingFieldState> Items;
+
+	// The field the states belong to.
+	ABallBearingField* Field = nullptr;
+
+	// Replicate only the states that have changed.
+	bool NetDeltaSerialize(FNetDeltaSerializeInfo& deltaParms)
+	{
+		return FFastArraySerializer::FastArrayDeltaSerialize<FBallBearingFieldState, FBallBearingFieldStates>(Items, deltaParms, *this);
+	}
+};
+
+template<>
+struct TStructOpsTypeTraits<FBallBearingFieldStates> : public TStructOpsTypeTraitsBase2<FBallBearingFieldStates>
+{
+	enum
+	{
+		WithNetDeltaSerializer = true
+	};
+};
+
+
+/**
+A field of passive ball bearings, rendered through a single instanced mesh.
+*********************************************************************************/
+
+UCLASS()
+class METALINMOTION_API ABallBearingField : public AActor
+{
+	GENERATED_BODY()
+
+public:
+
+	// Create the instanced mesh for the field on object construction.
+	ABallBearingField();
+
+	// The instanced mesh that represents all of the ball bearings in the field.
+	UPROPERTY(VisibleAnywhere, BlueprintReadOnly, Category = BallBearing)
+		UInstancedStaticMeshComponent* Instances = nullptr;
+
+	// Are the ball bearings in the field attractive to magnets when the game starts?
+	UPROPERTY(EditAnywhere, BlueprintReadOnly, Category = BallBearing)
+		bool Magnetized = true;
+
+	// Get the number of ball bearings in the field.
+	UFUNCTION(BlueprintCallable, Category = "Ball Bearing")
+		int32 GetNumBallBearings() const
+	{
+		return Records.Num();
+	}
+
+	// Set whether a ball bearing in the field is attractive to magnets.
+	UFUNCTION(BlueprintCallable, Category = "Ball Bearing")
+		void SetMagnetized(int32 index, bool magnetized);
+
+	// Reset the location of a ball bearing in the field to its initial location when spawned.
+	UFUNCTION(BlueprintCallable, Category = "Ball Bearing")
+		void ResetLocation(int32 index);
+
+	// Reset the locations of all the ball bearings in the field to their initial locations.
+	UFUNCTION(BlueprintCallable, Category = "Ball Bearing")
+		void ResetLocations();
+
+	// Restore all the ball bearings in the field to their state when the game started, as part of a fast reset.
+	void ResetToInitialState();
+
+	// Place each ball bearing in the field in its simulation tier, counting how many are in each.
+	void UpdateSimulationLOD(const FBallBearingSimulationLOD& simulationLOD, int32* numInTier);
+
+	// Add the magnetized ball bearings within a goal's radius to the magnetism solver.
+	void GatherMagnetism(FBallBearingMagnetismSolver& solver, int32 goalIndex, const FVector& location, float radius);
+
+	// Remove all the ball bearings in the field from the magnetism solver.
+	void RemoveMagnetism(FBallBearingMagnetismSolver& solver) const;
+
+	// Are there any ball bearings from the field in the spatial hash cells overlapping a box?
+	bool HasBallBearingsNear(const FBox& box) const
+	{
+		return SpatialHash.IsAnyInBox(box);
+	}
+
+protected:
+
+	// Point the replicated states at the field, once its properties have been initialized.
+	virtual void PostInitProperties() override;
+
+	// Create the physics bodies for the ball bearings in the field.
+	virtual void BeginPlay() override;
+
+	// Destroy the physics bodies for the ball bearings in the field.
+	virtual void EndPlay(const EEndPlayReason::Type endPlayReason) override;
+
+	// Copy the physics body locations into the instanced mesh, called every frame after physics.
+	virtual void Tick(float deltaSeconds) override;
+
+	// Establish the properties to be replicated.
+	virtual void GetLifetimeReplicatedProps(TArray<FLifetimeProperty>& outLifetimeProps) const override;
+
+private:
+
+	// Drive a ball bearing's kinematic body and mesh instance from its replicated state, on a client.
+	void ApplyReplicatedState(const FBallBearingFieldState& state);
+
+	// The replicated states of the ball bearings in the field.
+	UPROPERTY(Replicated)
+		FBallBearingFieldStates States;
+
+	// Has a replicated state been applied to the instanced mesh since it was last rendered?
+	bool ReplicatedStateApplied = false;
+
+	// Allow replicated states to be applied to the field.
+	friend struct FBallBearingFieldState;
+
+	// The passive ball bearings in the field, one per mesh instance.
+	TArray<FBallBearingFieldRecord> Records;
+
+	// Spatial hash of the ball bearings in the field, the handles being record indices.
+	FBallBearingSpatialHash SpatialHash;
+
+	// The radius of each ball bearing in the field.
+	float BallBearingRadius = 0.0f;
+
+	// Scratch buffer for spatial hash queries.
+	TArray<int32> QueryHandles;
+};
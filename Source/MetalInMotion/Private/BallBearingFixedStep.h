@@ -0,0 +1,59 @@
+/**
+
+Fixed step accumulator for Metal in Motion.
+
+Original author: Rob Baker.
+Current maintainer: Rob Baker.
+
+In deterministic mode, gameplay timers advance in whole fixed steps rather than by
+each frame's delta time, so the same input stream reaches the same thresholds on
+the same step whatever the frame rate. Time left over from a frame is carried
+forward into the next.
+
+*********************************************************************************/
+
+#pragma once
+
+#include "CoreMinimal.h"
+
+
+/**
+Accumulates frame time and releases it in whole fixed steps.
+*********************************************************************************/
+
+struct FBallBearingFixedStep
+{
+	// Construct the accumulator, with no step size meaning frame time is passed straight through.
+	explicit FBallBearingFixedStep(float stepSeconds = 0.0f)
+		: StepSeconds(stepSeconds)
+	{ }
+
+	// Accumulate a frame's time, returning the time to advance by in whole steps.
+	float Advance(float deltaSeconds)
+	{
+		if (StepSeconds <= 0.0f)
+		{
+			return deltaSeconds;
+		}
+
+		Accumulator += deltaSeconds;
+
+		int32 numSteps = FMath::FloorToInt(Accumulator / StepSeconds);
+
+		Accumulator -= numSteps * StepSeconds;
+
+		return numSteps * StepSeconds;
+	}
+
+	// Forget any time carried forward.
+	void Reset()
+	{
+		Accumulator = 0.0f;
+	}
+
+	// The size of each step, or zero to pass frame time straight through.
+	float StepSeconds = 0.0f;
+
+	// The time carried forward, always less than a step.
+	float Accumulator = 0.0f;
+};
@@ -10,38 +10,20 @@ These are generally used as the parent actor for goals within the game.
 *********************************************************************************/
 
 #include "BallBearingGoal.h"
-#include "Components/SphereComponent.h"
+#include "BallBearingSubsystem.h"
+#include "BallBearingTrace.h"
 #include "Components/BillboardComponent.h"
 
 
-/**
-Get a ratio of a value between a minimum and maximum amount, optionally clamped.
-*********************************************************************************/
-
-static float GetRatio(float value, float minimum, float maximum, bool clamp = true)
-{
-	if (value > maximum && clamp == true)
-	{
-		return 1.0f;
-	}
-	else if (value > minimum)
-	{
-		return (value - minimum) / (maximum - minimum);
-	}
-	else
-	{
-		return 0.0f;
-	}
-}
-
-
 /**
 Constructor for a goal for ball bearings.
 *********************************************************************************/
 
 ABallBearingGoal::ABallBearingGoal()
 {
-	PrimaryActorTick.bCanEverTick = true;
+	// Goals don't tick themselves, the ball bearing subsystem runs their magnetism in one batch.
+
+	PrimaryActorTick.bCanEverTick = false;
 
 	SetActorHiddenInGame(false);
 }
@@ -64,45 +46,84 @@ void ABallBearingGoal::PostInitializeComponents()
 
 
 /**
-Add magnetism to the proximate ball bearings, drawing them towards our center.
+Register this goal with the ball bearing subsystem.
 *********************************************************************************/
 
-void ABallBearingGoal::Tick(float deltaSeconds)
+void ABallBearingGoal::BeginPlay()
 {
-	Super::Tick(deltaSeconds);
+	Super::BeginPlay();
 
-	FVector ourLocation = GetActorLocation();
-	float sphereRadius = Cast<USphereComponent>(GetCollisionComponent())->GetScaledSphereRadius();
-	float magnetism = Magnetism;
+	UBallBearingSubsystem* subsystem = GetWorld()->GetSubsystem<UBallBearingSubsystem>();
 
-	// If we're cheating then give our goals extra magnetism.
+	if (subsystem != nullptr)
+	{
+		subsystem->RegisterGoal(this);
 
-	static const IConsoleVariable* extraForce = IConsoleManager::Get().FindConsoleVariable(TEXT("OurGame.ExtraMagnetism"));
+		// If the subsystem is finding our proximate bearings for us then we've no need
+		// for the trigger to generate overlap events at all.
 
-	if (extraForce != nullptr &&
-		extraForce->GetInt() != 0)
-	{
-		magnetism *= 4.0f;
+		if (subsystem->IsUsingSpatialBroadphase() == true)
+		{
+			GetCollisionComponent()->SetGenerateOverlapEvents(false);
+		}
 	}
+}
+
+
+/**
+Unregister this goal from the ball bearing subsystem.
+*********************************************************************************/
+
+void ABallBearingGoal::EndPlay(const EEndPlayReason::Type endPlayReason)
+{
+	UBallBearingSubsystem* subsystem = GetWorld()->GetSubsystem<UBallBearingSubsystem>();
+
+	// If our level is streaming out then our occupancy is persisted in the subsystem,
+	// still counted, until we stream back in. Otherwise report ourselves as emptied
+	// first so that filled-goal counts remain balanced.
+
+	if (endPlayReason == EEndPlayReason::RemovedFromWorld &&
+		subsystem != nullptr)
+	{
+		subsystem->PersistGoalState(this);
 
-	// Now iterate around the proximate ball bearings and draw them towards our center
-	// using physics forces scaled by magnetism and distance from the center.
+		Filled = false;
+	}
+	else
+	{
+		SetFilled(false);
+	}
 
-	for (ABallBearing* ballBearing : BallBearings)
+	if (subsystem != nullptr)
 	{
-		FVector difference = ourLocation - ballBearing->GetActorLocation();
-		float distance = difference.Size();
-		FVector direction = difference;
+		subsystem->UnregisterGoal(this);
+	}
+
+	Super::EndPlay(endPlayReason);
+}
 
-		direction.Normalize();
 
-		float ratio = GetRatio(distance, 0.0f, sphereRadius);
-		FVector force = (1.0f - ratio) * magnetism * direction;
+#if WITH_EDITOR
 
-		ballBearing->BallMesh->AddForce(force);
+/**
+Have any baked magnetism field baked again when the goal's properties are changed.
+*********************************************************************************/
+
+void ABallBearingGoal::PostEditChangeProperty(FPropertyChangedEvent& propertyChangedEvent)
+{
+	Super::PostEditChangeProperty(propertyChangedEvent);
+
+	UWorld* world = GetWorld();
+	UBallBearingSubsystem* subsystem = (world != nullptr) ? world->GetSubsystem<UBallBearingSubsystem>() : nullptr;
+
+	if (subsystem != nullptr)
+	{
+		subsystem->InvalidateBakedMagnetism();
 	}
 }
 
+#endif
+
 
 /**
 Add a ball bearing to the list of proximate bearings we're maintaining.
@@ -118,6 +139,15 @@ void ABallBearingGoal::NotifyActorBeginOverlap(AActor* otherActor)
 		ballBearing->Magnetized == true)
 	{
 		BallBearings.AddUnique(ballBearing);
+
+		// Make sure we're not dormant now we have a ball bearing to attract.
+
+		UBallBearingSubsystem* subsystem = GetWorld()->GetSubsystem<UBallBearingSubsystem>();
+
+		if (subsystem != nullptr)
+		{
+			subsystem->WakeGoal(this);
+		}
 	}
 }
 
@@ -141,23 +171,29 @@ void ABallBearingGoal::NotifyActorEndOverlap(AActor* otherActor)
 
 
 /**
-Does this goal have a ball bearing resting in its center?
+Set whether this goal has a ball bearing resting in its center, notifying the subsystem of changes.
 *********************************************************************************/
 
-bool ABallBearingGoal::HasBallBearing() const
+void ABallBearingGoal::SetFilled(bool filled)
 {
-	FVector ourLocation = GetActorLocation();
-
-	for (const ABallBearing* ballBearing : BallBearings)
+	if (Filled != filled)
 	{
-		FVector difference = ourLocation - ballBearing->GetActorLocation();
-		float distance = difference.Size();
+		Filled = filled;
 
-		if (distance < 75.0f)
+		if (Filled == true)
 		{
-			return true;
+			TRACE_BOOKMARK(TEXT("Goal filled: %s"), *GetName());
 		}
-	}
+		else
+		{
+			TRACE_BOOKMARK(TEXT("Goal emptied: %s"), *GetName());
+		}
+
+		UBallBearingSubsystem* subsystem = GetWorld()->GetSubsystem<UBallBearingSubsystem>();
 
-	return false;
+		if (subsystem != nullptr)
+		{
+			subsystem->NotifyGoalOccupancyChanged(this, Filled);
+		}
+	}
 }
@@ -36,15 +36,26 @@ public:
 		float Magnetism = 7500.0f;
 
 	// Does this goal have a ball bearing resting in its center?
-	bool HasBallBearing() const;
+	bool HasBallBearing() const
+	{
+		return Filled;
+	}
 
 protected:
 
 	// Hide the collision and sprite components in-game.
 	virtual void PostInitializeComponents() override;
 
-	// Add magnetism to the proximate ball bearings, drawing them towards our center.
-	virtual void Tick(float deltaSeconds) override;
+	// Register this goal with the ball bearing subsystem.
+	virtual void BeginPlay() override;
+
+	// Unregister this goal from the ball bearing subsystem.
+	virtual void EndPlay(const EEndPlayReason::Type endPlayReason) override;
+
+#if WITH_EDITOR
+	// Have any baked magnetism field baked again when the goal's properties are changed.
+	virtual void PostEditChangeProperty(FPropertyChangedEvent& propertyChangedEvent) override;
+#endif
 
 	// Add a ball bearing to the list of proximate bearings we're maintaining.
 	virtual void NotifyActorBeginOverlap(AActor* otherActor) override;
@@ -54,7 +65,22 @@ protected:
 
 private:
 
+	// Set whether this goal has a ball bearing resting in its center, notifying the subsystem of changes.
+	void SetFilled(bool filled);
+
 	// A list of proximate ball bearings.
 	UPROPERTY(Transient)
 		TArray<ABallBearing*> BallBearings;
+
+	// Does this goal have a ball bearing resting in its center?
+	bool Filled = false;
+
+	// The index of this goal in the subsystem's active goals, or INDEX_NONE while dormant.
+	int32 ActiveGoalIndex = INDEX_NONE;
+
+	// The region within which any ball bearing keeps this goal from going dormant.
+	FBox CoverageBox = FBox(ForceInit);
+
+	// Allow the ball bearing subsystem to run our magnetism and update our occupancy.
+	friend class UBallBearingSubsystem;
 };
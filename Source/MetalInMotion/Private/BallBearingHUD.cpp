@@ -9,6 +9,28 @@ Current maintainer: Rob Baker.
 
 #include "BallBearingHUD.h"
 #include "PlayerBallBearing.h"
+#include "BallBearingSubsystem.h"
+#include "BallBearingPool.h"
+#include "BallBearingImpactAudio.h"
+#include "MetalInMotionGameState.h"
+#include "HAL/IConsoleManager.h"
+
+
+// Is the performance page of the HUD being shown?
+static bool ShowPerformancePage = false;
+
+static FAutoConsoleCommand CTogglePerformanceHUD(TEXT("OurGame.PerformanceHUD"),
+	TEXT("Toggle the performance page of the ball bearing HUD."),
+	FConsoleCommandDelegate::CreateLambda([]() { ShowPerformancePage = !ShowPerformancePage; }));
+
+// The titles of the performance page rows for each system, in EBallBearingTiming order.
+static const TCHAR* PerformanceTitles[(int32)EBallBearingTiming::Num] =
+{
+	L"Magnetism ms",
+	L"Player tick ms",
+	L"End game check ms",
+	L"Hit notifications ms"
+};
 
 
 /**
@@ -23,10 +45,161 @@ void ABallBearingHUD::DrawHUD()
 
 	if (ballBearing != nullptr)
 	{
-		AddBool(L"In contact", ballBearing->InContact);
+		AddBool(L"In contact", ballBearing->IsInContact());
 		AddFloat(L"Speed", ballBearing->GetVelocity().Size() / 100.0f);
 		AddFloat(L"Dash timer", ballBearing->DashTimer);
 		AddFloat(L"Input latitude", ballBearing->InputLatitude);
 		AddFloat(L"Input longitude", ballBearing->InputLongitude);
 	}
+
+	UBallBearingSubsystem* subsystem = GetWorld()->GetSubsystem<UBallBearingSubsystem>();
+
+	if (subsystem != nullptr)
+	{
+		AddInt(L"Active goals", subsystem->GetNumActiveGoals());
+		AddInt(L"Dormant goals", subsystem->GetNumDormantGoals());
+	}
+
+	// The game state is replicated, so this is the same on clients as on the server.
+
+	AMetalInMotionGameState* gameState = GetWorld()->GetGameState<AMetalInMotionGameState>();
+
+	if (gameState != nullptr)
+	{
+		AddInt(L"Filled goals", gameState->NumFilledGoals);
+		AddFloat(L"Finished time", gameState->GetFinishedTime());
+	}
+
+	if (ShowPerformancePage == true)
+	{
+		DrawPerformancePage(GetWorld());
+	}
+	else
+	{
+		// Start the history afresh when the page is shown again. Until the ring buffers
+		// fill, the frames recorded are those from the start of them, so the index has
+		// to go back there along with the count.
+
+		PerformanceHistoryIndex = 0;
+		PerformanceHistoryCount = 0;
+	}
+}
+
+
+/**
+Draw the performance page of the HUD.
+*********************************************************************************/
+
+void ABallBearingHUD::DrawPerformancePage(UWorld* world)
+{
+	// Record this frame's timings into the ring buffers.
+
+	for (int32 i = 0; i < (int32)EBallBearingTiming::Num; i++)
+	{
+		PerformanceHistory[i][PerformanceHistoryIndex] = (float)(FBallBearingTimings::GetSeconds((EBallBearingTiming)i) * 1000.0);
+	}
+
+	PerformanceHistoryIndex = (PerformanceHistoryIndex + 1) % PerformanceHistorySize;
+	PerformanceHistoryCount = FMath::Min(PerformanceHistoryCount + 1, PerformanceHistorySize);
+
+	// Show the rolling average for each system, with its histogram off to the right.
+
+	for (int32 i = 0; i < (int32)EBallBearingTiming::Num; i++)
+	{
+		float total = 0.0f;
+
+		for (int32 j = 0; j < PerformanceHistoryCount; j++)
+		{
+			total += PerformanceHistory[i][j];
+		}
+
+		DrawHistogram(i, GetNextRowPosition() + FVector2D(HorizontalOffset + 60.0f, 0.0f));
+
+		AddFloat(PerformanceTitles[i], total / PerformanceHistoryCount);
+	}
+
+	UBallBearingSubsystem* subsystem = world->GetSubsystem<UBallBearingSubsystem>();
+
+	if (subsystem != nullptr)
+	{
+		AddInt(L"Active bearings", subsystem->GetNumMagnetizedBallBearings());
+		AddInt(L"Forces applied", subsystem->GetNumMagnetismForcesApplied());
+
+		if (subsystem->IsUsingBakedMagnetism() == true)
+		{
+			AddInt(L"Baked bricks", subsystem->GetBakedMagnetism().GetNumBricks());
+		}
+
+		if (subsystem->IsUsingSimulationLOD() == true)
+		{
+			AddInt(L"Near bearings", subsystem->GetNumBallBearingsInTier(EBallBearingSimulationTier::Near));
+			AddInt(L"Mid bearings", subsystem->GetNumBallBearingsInTier(EBallBearingSimulationTier::Mid));
+			AddInt(L"Far bearings", subsystem->GetNumBallBearingsInTier(EBallBearingSimulationTier::Far));
+		}
+	}
+
+	UBallBearingPoolSubsystem* pool = world->GetSubsystem<UBallBearingPoolSubsystem>();
+
+	if (pool != nullptr &&
+		pool->GetNumCreated() > 0)
+	{
+		AddInt(L"Pooled in use", pool->GetNumInUse());
+		AddInt(L"Pool high water", pool->GetHighWaterMark());
+		AddInt(L"Pool misses", pool->GetNumMisses());
+	}
+
+	UBallBearingImpactAudioSubsystem* impactAudio = world->GetSubsystem<UBallBearingImpactAudioSubsystem>();
+
+	if (impactAudio != nullptr &&
+		impactAudio->GetNumVoices() > 0)
+	{
+		AddInt(L"Impact voices", impactAudio->GetNumVoicesPlaying());
+	}
+}
+
+
+/**
+Draw a histogram of the recorded frame times for a system.
+*********************************************************************************/
+
+void ABallBearingHUD::DrawHistogram(int32 system, const FVector2D& position)
+{
+	// The buckets span from zero to the slowest frame recorded, so the shape of the
+	// distribution stays readable whatever the scale of the system's timings.
+
+	const float* history = PerformanceHistory[system];
+	float maximum = 0.0f;
+
+	for (int32 i = 0; i < PerformanceHistoryCount; i++)
+	{
+		maximum = FMath::Max(maximum, history[i]);
+	}
+
+	int32 buckets[HistogramSize] = { 0 };
+	int32 largestBucket = 1;
+
+	if (maximum > 0.0f)
+	{
+		for (int32 i = 0; i < PerformanceHistoryCount; i++)
+		{
+			int32 bucket = FMath::Min((int32)(history[i] / maximum * HistogramSize), HistogramSize - 1);
+
+			largestBucket = FMath::Max(largestBucket, ++buckets[bucket]);
+		}
+	}
+
+	float height = GetLineHeight() - 2.0f;
+	float barWidth = 3.0f;
+
+	DrawRect(FLinearColor(0.0f, 0.0f, 0.0f, 0.5f), position.X, position.Y, HistogramSize * barWidth, height);
+
+	for (int32 i = 0; i < HistogramSize; i++)
+	{
+		if (buckets[i] > 0)
+		{
+			float barHeight = FMath::Max(height * buckets[i] / largestBucket, 1.0f);
+
+			DrawRect(FLinearColor::Green, position.X + i * barWidth, position.Y + height - barHeight, barWidth - 1.0f, barHeight);
+		}
+	}
 }
@@ -5,11 +5,18 @@ Ball bearing HUD for Metal in Motion.
 Original author: Rob Baker.
 Current maintainer: Rob Baker.
 
+The HUD has a performance page, toggled with the OurGame.PerformanceHUD console
+command, showing the game thread time spent in each of the main game systems
+as a rolling average over the last couple of seconds, with a histogram of the
+frame times alongside each, and the number of active ball bearings, goals and
+magnetic forces applied this frame.
+
 *********************************************************************************/
 
 #pragma once
 
 #include "DebugHUD.h"
+#include "BallBearingTimings.h"
 #include "BallBearingHUD.generated.h"
 
 
@@ -26,4 +33,27 @@ protected:
 
 	// Draw the HUD.
 	virtual void DrawHUD() override;
+
+private:
+
+	// Draw the performance page of the HUD.
+	void DrawPerformancePage(UWorld* world);
+
+	// Draw a histogram of the recorded frame times for a system.
+	void DrawHistogram(int32 system, const FVector2D& position);
+
+	// The number of frames of history kept for the performance page.
+	static constexpr int32 PerformanceHistorySize = 120;
+
+	// The number of buckets in each histogram.
+	static constexpr int32 HistogramSize = 24;
+
+	// The recorded milliseconds spent in each system, as a ring buffer per system.
+	float PerformanceHistory[(int32)EBallBearingTiming::Num][PerformanceHistorySize];
+
+	// The index in the ring buffers the next frame will be recorded at.
+	int32 PerformanceHistoryIndex = 0;
+
+	// The number of valid frames in the ring buffers.
+	int32 PerformanceHistoryCount = 0;
 };
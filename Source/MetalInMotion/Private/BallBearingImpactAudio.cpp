@@ -0,0 +1,352 @@
+/**
+
+Impact audio for ball bearings in Metal in Motion.
+
+Original author: Rob Baker.
+Current maintainer: Rob Baker.
+
+*********************************************************************************/
+
+#include "BallBearingImpactAudio.h"
+#include "BallBearingTimings.h"
+#include "BallBearingTrace.h"
+#include "Components/AudioComponent.h"
+#include "GameFramework/PlayerController.h"
+#include "GameFramework/WorldSettings.h"
+#include "HAL/IConsoleManager.h"
+#include "Sound/SoundBase.h"
+#include "Algo/Sort.h"
+
+
+/**
+Play the frame's impacts.
+*********************************************************************************/
+
+void FBallBearingImpactAudioTickFunction::ExecuteTick(float deltaTime, ELevelTick tickType, ENamedThreads::Type currentThread, const FGraphEventRef& myCompletionGraphEvent)
+{
+	if (Subsystem != nullptr &&
+		tickType != LEVELTICK_ViewportsOnly)
+	{
+		Subsystem->Tick(deltaTime);
+	}
+}
+
+
+/**
+Establish the thresholds and the voice budget for this world.
+*********************************************************************************/
+
+void UBallBearingImpactAudioSubsystem::Initialize(FSubsystemCollectionBase& collection)
+{
+	Super::Initialize(collection);
+
+	static const IConsoleVariable* impactAudio = IConsoleManager::Get().FindConsoleVariable(TEXT("OurGame.ImpactAudio"));
+	static const IConsoleVariable* voices = IConsoleManager::Get().FindConsoleVariable(TEXT("OurGame.ImpactAudioVoices"));
+	static const IConsoleVariable* minImpulse = IConsoleManager::Get().FindConsoleVariable(TEXT("OurGame.ImpactAudioMinImpulse"));
+
+	// Dedicated servers have nobody to listen.
+
+	Enabled = (impactAudio == nullptr || impactAudio->GetInt() != 0) && GetWorld()->GetNetMode() != NM_DedicatedServer;
+	NumVoices = FMath::Max((voices != nullptr) ? voices->GetInt() : 16, 1);
+	MinImpulseSquared = FMath::Square(FMath::Max((minImpulse != nullptr) ? minImpulse->GetFloat() : 1000.0f, 0.0f));
+}
+
+
+/**
+Stop playing impacts when the subsystem is torn down along with its world.
+*********************************************************************************/
+
+void UBallBearingImpactAudioSubsystem::Deinitialize()
+{
+	if (TickFunction.IsTickFunctionRegistered() == true)
+	{
+		TickFunction.UnRegisterTickFunction();
+	}
+
+	for (FBallBearingImpactVoice& voice : Voices)
+	{
+		if (voice.Component != nullptr)
+		{
+			voice.Component->Stop();
+		}
+	}
+
+	Voices.Empty();
+	Impacts.Reset();
+
+	Super::Deinitialize();
+}
+
+
+/**
+Set the sound to play for impacts, creating the voices to play it through.
+*********************************************************************************/
+
+void UBallBearingImpactAudioSubsystem::SetImpactSound(USoundBase* sound)
+{
+	if (Enabled == false ||
+		sound == nullptr)
+	{
+		return;
+	}
+
+	ImpactSound = sound;
+
+	// The voices are owned by the world settings, much as the audio device does for
+	// sounds spawned without an owner, and are only ever played and stopped.
+
+	UWorld* world = GetWorld();
+	AWorldSettings* worldSettings = world->GetWorldSettings();
+
+	while (Voices.Num() < NumVoices)
+	{
+		UAudioComponent* component = NewObject<UAudioComponent>((worldSettings != nullptr) ? (UObject*)worldSettings : (UObject*)world);
+
+		component->bAutoActivate = false;
+		component->bAutoDestroy = false;
+		component->bAllowSpatialization = true;
+		component->RegisterComponentWithWorld(world);
+
+		Voices.AddDefaulted_GetRef().Component = component;
+	}
+
+	for (FBallBearingImpactVoice& voice : Voices)
+	{
+		voice.Component->SetSound(ImpactSound);
+	}
+
+	if (TickFunction.IsTickFunctionRegistered() == false)
+	{
+		TickFunction.Subsystem = this;
+		TickFunction.TickGroup = TG_PostPhysics;
+		TickFunction.bCanEverTick = true;
+		TickFunction.RegisterTickFunction(world->PersistentLevel);
+	}
+}
+
+
+/**
+Report a ball bearing hit, normally from its NotifyHit.
+*********************************************************************************/
+
+void UBallBearingImpactAudioSubsystem::ReportImpact(const FVector& location, const FVector& normalImpulse)
+{
+	// This is called for every contact, so reject what we can without a square root.
+
+	float impulseSquared = normalImpulse.SizeSquared();
+
+	if (ImpactSound == nullptr ||
+		impulseSquared < MinImpulseSquared)
+	{
+		return;
+	}
+
+	INC_DWORD_STAT(STAT_ImpactsReported);
+
+	float impulse = FMath::Sqrt(impulseSquared);
+
+	// Coalesce with any impact nearby, keeping the stronger.
+
+	for (FBallBearingImpact& impact : Impacts)
+	{
+		if (FVector::DistSquared(impact.Location, location) < FMath::Square(CoalesceDistance))
+		{
+			if (impulse > impact.Impulse)
+			{
+				impact.Location = location;
+				impact.Impulse = impulse;
+			}
+
+			return;
+		}
+	}
+
+	if (Impacts.Num() < MaxImpacts)
+	{
+		FBallBearingImpact& impact = Impacts.AddDefaulted_GetRef();
+
+		impact.Location = location;
+		impact.Impulse = impulse;
+
+		return;
+	}
+
+	// With the frame full, replace the softest impact if this one's stronger.
+
+	FBallBearingImpact* softest = &Impacts[0];
+
+	for (FBallBearingImpact& impact : Impacts)
+	{
+		if (impact.Impulse < softest->Impulse)
+		{
+			softest = &impact;
+		}
+	}
+
+	if (impulse > softest->Impulse)
+	{
+		softest->Location = location;
+		softest->Impulse = impulse;
+	}
+}
+
+
+/**
+Get the number of voices currently playing impacts.
+*********************************************************************************/
+
+int32 UBallBearingImpactAudioSubsystem::GetNumVoicesPlaying() const
+{
+	int32 numPlaying = 0;
+
+	for (const FBallBearingImpactVoice& voice : Voices)
+	{
+		numPlaying += (voice.Component != nullptr && voice.Component->IsPlaying() == true) ? 1 : 0;
+	}
+
+	return numPlaying;
+}
+
+
+/**
+Cull and play the impacts reported this frame.
+*********************************************************************************/
+
+void UBallBearingImpactAudioSubsystem::Tick(float deltaSeconds)
+{
+	SCOPE_CYCLE_COUNTER(STAT_ImpactAudio);
+	BALL_BEARING_TRACE_SCOPE(BallBearingImpactAudio);
+
+	static const IConsoleVariable* minImpulse = IConsoleManager::Get().FindConsoleVariable(TEXT("OurGame.ImpactAudioMinImpulse"));
+	static const IConsoleVariable* fullImpulse = IConsoleManager::Get().FindConsoleVariable(TEXT("OurGame.ImpactAudioFullImpulse"));
+	static const IConsoleVariable* maxDistance = IConsoleManager::Get().FindConsoleVariable(TEXT("OurGame.ImpactAudioMaxDistance"));
+
+	// Pick up the thresholds for the next frame's hits here, rather than on every hit.
+
+	float minimumImpulse = FMath::Max((minImpulse != nullptr) ? minImpulse->GetFloat() : 1000.0f, 0.0f);
+	float fullVolumeImpulse = FMath::Max((fullImpulse != nullptr) ? fullImpulse->GetFloat() : 20000.0f, minimumImpulse + 1.0f);
+	float maximumDistance = FMath::Max((maxDistance != nullptr) ? maxDistance->GetFloat() : 5000.0f, 1.0f);
+
+	MinImpulseSquared = FMath::Square(minimumImpulse);
+
+	if (Impacts.Num() == 0)
+	{
+		return;
+	}
+
+	// Impacts are heard from the local players' audio listeners.
+
+	ListenerLocations.Reset();
+
+	for (FConstPlayerControllerIterator iterator = GetWorld()->GetPlayerControllerIterator(); iterator; ++iterator)
+	{
+		APlayerController* controller = iterator->Get();
+
+		if (controller != nullptr &&
+			controller->IsLocalController() == true)
+		{
+			FVector location;
+			FVector frontDirection;
+			FVector rightDirection;
+
+			controller->GetAudioListenerPosition(location, frontDirection, rightDirection);
+
+			ListenerLocations.Add(location);
+		}
+	}
+
+	// Cull the impacts out of earshot, prioritizing the rest by their loudness at the
+	// nearest listener.
+
+	for (int32 i = Impacts.Num() - 1; i >= 0; i--)
+	{
+		FBallBearingImpact& impact = Impacts[i];
+		float distanceSquared = MAX_flt;
+
+		for (const FVector& listenerLocation : ListenerLocations)
+		{
+			distanceSquared = FMath::Min(distanceSquared, FVector::DistSquared(impact.Location, listenerLocation));
+		}
+
+		if (distanceSquared > FMath::Square(maximumDistance))
+		{
+			Impacts.RemoveAtSwap(i, 1, false);
+		}
+		else
+		{
+			impact.Priority = FMath::Min(impact.Impulse / fullVolumeImpulse, 1.0f) * (1.0f - FMath::Sqrt(distanceSquared) / maximumDistance);
+		}
+	}
+
+	Algo::Sort(Impacts, [] (const FBallBearingImpact& a, const FBallBearingImpact& b)
+	{
+		return a.Priority > b.Priority;
+	});
+
+	// Play the loudest impacts first, so that once the voices run out it's only the
+	// quietest that get dropped.
+
+	float time = GetWorld()->GetTimeSeconds();
+
+	for (const FBallBearingImpact& impact : Impacts)
+	{
+		FBallBearingImpactVoice* voice = FindVoice(impact.Priority, time);
+
+		if (voice == nullptr)
+		{
+			break;
+		}
+
+		UAudioComponent* component = voice->Component;
+
+		component->SetWorldLocation(impact.Location);
+		component->SetVolumeMultiplier(FMath::GetMappedRangeValueClamped(FVector2D(minimumImpulse, fullVolumeImpulse), FVector2D(0.2f, 1.0f), impact.Impulse));
+		component->SetPitchMultiplier(FMath::GetMappedRangeValueClamped(FVector2D(minimumImpulse, fullVolumeImpulse), FVector2D(0.9f, 1.1f), impact.Impulse));
+		component->Play();
+
+		voice->Priority = impact.Priority;
+		voice->StartTime = time;
+
+		INC_DWORD_STAT(STAT_ImpactsPlayed);
+	}
+
+	Impacts.Reset();
+}
+
+
+/**
+Find a voice for an impact, a free one or one to steal, or nullptr if there's none to be had.
+*********************************************************************************/
+
+FBallBearingImpactVoice* UBallBearingImpactAudioSubsystem::FindVoice(float priority, float time)
+{
+	FBallBearingImpactVoice* lowest = nullptr;
+	float lowestPriority = priority;
+
+	for (FBallBearingImpactVoice& voice : Voices)
+	{
+		if (voice.Component->IsPlaying() == false)
+		{
+			return &voice;
+		}
+
+		// A voice's claim on its component fades as its impact dies away.
+
+		float voicePriority = voice.Priority * FMath::Max(1.0f - (time - voice.StartTime) / VoiceFadeTime, 0.0f);
+
+		if (voicePriority < lowestPriority)
+		{
+			lowest = &voice;
+			lowestPriority = voicePriority;
+		}
+	}
+
+	if (lowest != nullptr)
+	{
+		INC_DWORD_STAT(STAT_ImpactVoicesStolen);
+
+		lowest->Component->Stop();
+	}
+
+	return lowest;
+}
@@ -0,0 +1,170 @@
+/**
+
+Impact audio for ball bearings in Metal in Motion.
+
+Original author: Rob Baker.
+Current maintainer: Rob Baker.
+
+Ball bearings report their hits here rather than playing sounds themselves, as a
+level full of them can make hundreds of contacts a frame. Hits too soft to hear
+are rejected as they're reported, and the rest are coalesced, so hits close to
+one another in the same frame, such as both sides of a collision between two
+ball bearings, become a single impact with the stronger impulse.
+
+Once a frame, after physics, impacts too far from any listener are culled and
+the rest are played loudest first through a fixed pool of audio components, the
+voice budget, created once up front. When every voice is busy, an impact steals
+the voice with the lowest priority if it's louder, a voice's priority fading
+as it ages, and is otherwise dropped. No components are created or destroyed
+in play, however many ball bearings are colliding.
+
+*********************************************************************************/
+
+#pragma once
+
+#include "CoreMinimal.h"
+#include "Subsystems/WorldSubsystem.h"
+#include "Engine/EngineBaseTypes.h"
+#include "BallBearingImpactAudio.generated.h"
+
+class USoundBase;
+class UAudioComponent;
+class UBallBearingImpactAudioSubsystem;
+
+
+/**
+An impact waiting to be played this frame.
+*********************************************************************************/
+
+struct FBallBearingImpact
+{
+	// The location of the impact.
+	FVector Location = FVector::ZeroVector;
+
+	// The magnitude of the impact's impulse.
+	float Impulse = 0.0f;
+
+	// The priority of the impact, from its impulse and distance from the nearest listener.
+	float Priority = 0.0f;
+};
+
+
+/**
+A voice for playing impacts through.
+*********************************************************************************/
+
+USTRUCT()
+struct FBallBearingImpactVoice
+{
+	GENERATED_BODY()
+
+	// The audio component the voice plays through.
+	UPROPERTY(Transient)
+		UAudioComponent* Component = nullptr;
+
+	// The priority of the impact the voice was last started for.
+	float Priority = 0.0f;
+
+	// The world time the voice was last started, in seconds.
+	float StartTime = 0.0f;
+};
+
+
+/**
+Tick function used to play the frame's impacts, after physics.
+*********************************************************************************/
+
+struct FBallBearingImpactAudioTickFunction : public FTickFunction
+{
+	// The subsystem to play the impacts for.
+	UBallBearingImpactAudioSubsystem* Subsystem = nullptr;
+
+	// Play the frame's impacts.
+	virtual void ExecuteTick(float deltaTime, ELevelTick tickType, ENamedThreads::Type currentThread, const FGraphEventRef& myCompletionGraphEvent) override;
+
+	// Describe the tick function for diagnostics.
+	virtual FString DiagnosticMessage() override
+	{
+		return TEXT("FBallBearingImpactAudioTickFunction");
+	}
+};
+
+
+/**
+World subsystem for ball bearing impact audio.
+*********************************************************************************/
+
+UCLASS()
+class METALINMOTION_API UBallBearingImpactAudioSubsystem : public UWorldSubsystem
+{
+	GENERATED_BODY()
+
+public:
+
+	// Establish the thresholds and the voice budget for this world.
+	virtual void Initialize(FSubsystemCollectionBase& collection) override;
+
+	// Stop playing impacts when the subsystem is torn down along with its world.
+	virtual void Deinitialize() override;
+
+	// Set the sound to play for impacts, creating the voices to play it through.
+	void SetImpactSound(USoundBase* sound);
+
+	// Report a ball bearing hit, normally from its NotifyHit.
+	void ReportImpact(const FVector& location, const FVector& normalImpulse);
+
+	// Get the number of voices currently playing impacts.
+	int32 GetNumVoicesPlaying() const;
+
+	// Get the size of the voice budget.
+	int32 GetNumVoices() const
+	{
+		return Voices.Num();
+	}
+
+private:
+
+	// Cull and play the impacts reported this frame.
+	void Tick(float deltaSeconds);
+
+	// Find a voice for an impact, a free one or one to steal, or nullptr if there's none to be had.
+	FBallBearingImpactVoice* FindVoice(float priority, float time);
+
+	// The sound to play for impacts.
+	UPROPERTY(Transient)
+		USoundBase* ImpactSound = nullptr;
+
+	// The voices for playing impacts through.
+	UPROPERTY(Transient)
+		TArray<FBallBearingImpactVoice> Voices;
+
+	// The impacts reported this frame.
+	TArray<FBallBearingImpact, TInlineAllocator<32>> Impacts;
+
+	// Scratch buffer for the locations of the listeners.
+	TArray<FVector> ListenerLocations;
+
+	// The number of voices in the budget.
+	int32 NumVoices = 16;
+
+	// The squared impulse below which hits are too soft to be heard.
+	float MinImpulseSquared = 0.0f;
+
+	// Is impact audio enabled for this world?
+	bool Enabled = false;
+
+	// The tick function used to play the frame's impacts.
+	FBallBearingImpactAudioTickFunction TickFunction;
+
+	// The largest number of impacts held for a frame, beyond which the softest are replaced.
+	static constexpr int32 MaxImpacts = 32;
+
+	// The distance within which hits in the same frame are coalesced into one impact.
+	static constexpr float CoalesceDistance = 100.0f;
+
+	// The time over which a voice's priority fades to nothing, for stealing.
+	static constexpr float VoiceFadeTime = 0.5f;
+
+	// Allow the tick function to tick us.
+	friend struct FBallBearingImpactAudioTickFunction;
+};
@@ -0,0 +1,204 @@
+/**
+
+Baked magnetism field for ball bearings in Metal in Motion.
+
+Original author: Rob Baker.
+Current maintainer: Rob Baker.
+
+*********************************************************************************/
+
+#include "BallBearingMagnetismField.h"
+#include "BallBearingMath.h"
+#include "MetalInMotion.h"
+
+
+/**
+Bake the combined magnetism of a number of goals into the field, with cells of a given size.
+*********************************************************************************/
+
+void FBallBearingMagnetismField::Bake(TArrayView<const FGoal> goals, float cellSize)
+{
+	Reset();
+
+	CellSize = FMath::Max(cellSize, 1.0f);
+	InverseCellSize = 1.0f / CellSize;
+	Goals.Append(goals.GetData(), goals.Num());
+
+	for (const FGoal& goal : Goals)
+	{
+		// The range of nodes the goal reaches, and the bricks holding them, including
+		// those holding them on their far faces.
+
+		FIntVector minimumNode;
+		FIntVector maximumNode;
+
+		for (int32 axis = 0; axis < 3; axis++)
+		{
+			minimumNode[axis] = FMath::CeilToInt((goal.Location[axis] - goal.Radius) * InverseCellSize);
+			maximumNode[axis] = FMath::FloorToInt((goal.Location[axis] + goal.Radius) * InverseCellSize);
+		}
+
+		FIntVector minimumBrick(FloorDivide(minimumNode.X - 1, BrickCells), FloorDivide(minimumNode.Y - 1, BrickCells), FloorDivide(minimumNode.Z - 1, BrickCells));
+		FIntVector maximumBrick(FloorDivide(maximumNode.X, BrickCells), FloorDivide(maximumNode.Y, BrickCells), FloorDivide(maximumNode.Z, BrickCells));
+		float inverseRadius = (goal.Radius > KINDA_SMALL_NUMBER) ? 1.0f / goal.Radius : 0.0f;
+
+		for (int32 bz = minimumBrick.Z; bz <= maximumBrick.Z; bz++)
+		{
+			for (int32 by = minimumBrick.Y; by <= maximumBrick.Y; by++)
+			{
+				for (int32 bx = minimumBrick.X; bx <= maximumBrick.X; bx++)
+				{
+					FIntVector brick(bx, by, bz);
+					int32* existing = BrickIndices.Find(brick);
+					int32 brickIndex = (existing != nullptr) ? *existing : BrickIndices.Add(brick, BrickIndices.Num());
+
+					if (existing == nullptr)
+					{
+						Nodes.AddZeroed(NodesPerBrick);
+					}
+
+					// Add the goal's magnetism to each of the brick's nodes that it reaches.
+
+					FIntVector origin = brick * BrickCells;
+					FIntVector first(FMath::Max(minimumNode.X - origin.X, 0), FMath::Max(minimumNode.Y - origin.Y, 0), FMath::Max(minimumNode.Z - origin.Z, 0));
+					FIntVector last(FMath::Min(maximumNode.X - origin.X, BrickCells), FMath::Min(maximumNode.Y - origin.Y, BrickCells), FMath::Min(maximumNode.Z - origin.Z, BrickCells));
+
+					for (int32 z = first.Z; z <= last.Z; z++)
+					{
+						for (int32 y = first.Y; y <= last.Y; y++)
+						{
+							for (int32 x = first.X; x <= last.X; x++)
+							{
+								FVector location = FVector(origin + FIntVector(x, y, z)) * CellSize;
+								FVector delta = goal.Location - location;
+								FVector force;
+								float distance;
+
+								FBallBearingMath::GetMagnetismForce(delta.X, delta.Y, delta.Z, inverseRadius, goal.Magnetism, force.X, force.Y, force.Z, distance);
+
+								Nodes[GetNodeIndex(brickIndex, x, y, z)] += force;
+							}
+						}
+					}
+				}
+			}
+		}
+	}
+}
+
+
+/**
+Empty the field.
+*********************************************************************************/
+
+void FBallBearingMagnetismField::Reset()
+{
+	BrickIndices.Reset();
+	Nodes.Reset();
+	Goals.Reset();
+
+	CellSize = 0.0f;
+	InverseCellSize = 0.0f;
+}
+
+
+/**
+Sample the field at a location with trilinear interpolation, being zero wherever no goal reaches.
+*********************************************************************************/
+
+FVector FBallBearingMagnetismField::Sample(const FVector& location) const
+{
+	FVector grid = location * InverseCellSize;
+	FIntVector cell(FMath::FloorToInt(grid.X), FMath::FloorToInt(grid.Y), FMath::FloorToInt(grid.Z));
+	FIntVector brick(FloorDivide(cell.X, BrickCells), FloorDivide(cell.Y, BrickCells), FloorDivide(cell.Z, BrickCells));
+	const int32* brickIndex = BrickIndices.Find(brick);
+
+	if (brickIndex == nullptr)
+	{
+		return FVector::ZeroVector;
+	}
+
+	FIntVector local = cell - brick * BrickCells;
+	FVector fraction = grid - FVector(cell);
+	int32 base = GetNodeIndex(*brickIndex, local.X, local.Y, local.Z);
+
+	// The eight nodes around the location, a step in X, Y and Z apart.
+
+	const int32 stepY = BrickNodes;
+	const int32 stepZ = BrickNodes * BrickNodes;
+
+	FVector x00 = FMath::Lerp(Nodes[base], Nodes[base + 1], fraction.X);
+	FVector x10 = FMath::Lerp(Nodes[base + stepY], Nodes[base + stepY + 1], fraction.X);
+	FVector x01 = FMath::Lerp(Nodes[base + stepZ], Nodes[base + stepZ + 1], fraction.X);
+	FVector x11 = FMath::Lerp(Nodes[base + stepZ + stepY], Nodes[base + stepZ + stepY + 1], fraction.X);
+
+	return FMath::Lerp(FMath::Lerp(x00, x10, fraction.Y), FMath::Lerp(x01, x11, fraction.Y), fraction.Z);
+}
+
+
+/**
+Get the exact combined magnetism at a location of the goals the field was baked from.
+*********************************************************************************/
+
+FVector FBallBearingMagnetismField::GetExactForce(const FVector& location) const
+{
+	FVector total = FVector::ZeroVector;
+
+	for (const FGoal& goal : Goals)
+	{
+		FVector delta = goal.Location - location;
+		FVector force;
+		float distance;
+
+		FBallBearingMath::GetMagnetismForce(delta.X, delta.Y, delta.Z, (goal.Radius > KINDA_SMALL_NUMBER) ? 1.0f / goal.Radius : 0.0f, goal.Magnetism, force.X, force.Y, force.Z, distance);
+
+		total += force;
+	}
+
+	return total;
+}
+
+
+/**
+Compare the field against the exact magnetism at random locations within the goals, logging the error.
+*********************************************************************************/
+
+void FBallBearingMagnetismField::ReportError(int32 numSamples, int32 seed) const
+{
+	if (Goals.Num() == 0 ||
+		numSamples <= 0)
+	{
+		return;
+	}
+
+	// Sample uniformly within a random goal's sphere each time, measuring the error
+	// relative to that goal's magnetism so goals of different strengths compare.
+
+	FRandomStream random(seed);
+	double totalError = 0.0;
+	double totalRelativeError = 0.0;
+	float maximumError = 0.0f;
+	float maximumRelativeError = 0.0f;
+	FVector maximumErrorLocation = FVector::ZeroVector;
+
+	for (int32 i = 0; i < numSamples; i++)
+	{
+		const FGoal& goal = Goals[random.RandHelper(Goals.Num())];
+		FVector location = goal.Location + random.GetUnitVector() * goal.Radius * FMath::Pow(random.GetFraction(), 1.0f / 3.0f);
+		float error = (Sample(location) - GetExactForce(location)).Size();
+		float relativeError = (goal.Magnetism > KINDA_SMALL_NUMBER) ? error / goal.Magnetism : 0.0f;
+
+		totalError += error;
+		totalRelativeError += relativeError;
+
+		if (error > maximumError)
+		{
+			maximumError = error;
+			maximumErrorLocation = location;
+		}
+
+		maximumRelativeError = FMath::Max(maximumRelativeError, relativeError);
+	}
+
+	UE_LOG(LogMetalInMotion, Log, TEXT("Baked magnetism error over %d samples: mean %.1f (%.2f%% of magnetism), max %.1f (%.2f%%) at %s"), numSamples, totalError / numSamples, totalRelativeError * 100.0 / numSamples, maximumError, maximumRelativeError * 100.0f, *maximumErrorLocation.ToString());
+}
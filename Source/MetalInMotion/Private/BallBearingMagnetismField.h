@@ -0,0 +1,121 @@
+/**
+
+Baked magnetism field for ball bearings in Metal in Motion.
+
+Original author: Rob Baker.
+Current maintainer: Rob Baker.
+
+Goals never move, so the combined magnetism of all of them can be baked into a
+grid of force vectors once, rather than being worked out for every goal and
+ball bearing pairing every frame. A ball bearing then needs just one trilinearly
+interpolated lookup for its force, however many goals it's close to.
+
+The grid is sparse, held as bricks of cells that are only allocated where a goal
+reaches. Each brick holds the nodes on its far faces too, duplicating those of
+its neighbors, so that all eight nodes for a lookup are always in one brick and
+a lookup only ever needs the one map find.
+
+Interpolation smooths the field out over a cell, so the force is most under-
+estimated at a goal's center, where it flips direction. The finer the cells,
+the closer the field follows the exact magnetism, for more memory and a longer
+bake. The error can be measured against the exact magnetism after baking.
+
+*********************************************************************************/
+
+#pragma once
+
+#include "CoreMinimal.h"
+
+
+/**
+Baked magnetism field for ball bearings.
+*********************************************************************************/
+
+class METALINMOTION_API FBallBearingMagnetismField
+{
+public:
+
+	// A goal to bake into the field.
+	struct FGoal
+	{
+		// The location of the goal's center.
+		FVector Location = FVector::ZeroVector;
+
+		// The radius within which the goal's magnetism reaches.
+		float Radius = 0.0f;
+
+		// The strength of the goal's magnetism.
+		float Magnetism = 0.0f;
+	};
+
+	// Bake the combined magnetism of a number of goals into the field, with cells of a given size.
+	void Bake(TArrayView<const FGoal> goals, float cellSize);
+
+	// Empty the field.
+	void Reset();
+
+	// Has the field been baked?
+	bool IsBaked() const
+	{
+		return CellSize > 0.0f;
+	}
+
+	// Sample the field at a location with trilinear interpolation, being zero wherever no goal reaches.
+	FVector Sample(const FVector& location) const;
+
+	// Get the exact combined magnetism at a location of the goals the field was baked from.
+	FVector GetExactForce(const FVector& location) const;
+
+	// Compare the field against the exact magnetism at random locations within the goals, logging the error.
+	void ReportError(int32 numSamples, int32 seed) const;
+
+	// Get the number of bricks allocated in the field.
+	int32 GetNumBricks() const
+	{
+		return BrickIndices.Num();
+	}
+
+	// Get the memory allocated for the field, in bytes.
+	SIZE_T GetAllocatedSize() const
+	{
+		return Nodes.GetAllocatedSize() + BrickIndices.GetAllocatedSize() + Goals.GetAllocatedSize();
+	}
+
+private:
+
+	// Get the brick holding a node, for nodes on the near faces of a brick.
+	static int32 FloorDivide(int32 value, int32 divisor)
+	{
+		return (value >= 0) ? value / divisor : (value - divisor + 1) / divisor;
+	}
+
+	// Get the index of a node within the node buffer.
+	static int32 GetNodeIndex(int32 brickIndex, int32 x, int32 y, int32 z)
+	{
+		return brickIndex * NodesPerBrick + (z * BrickNodes + y) * BrickNodes + x;
+	}
+
+	// The number of cells along each side of a brick.
+	static constexpr int32 BrickCells = 8;
+
+	// The number of nodes along each side of a brick, including those on its far faces.
+	static constexpr int32 BrickNodes = BrickCells + 1;
+
+	// The number of nodes in each brick.
+	static constexpr int32 NodesPerBrick = BrickNodes * BrickNodes * BrickNodes;
+
+	// The index of each allocated brick, by its coordinates.
+	TMap<FIntVector, int32> BrickIndices;
+
+	// The force at every node of every brick.
+	TArray<FVector> Nodes;
+
+	// The goals the field was baked from.
+	TArray<FGoal> Goals;
+
+	// The size of each cell, or zero if not baked.
+	float CellSize = 0.0f;
+
+	// The reciprocal of the size of each cell.
+	float InverseCellSize = 0.0f;
+};
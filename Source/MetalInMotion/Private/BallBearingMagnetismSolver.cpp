@@ -0,0 +1,375 @@
+/**
+
+Magnetism solver for ball bearings in Metal in Motion.
+
+Original author: Rob Baker.
+Current maintainer: Rob Baker.
+
+*********************************************************************************/
+
+#include "BallBearingMagnetismSolver.h"
+#include "PhysicsEngine/BodyInstance.h"
+#include "Async/ParallelFor.h"
+
+
+/**
+Clear the solver ready for gathering a new frame, keeping its allocations.
+*********************************************************************************/
+
+void FBallBearingMagnetismSolver::Reset()
+{
+	GoalLocations.Reset();
+	GoalInverseRadii.Reset();
+	GoalMagnetisms.Reset();
+	GoalFilled.Reset();
+
+	Bodies.Reset();
+	BodyLocations.Reset();
+	BodyForces.Reset();
+	BodySettled.Reset();
+	BodyAsleep.Reset();
+	BodyForceScales.Reset();
+	BodyIndices.Reset();
+
+	ChunkPairStarts.Reset();
+	PairGoals.Reset();
+	PairBodies.Reset();
+	PairDeltaX.Reset();
+	PairDeltaY.Reset();
+	PairDeltaZ.Reset();
+	PairInverseRadius.Reset();
+	PairMagnetism.Reset();
+
+	NumPairs = 0;
+	NumForcesApplied = 0;
+	NumBodiesAsleep = 0;
+}
+
+
+/**
+Add a goal to the solver, returning its index.
+*********************************************************************************/
+
+int32 FBallBearingMagnetismSolver::AddGoal(const FVector& location, float radius, float magnetism)
+{
+	// Start a new chunk every so many goals, padding the pairings so that each chunk
+	// begins on a vector register boundary and no two chunks ever share one.
+
+	if (GoalLocations.Num() % GoalsPerChunk == 0)
+	{
+		while (PairGoals.Num() % 4 != 0)
+		{
+			AddPaddingPair();
+		}
+
+		ChunkPairStarts.Add(PairGoals.Num());
+	}
+
+	GoalLocations.Add(location);
+	GoalInverseRadii.Add((radius > KINDA_SMALL_NUMBER) ? 1.0f / radius : 0.0f);
+	GoalMagnetisms.Add(magnetism);
+
+	return GoalFilled.Add(0);
+}
+
+
+/**
+Add a ball bearing's physics body to the solver, returning its index, noting whether it's asleep.
+*********************************************************************************/
+
+int32 FBallBearingMagnetismSolver::AddBody(FBodyInstance* body, const FVector& location, float forceScale)
+{
+	check(body != nullptr);
+
+	const int32* existing = BodyIndices.Find(body);
+
+	if (existing != nullptr)
+	{
+		return *existing;
+	}
+
+	int32 index = Bodies.Add(body);
+	bool asleep = (body->IsInstanceAwake() == false);
+
+	BodyLocations.Add(location);
+	BodyForces.Add(FVector::ZeroVector);
+	BodySettled.Add(0);
+	BodyAsleep.Add((asleep == true) ? 1 : 0);
+	BodyForceScales.Add(forceScale);
+	BodyIndices.Add(body, index);
+
+	NumBodiesAsleep += (asleep == true) ? 1 : 0;
+
+	return index;
+}
+
+
+/**
+Pair a goal with a proximate body. Pairs for a goal must be added contiguously.
+*********************************************************************************/
+
+void FBallBearingMagnetismSolver::AddPair(int32 goalIndex, int32 bodyIndex)
+{
+	checkSlow(PairGoals.Num() == 0 || PairGoals.Last() <= goalIndex);
+
+	FVector difference = GoalLocations[goalIndex] - BodyLocations[bodyIndex];
+
+	PairGoals.Add(goalIndex);
+	PairBodies.Add(bodyIndex);
+	PairDeltaX.Add(difference.X);
+	PairDeltaY.Add(difference.Y);
+	PairDeltaZ.Add(difference.Z);
+	PairInverseRadius.Add(GoalInverseRadii[goalIndex]);
+	PairMagnetism.Add(GoalMagnetisms[goalIndex]);
+
+	NumPairs++;
+}
+
+
+/**
+Remove a body and its pairings, for when it leaves play while they're still in use.
+*********************************************************************************/
+
+void FBallBearingMagnetismSolver::RemoveBody(FBodyInstance* body)
+{
+	int32 bodyIndex = INDEX_NONE;
+
+	if (BodyIndices.RemoveAndCopyValue(body, bodyIndex) == false)
+	{
+		return;
+	}
+
+	// The body's slot is emptied rather than removed, so no other indices move, and
+	// its pairings are turned into padding, which solves to nothing.
+
+	Bodies[bodyIndex] = nullptr;
+	BodyForces[bodyIndex] = FVector::ZeroVector;
+	BodySettled[bodyIndex] = 0;
+	BodyForceScales[bodyIndex] = 0.0f;
+
+	if (BodyAsleep[bodyIndex] != 0)
+	{
+		BodyAsleep[bodyIndex] = 0;
+
+		NumBodiesAsleep--;
+	}
+
+	TArray<int32, TInlineAllocator<8>> filledGoals;
+
+	for (int32 i = 0; i < PairBodies.Num(); i++)
+	{
+		if (PairBodies[i] == bodyIndex)
+		{
+			if (GoalFilled[PairGoals[i]] != 0)
+			{
+				filledGoals.AddUnique(PairGoals[i]);
+			}
+
+			PairGoals[i] = INDEX_NONE;
+			PairBodies[i] = INDEX_NONE;
+			PairDeltaX[i] = 0.0f;
+			PairDeltaY[i] = 0.0f;
+			PairDeltaZ[i] = 0.0f;
+			PairInverseRadius[i] = 0.0f;
+			PairMagnetism[i] = 0.0f;
+
+			NumPairs--;
+		}
+	}
+
+	// A goal that was filled may only have been filled by this body, so check its
+	// remaining pairings again. Goals are only ever filled by a solve, so their
+	// pairings' distances are those it wrote.
+
+	for (int32 goalIndex : filledGoals)
+	{
+		GoalFilled[goalIndex] = 0;
+
+		for (int32 i = 0; i < PairGoals.Num(); i++)
+		{
+			if (PairGoals[i] == goalIndex &&
+				FBallBearingMath::IsSettled(PairDistance[i]) == true)
+			{
+				GoalFilled[goalIndex] = 1;
+			}
+		}
+	}
+}
+
+
+/**
+Add a padding pairing, which has no magnetism and is never read back.
+*********************************************************************************/
+
+void FBallBearingMagnetismSolver::AddPaddingPair()
+{
+	PairGoals.Add(INDEX_NONE);
+	PairBodies.Add(INDEX_NONE);
+	PairDeltaX.Add(0.0f);
+	PairDeltaY.Add(0.0f);
+	PairDeltaZ.Add(0.0f);
+	PairInverseRadius.Add(0.0f);
+	PairMagnetism.Add(0.0f);
+}
+
+
+/**
+Compute the magnetic force for every pairing and sum them for each body.
+*********************************************************************************/
+
+void FBallBearingMagnetismSolver::Solve(bool parallel)
+{
+	// Pad the final chunk out to a whole number of vector registers.
+
+	while (PairGoals.Num() % 4 != 0)
+	{
+		AddPaddingPair();
+	}
+
+	int32 numPadded = PairGoals.Num();
+
+	PairForceX.SetNumUninitialized(numPadded, false);
+	PairForceY.SetNumUninitialized(numPadded, false);
+	PairForceZ.SetNumUninitialized(numPadded, false);
+	PairDistance.SetNumUninitialized(numPadded, false);
+
+	// Solve each chunk of goals, in parallel if asked to and there's more than one.
+
+	ParallelFor(ChunkPairStarts.Num(), [this](int32 chunkIndex)
+	{
+		SolveChunk(chunkIndex);
+	}, parallel == false || ChunkPairStarts.Num() < 2);
+
+	// Sum the forces for each body serially in pairing order, so that the floating
+	// point results never depend on how the chunks were scheduled. Note which bodies
+	// are resting in the center of a goal while we're at it.
+
+	for (int32 i = 0; i < numPadded; i++)
+	{
+		int32 bodyIndex = PairBodies[i];
+
+		if (bodyIndex != INDEX_NONE)
+		{
+			if (BakedField == nullptr)
+			{
+				BodyForces[bodyIndex] += FVector(PairForceX[i], PairForceY[i], PairForceZ[i]);
+			}
+
+			if (FBallBearingMath::IsSettled(PairDistance[i]) == true)
+			{
+				BodySettled[bodyIndex] = 1;
+			}
+		}
+	}
+
+	// With a baked field, each body's force is a single lookup, however many goals
+	// it's paired with.
+
+	if (BakedField != nullptr)
+	{
+		for (int32 i = 0; i < Bodies.Num(); i++)
+		{
+			BodyForces[i] = BakedField->Sample(BodyLocations[i]) * BakedFieldScale;
+		}
+	}
+}
+
+
+/**
+Solve the pairings for one chunk of goals.
+*********************************************************************************/
+
+void FBallBearingMagnetismSolver::SolveChunk(int32 chunkIndex)
+{
+	int32 start = ChunkPairStarts[chunkIndex];
+	int32 end = (ChunkPairStarts.IsValidIndex(chunkIndex + 1) == true) ? ChunkPairStarts[chunkIndex + 1] : PairGoals.Num();
+
+	// Chunks start on a vector register boundary and are padded out to whole ones,
+	// so the batch can run straight over the chunk's slice of the pairings. With a
+	// baked field, only the distances are needed.
+
+	if (BakedField != nullptr)
+	{
+		FBallBearingMath::GetDistances(end - start, &PairDeltaX[start], &PairDeltaY[start], &PairDeltaZ[start], &PairDistance[start]);
+	}
+	else
+	{
+		FBallBearingMath::GetMagnetismForces(end - start, &PairDeltaX[start], &PairDeltaY[start], &PairDeltaZ[start], &PairInverseRadius[start], &PairMagnetism[start], &PairForceX[start], &PairForceY[start], &PairForceZ[start], &PairDistance[start]);
+	}
+
+	// Note which of this chunk's goals have a bearing at their center. Goals never
+	// span chunks, so no other chunk writes to these.
+
+	for (int32 i = start; i < end; i++)
+	{
+		int32 goalIndex = PairGoals[i];
+
+		if (goalIndex != INDEX_NONE &&
+			FBallBearingMath::IsSettled(PairDistance[i]) == true)
+		{
+			GoalFilled[goalIndex] = 1;
+		}
+	}
+}
+
+
+/**
+Refresh the body locations from the physics scene, ready to solve the same pairings again.
+*********************************************************************************/
+
+void FBallBearingMagnetismSolver::RefreshLocations()
+{
+	for (int32 i = 0; i < Bodies.Num(); i++)
+	{
+		if (Bodies[i] != nullptr)
+		{
+			BodyLocations[i] = Bodies[i]->GetUnrealWorldTransform().GetLocation();
+		}
+
+		BodyForces[i] = FVector::ZeroVector;
+	}
+
+	FMemory::Memzero(GoalFilled.GetData(), GoalFilled.Num());
+	FMemory::Memzero(BodySettled.GetData(), BodySettled.Num());
+
+	for (int32 i = 0; i < PairGoals.Num(); i++)
+	{
+		int32 goalIndex = PairGoals[i];
+
+		if (goalIndex != INDEX_NONE)
+		{
+			FVector difference = GoalLocations[goalIndex] - BodyLocations[PairBodies[i]];
+
+			PairDeltaX[i] = difference.X;
+			PairDeltaY[i] = difference.Y;
+			PairDeltaZ[i] = difference.Z;
+		}
+	}
+
+	NumForcesApplied = 0;
+}
+
+
+/**
+Apply the summed forces to their bodies in one batch, optionally spread across substeps.
+*********************************************************************************/
+
+void FBallBearingMagnetismSolver::ApplyForces(bool allowSubstepping)
+{
+	// Bodies that have been pulled equally in every direction, or are sat right on a
+	// goal's center, have nothing to apply. Sleeping bodies are left to sleep, as
+	// adding a force would wake them, and bodies skipping this frame are skipped.
+
+	for (int32 i = 0; i < Bodies.Num(); i++)
+	{
+		if (Bodies[i] != nullptr &&
+			BodyForces[i].IsZero() == false &&
+			BodyAsleep[i] == 0 &&
+			BodyForceScales[i] > 0.0f)
+		{
+			Bodies[i]->AddForce(BodyForces[i] * BodyForceScales[i], allowSubstepping, false);
+
+			NumForcesApplied++;
+		}
+	}
+}
@@ -0,0 +1,237 @@
+/**
+
+Magnetism solver for ball bearings in Metal in Motion.
+
+Original author: Rob Baker.
+Current maintainer: Rob Baker.
+
+Rather than each goal ticking and pushing its proximate ball bearings around one
+at a time, the goals and bearings are gathered into structure-of-arrays buffers
+once per frame, every goal / bearing pairing is solved four at a time using the
+batch magnetism in BallBearingMath.h, and the summed forces are applied in one
+batch.
+
+Goals are split into fixed-size chunks which can be solved in parallel, each
+chunk writing only to its own slice of the pairing buffers. Forces are then
+summed for each body serially in pairing order, so the results are identical
+however many threads took part.
+
+The pairings gathered for a frame can also be solved again for each physics step
+within it, refreshing the bodies' locations from the physics scene each time. A
+body leaving play before then can be removed from them without disturbing the
+rest.
+
+Each body can have its force scaled, or skipped for the frame with a zero scale,
+for ball bearings being simulated at a reduced rate.
+
+Optionally, the forces can come from a baked magnetism field instead, one lookup
+per body. The pairings are still solved for their distances, so goal occupancy
+and settling work just the same.
+
+Bodies that are asleep when gathered are still paired, so goals they're resting
+in stay filled, but no force is applied to them as that would wake them again.
+
+*********************************************************************************/
+
+#pragma once
+
+#include "CoreMinimal.h"
+#include "BallBearingMath.h"
+#include "BallBearingMagnetismField.h"
+
+struct FBodyInstance;
+
+
+/**
+Magnetism solver for ball bearings in Metal in Motion.
+*********************************************************************************/
+
+class METALINMOTION_API FBallBearingMagnetismSolver
+{
+public:
+
+	// The distance from a goal's center within which a ball bearing is considered resting there.
+	static constexpr float SettleDistance = FBallBearingMath::SettleDistance;
+
+	// Clear the solver ready for gathering a new frame, keeping its allocations.
+	void Reset();
+
+	// Add a goal to the solver, returning its index.
+	int32 AddGoal(const FVector& location, float radius, float magnetism);
+
+	// Add a ball bearing's physics body to the solver, returning its index, noting whether it's asleep.
+	// Adding the same body more than once returns the same index.
+	int32 AddBody(FBodyInstance* body, const FVector& location, float forceScale = 1.0f);
+
+	// Pair a goal with a proximate body. Pairs for a goal must be added contiguously.
+	void AddPair(int32 goalIndex, int32 bodyIndex);
+
+	// Remove a body and its pairings, for when it leaves play while they're still in use.
+	void RemoveBody(FBodyInstance* body);
+
+	// Take the forces from a baked magnetism field, scaled, rather than the pairings, or from the pairings if null.
+	void SetBakedField(const FBallBearingMagnetismField* field, float scale)
+	{
+		BakedField = field;
+		BakedFieldScale = scale;
+	}
+
+	// Set the number of goals in each chunk of work solved in parallel.
+	void SetGoalsPerChunk(int32 goalsPerChunk)
+	{
+		check(GoalLocations.Num() == 0);
+
+		GoalsPerChunk = FMath::Max(goalsPerChunk, 1);
+	}
+
+	// Compute the magnetic force for every pairing and sum them for each body.
+	void Solve(bool parallel);
+
+	// Refresh the body locations from the physics scene, ready to solve the same pairings again.
+	void RefreshLocations();
+
+	// Apply the summed forces to their bodies in one batch, optionally spread across substeps.
+	void ApplyForces(bool allowSubstepping = true);
+
+	// Does the goal at the given index have a ball bearing resting in its center?
+	bool IsGoalFilled(int32 goalIndex) const
+	{
+		return GoalFilled[goalIndex] != 0;
+	}
+
+	// Get the physics body at the given index, or null if it's been removed.
+	FBodyInstance* GetBody(int32 bodyIndex) const
+	{
+		return Bodies[bodyIndex];
+	}
+
+	// Is the body at the given index resting in the center of any goal it's paired with?
+	bool IsBodySettled(int32 bodyIndex) const
+	{
+		return BodySettled[bodyIndex] != 0;
+	}
+
+	// Was the body at the given index asleep when it was gathered?
+	bool IsBodyAsleep(int32 bodyIndex) const
+	{
+		return BodyAsleep[bodyIndex] != 0;
+	}
+
+	// Get the number of bodies that were asleep when gathered this frame.
+	int32 GetNumBodiesAsleep() const
+	{
+		return NumBodiesAsleep;
+	}
+
+	// Get the number of goals gathered this frame.
+	int32 GetNumGoals() const
+	{
+		return GoalLocations.Num();
+	}
+
+	// Get the number of bodies gathered this frame.
+	int32 GetNumBodies() const
+	{
+		return Bodies.Num();
+	}
+
+	// Get the number of goal / body pairings gathered this frame.
+	int32 GetNumPairs() const
+	{
+		return NumPairs;
+	}
+
+	// Get the number of forces applied to bodies this frame.
+	int32 GetNumForcesApplied() const
+	{
+		return NumForcesApplied;
+	}
+
+	// Get the number of chunks of work the goals were split into this frame.
+	int32 GetNumChunks() const
+	{
+		return ChunkPairStarts.Num();
+	}
+
+private:
+
+	// Add a padding pairing, which has no magnetism and is never read back.
+	void AddPaddingPair();
+
+	// Solve the pairings for one chunk of goals.
+	void SolveChunk(int32 chunkIndex);
+
+	// Float buffers aligned for loading straight into vector registers.
+	typedef TArray<float, TAlignedHeapAllocator<16>> FAlignedFloats;
+
+	// The location of each goal.
+	TArray<FVector> GoalLocations;
+
+	// The reciprocal of the radius of each goal.
+	TArray<float> GoalInverseRadii;
+
+	// The magnetism of each goal.
+	TArray<float> GoalMagnetisms;
+
+	// Whether each goal has a ball bearing resting in its center, written by Solve.
+	TArray<uint8> GoalFilled;
+
+	// The physics body of each ball bearing.
+	TArray<FBodyInstance*> Bodies;
+
+	// The location of each ball bearing.
+	TArray<FVector> BodyLocations;
+
+	// The summed force for each ball bearing, written by Solve.
+	TArray<FVector> BodyForces;
+
+	// Whether each ball bearing is resting in the center of a goal, written by Solve.
+	TArray<uint8> BodySettled;
+
+	// Whether each ball bearing was asleep when it was gathered.
+	TArray<uint8> BodyAsleep;
+
+	// The scale for the summed force on each ball bearing when it's applied.
+	TArray<float> BodyForceScales;
+
+	// Lookup from a physics body to its index, to avoid gathering a body twice.
+	TMap<FBodyInstance*, int32> BodyIndices;
+
+	// The number of goals in each chunk of work solved in parallel.
+	int32 GoalsPerChunk = 32;
+
+	// The baked magnetism field to take the forces from, if any.
+	const FBallBearingMagnetismField* BakedField = nullptr;
+
+	// The scale for the forces taken from the baked magnetism field.
+	float BakedFieldScale = 1.0f;
+
+	// The first pairing of each chunk, always a multiple of four.
+	TArray<int32> ChunkPairStarts;
+
+	// The goal index of each pairing, or INDEX_NONE for padding.
+	TArray<int32> PairGoals;
+
+	// The body index of each pairing, or INDEX_NONE for padding.
+	TArray<int32> PairBodies;
+
+	// Structure-of-arrays buffers for each pairing, with each chunk padded to a multiple of four.
+	FAlignedFloats PairDeltaX;
+	FAlignedFloats PairDeltaY;
+	FAlignedFloats PairDeltaZ;
+	FAlignedFloats PairInverseRadius;
+	FAlignedFloats PairMagnetism;
+	FAlignedFloats PairForceX;
+	FAlignedFloats PairForceY;
+	FAlignedFloats PairForceZ;
+	FAlignedFloats PairDistance;
+
+	// The number of valid pairings, not counting any padding.
+	int32 NumPairs = 0;
+
+	// The number of forces applied to bodies this frame.
+	int32 NumForcesApplied = 0;
+
+	// The number of bodies that were asleep when gathered this frame.
+	int32 NumBodiesAsleep = 0;
+};
@@ -0,0 +1,176 @@
+/**
+
+Ball bearing physics math for Metal in Motion.
+
+Original author: Rob Baker.
+Current maintainer: Rob Baker.
+
+The math at the heart of the gameplay: the magnetism force law, goal settling,
+and the maximum speed clamp with its braking curve for dashing. It depends on
+nothing but the standard library, so that it can be compiled, tested and
+benchmarked outside of the engine, by Tests/BallBearingMath, and the game code
+calls it rather than repeating it.
+
+Magnetism is provided for a single pairing and for batches of pairings held as
+separate, 16-byte aligned arrays of components. The batch version uses SSE where
+it's available, four pairings at a time, and falls back on the scalar version
+otherwise. Both use correctly rounded square roots and divisions in the same
+order, so they give bit-identical results, so long as the compiler isn't told
+to contract multiplies and adds into fused operations.
+
+*********************************************************************************/
+
+#pragma once
+
+#include <cmath>
+#include <algorithm>
+
+#if defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#define BALL_BEARING_MATH_SSE 1
+#include <emmintrin.h>
+#else
+#define BALL_BEARING_MATH_SSE 0
+#endif
+
+
+/**
+Ball bearing physics math, independent of the engine.
+*********************************************************************************/
+
+struct FBallBearingMath
+{
+	// The distance from a goal's center within which a ball bearing is considered resting there.
+	static constexpr float SettleDistance = 75.0f;
+
+	// The squared distance below which a ball bearing is considered exactly on a goal's center.
+	static constexpr float CenterDistanceSquared = 1.e-8f;
+
+	// Get the ratio of a distance to a goal's radius, given as its inverse, clamped to 1.
+	static float GetRatio(float distance, float inverseRadius)
+	{
+		return std::min(distance * inverseRadius, 1.0f);
+	}
+
+	// Is a ball bearing at a distance from a goal's center resting there?
+	static bool IsSettled(float distance)
+	{
+		return distance < SettleDistance;
+	}
+
+	// Get the magnetic force on a ball bearing offset from a goal's center by a delta, and its distance.
+	// The force is (1 - ratio) * magnetism towards the center, and nothing exactly on the center.
+	static void GetMagnetismForce(float deltaX, float deltaY, float deltaZ, float inverseRadius, float magnetism, float& forceX, float& forceY, float& forceZ, float& distance)
+	{
+		float distanceSquared = deltaZ * deltaZ + (deltaY * deltaY + deltaX * deltaX);
+
+		if (distanceSquared > CenterDistanceSquared)
+		{
+			distance = std::sqrt(distanceSquared);
+
+			float scale = ((1.0f - GetRatio(distance, inverseRadius)) * magnetism) / distance;
+
+			forceX = deltaX * scale;
+			forceY = deltaY * scale;
+			forceZ = deltaZ * scale;
+		}
+		else
+		{
+			distance = 0.0f;
+			forceX = 0.0f;
+			forceY = 0.0f;
+			forceZ = 0.0f;
+		}
+	}
+
+	// Get the magnetic forces on a batch of ball bearings and their distances, as GetMagnetismForce does.
+	// The arrays must be 16-byte aligned and the count a multiple of 4.
+	static void GetMagnetismForces(int count, const float* deltaX, const float* deltaY, const float* deltaZ, const float* inverseRadius, const float* magnetism, float* forceX, float* forceY, float* forceZ, float* distance)
+	{
+#if BALL_BEARING_MATH_SSE
+		const __m128 one = _mm_set1_ps(1.0f);
+		const __m128 center = _mm_set1_ps(CenterDistanceSquared);
+
+		for (int i = 0; i < count; i += 4)
+		{
+			__m128 dx = _mm_load_ps(deltaX + i);
+			__m128 dy = _mm_load_ps(deltaY + i);
+			__m128 dz = _mm_load_ps(deltaZ + i);
+
+			__m128 distanceSquared = _mm_add_ps(_mm_mul_ps(dz, dz), _mm_add_ps(_mm_mul_ps(dy, dy), _mm_mul_ps(dx, dx)));
+			__m128 valid = _mm_cmpgt_ps(distanceSquared, center);
+
+			// Bearings on the center divide by one instead, and are masked out after.
+
+			__m128 d = _mm_and_ps(valid, _mm_sqrt_ps(distanceSquared));
+			__m128 divisor = _mm_or_ps(d, _mm_andnot_ps(valid, one));
+			__m128 ratio = _mm_min_ps(_mm_mul_ps(d, _mm_load_ps(inverseRadius + i)), one);
+			__m128 scale = _mm_and_ps(valid, _mm_div_ps(_mm_mul_ps(_mm_sub_ps(one, ratio), _mm_load_ps(magnetism + i)), divisor));
+
+			_mm_store_ps(forceX + i, _mm_mul_ps(dx, scale));
+			_mm_store_ps(forceY + i, _mm_mul_ps(dy, scale));
+			_mm_store_ps(forceZ + i, _mm_mul_ps(dz, scale));
+			_mm_store_ps(distance + i, d);
+		}
+#else
+		for (int i = 0; i < count; i++)
+		{
+			GetMagnetismForce(deltaX[i], deltaY[i], deltaZ[i], inverseRadius[i], magnetism[i], forceX[i], forceY[i], forceZ[i], distance[i]);
+		}
+#endif
+	}
+
+	// Get the distances of a batch of ball bearings from their goals' centers, without their forces.
+	// The arrays must be 16-byte aligned and the count a multiple of 4.
+	static void GetDistances(int count, const float* deltaX, const float* deltaY, const float* deltaZ, float* distance)
+	{
+#if BALL_BEARING_MATH_SSE
+		for (int i = 0; i < count; i += 4)
+		{
+			__m128 dx = _mm_load_ps(deltaX + i);
+			__m128 dy = _mm_load_ps(deltaY + i);
+			__m128 dz = _mm_load_ps(deltaZ + i);
+
+			__m128 distanceSquared = _mm_add_ps(_mm_mul_ps(dz, dz), _mm_add_ps(_mm_mul_ps(dy, dy), _mm_mul_ps(dx, dx)));
+			__m128 valid = _mm_cmpgt_ps(distanceSquared, _mm_set1_ps(CenterDistanceSquared));
+
+			_mm_store_ps(distance + i, _mm_and_ps(valid, _mm_sqrt_ps(distanceSquared)));
+		}
+#else
+		for (int i = 0; i < count; i++)
+		{
+			float distanceSquared = deltaZ[i] * deltaZ[i] + (deltaY[i] * deltaY[i] + deltaX[i] * deltaX[i]);
+
+			distance[i] = (distanceSquared > CenterDistanceSquared) ? std::sqrt(distanceSquared) : 0.0f;
+		}
+#endif
+	}
+
+	// Get how hard to brake towards the maximum speed, from 1 normally down to 0 at the start of a dash.
+	static float GetBrakingRatio(float dashTimer)
+	{
+		float remaining = 1.0f - std::min(dashTimer, 1.0f);
+
+		return remaining * remaining;
+	}
+
+	// Get the velocity to brake towards if a velocity's planar speed is over a maximum, returning whether it is.
+	// The vertical component is left alone, and braking eases off while dashing.
+	static bool GetClampedVelocity(float velocityX, float velocityY, float velocityZ, float maximumSpeed, float dashTimer, float& clampedX, float& clampedY, float& clampedZ)
+	{
+		float planarSpeed = std::sqrt(velocityX * velocityX + velocityY * velocityY);
+
+		if (planarSpeed <= maximumSpeed)
+		{
+			return false;
+		}
+
+		float scale = maximumSpeed / planarSpeed;
+		float brakingRatio = GetBrakingRatio(dashTimer);
+
+		clampedX = velocityX + (velocityX * scale - velocityX) * brakingRatio;
+		clampedY = velocityY + (velocityY * scale - velocityY) * brakingRatio;
+		clampedZ = velocityZ;
+
+		return true;
+	}
+};
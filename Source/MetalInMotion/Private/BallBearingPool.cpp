@@ -0,0 +1,258 @@
+/**
+
+Ball bearing pool for Metal in Motion.
+
+Original author: Rob Baker.
+Current maintainer: Rob Baker.
+
+*********************************************************************************/
+
+#include "BallBearingPool.h"
+#include "BallBearing.h"
+#include "BallBearingTimings.h"
+#include "Engine/World.h"
+
+
+/**
+Create ball bearings of a class up front, so that there are at least a number parked.
+*********************************************************************************/
+
+void UBallBearingPoolSubsystem::WarmUp(TSubclassOf<ABallBearing> ballBearingClass, int32 count)
+{
+	if (ballBearingClass == nullptr)
+	{
+		return;
+	}
+
+	FBallBearingPoolBucket& bucket = Buckets.FindOrAdd(ballBearingClass);
+
+	// Reserve the in-use list too, so spawning up to the warmed up count never grows it.
+
+	bucket.Parked.Reserve(count);
+	InUse.Reserve(InUse.Num() + count);
+
+	while (bucket.Parked.Num() < count)
+	{
+		ABallBearing* ballBearing = CreateBallBearing(ballBearingClass);
+
+		if (ballBearing == nullptr)
+		{
+			break;
+		}
+
+		bucket.Parked.Add(ballBearing);
+	}
+
+	UpdateStats();
+}
+
+
+/**
+Spawn a ball bearing from the pool, creating one only if there are none parked.
+*********************************************************************************/
+
+ABallBearing* UBallBearingPoolSubsystem::SpawnBallBearing(TSubclassOf<ABallBearing> ballBearingClass, const FTransform& transform)
+{
+	if (ballBearingClass == nullptr)
+	{
+		return nullptr;
+	}
+
+	FBallBearingPoolBucket& bucket = Buckets.FindOrAdd(ballBearingClass);
+	ABallBearing* ballBearing = nullptr;
+
+	// Anything parked may have been destroyed along with its level since.
+
+	while (ballBearing == nullptr &&
+		bucket.Parked.Num() > 0)
+	{
+		ballBearing = bucket.Parked.Pop(false);
+
+		if (IsValid(ballBearing) == false)
+		{
+			ballBearing = nullptr;
+		}
+	}
+
+	if (ballBearing == nullptr)
+	{
+		ballBearing = CreateBallBearing(ballBearingClass);
+
+		if (ballBearing == nullptr)
+		{
+			return nullptr;
+		}
+
+		NumMisses++;
+	}
+
+	ballBearing->PoolIndex = InUse.Add(ballBearing);
+	ballBearing->Unpark(transform);
+
+	HighWaterMark = FMath::Max(HighWaterMark, InUse.Num());
+
+	UpdateStats();
+
+	return ballBearing;
+}
+
+
+/**
+Spawn a ball bearing from the pool for each of a number of transforms.
+*********************************************************************************/
+
+void UBallBearingPoolSubsystem::SpawnBallBearings(TSubclassOf<ABallBearing> ballBearingClass, TArrayView<const FTransform> transforms, TArray<ABallBearing*>& ballBearings)
+{
+	ballBearings.Reset(transforms.Num());
+
+	for (const FTransform& transform : transforms)
+	{
+		ABallBearing* ballBearing = SpawnBallBearing(ballBearingClass, transform);
+
+		if (ballBearing != nullptr)
+		{
+			ballBearings.Add(ballBearing);
+		}
+	}
+}
+
+
+/**
+Release a ball bearing spawned from the pool back into it.
+*********************************************************************************/
+
+void UBallBearingPoolSubsystem::ReleaseBallBearing(ABallBearing* ballBearing)
+{
+	if (ensureMsgf(ballBearing != nullptr && ballBearing->PoolIndex != INDEX_NONE, TEXT("Releasing a ball bearing that wasn't spawned from the pool")) == false)
+	{
+		return;
+	}
+
+	RemoveBallBearing(ballBearing);
+
+	ballBearing->Park();
+
+	Buckets.FindOrAdd(ballBearing->GetClass()).Parked.Add(ballBearing);
+
+	UpdateStats();
+}
+
+
+/**
+Forget a ball bearing spawned from the pool that's being destroyed rather than released.
+*********************************************************************************/
+
+void UBallBearingPoolSubsystem::ForgetBallBearing(ABallBearing* ballBearing)
+{
+	if (ballBearing == nullptr ||
+		ballBearing->PoolIndex == INDEX_NONE)
+	{
+		return;
+	}
+
+	RemoveBallBearing(ballBearing);
+
+	UpdateStats();
+}
+
+
+/**
+Release a number of ball bearings spawned from the pool back into it.
+*********************************************************************************/
+
+void UBallBearingPoolSubsystem::ReleaseBallBearings(TArrayView<ABallBearing* const> ballBearings)
+{
+	for (ABallBearing* ballBearing : ballBearings)
+	{
+		ReleaseBallBearing(ballBearing);
+	}
+}
+
+
+/**
+Release every ball bearing spawned from the pool back into it.
+*********************************************************************************/
+
+void UBallBearingPoolSubsystem::ReleaseAllBallBearings()
+{
+	// Anything in use should have been forgotten when it was destroyed, but strip out
+	// any that weren't rather than trying to park them.
+
+	while (InUse.Num() > 0)
+	{
+		ABallBearing* ballBearing = InUse.Last();
+
+		if (IsValid(ballBearing) == true)
+		{
+			ReleaseBallBearing(ballBearing);
+		}
+		else
+		{
+			InUse.Pop(false);
+
+			if (ballBearing != nullptr)
+			{
+				ballBearing->PoolIndex = INDEX_NONE;
+			}
+		}
+	}
+
+	UpdateStats();
+}
+
+
+/**
+Remove a ball bearing from the in-use list.
+*********************************************************************************/
+
+void UBallBearingPoolSubsystem::RemoveBallBearing(ABallBearing* ballBearing)
+{
+	// Swap the last ball bearing in use into this one's place and patch up its index.
+
+	int32 index = ballBearing->PoolIndex;
+
+	InUse.RemoveAtSwap(index, 1, false);
+
+	if (InUse.IsValidIndex(index) == true &&
+		InUse[index] != nullptr)
+	{
+		InUse[index]->PoolIndex = index;
+	}
+
+	ballBearing->PoolIndex = INDEX_NONE;
+}
+
+
+/**
+Create a new ball bearing, parked.
+*********************************************************************************/
+
+ABallBearing* UBallBearingPoolSubsystem::CreateBallBearing(UClass* ballBearingClass)
+{
+	FActorSpawnParameters parameters;
+
+	parameters.SpawnCollisionHandlingOverride = ESpawnActorCollisionHandlingMethod::AlwaysSpawn;
+
+	ABallBearing* ballBearing = GetWorld()->SpawnActor<ABallBearing>(ballBearingClass, FTransform::Identity, parameters);
+
+	if (ballBearing != nullptr)
+	{
+		ballBearing->Park();
+
+		NumCreated++;
+	}
+
+	return ballBearing;
+}
+
+
+/**
+Update the pool's stats.
+*********************************************************************************/
+
+void UBallBearingPoolSubsystem::UpdateStats()
+{
+	SET_DWORD_STAT(STAT_PooledBallBearings, NumCreated);
+	SET_DWORD_STAT(STAT_PooledBallBearingsInUse, InUse.Num());
+	SET_DWORD_STAT(STAT_PooledBallBearingsHighWater, HighWaterMark);
+}
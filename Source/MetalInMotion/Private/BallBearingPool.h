@@ -0,0 +1,130 @@
+/**
+
+Ball bearing pool for Metal in Motion.
+
+Original author: Rob Baker.
+Current maintainer: Rob Baker.
+
+Modes that spawn and despawn ball bearings continuously, such as fountains, waves
+and timed drops, would otherwise be creating and destroying actors all the time,
+with the allocation and garbage collection spikes that brings. The pool creates
+ball bearings up front, warmed up at load time, and recycles them instead.
+
+A parked ball bearing is hidden, has its physics and collision turned off and is
+unregistered from the ball bearing subsystem, so it costs nothing per frame.
+Parking leaves every other ball bearing's magnetism alone, even mid-frame when
+magnetism is applied per physics step. It's fully reset on reuse. As long as the
+pool was warmed up to its high-water mark, churning through ball bearings creates
+no objects at all.
+
+*********************************************************************************/
+
+#pragma once
+
+#include "CoreMinimal.h"
+#include "Subsystems/WorldSubsystem.h"
+#include "Templates/SubclassOf.h"
+#include "BallBearingPool.generated.h"
+
+class ABallBearing;
+
+
+/**
+The parked ball bearings of one class.
+*********************************************************************************/
+
+USTRUCT()
+struct FBallBearingPoolBucket
+{
+	GENERATED_BODY()
+
+	// The ball bearings parked, ready for reuse.
+	UPROPERTY(Transient)
+		TArray<ABallBearing*> Parked;
+};
+
+
+/**
+World subsystem for pooling ball bearings.
+*********************************************************************************/
+
+UCLASS()
+class METALINMOTION_API UBallBearingPoolSubsystem : public UWorldSubsystem
+{
+	GENERATED_BODY()
+
+public:
+
+	// Create ball bearings of a class up front, so that there are at least a number parked.
+	void WarmUp(TSubclassOf<ABallBearing> ballBearingClass, int32 count);
+
+	// Spawn a ball bearing from the pool, creating one only if there are none parked.
+	ABallBearing* SpawnBallBearing(TSubclassOf<ABallBearing> ballBearingClass, const FTransform& transform);
+
+	// Spawn a ball bearing from the pool for each of a number of transforms.
+	void SpawnBallBearings(TSubclassOf<ABallBearing> ballBearingClass, TArrayView<const FTransform> transforms, TArray<ABallBearing*>& ballBearings);
+
+	// Release a ball bearing spawned from the pool back into it.
+	void ReleaseBallBearing(ABallBearing* ballBearing);
+
+	// Release a number of ball bearings spawned from the pool back into it.
+	void ReleaseBallBearings(TArrayView<ABallBearing* const> ballBearings);
+
+	// Release every ball bearing spawned from the pool back into it.
+	void ReleaseAllBallBearings();
+
+	// Forget a ball bearing spawned from the pool that's being destroyed rather than released.
+	void ForgetBallBearing(ABallBearing* ballBearing);
+
+	// Get the number of ball bearings the pool has created.
+	int32 GetNumCreated() const
+	{
+		return NumCreated;
+	}
+
+	// Get the number of ball bearings currently spawned from the pool.
+	int32 GetNumInUse() const
+	{
+		return InUse.Num();
+	}
+
+	// Get the largest number of ball bearings ever spawned from the pool at once.
+	int32 GetHighWaterMark() const
+	{
+		return HighWaterMark;
+	}
+
+	// Get the number of spawns that had to create a ball bearing after warming up.
+	int32 GetNumMisses() const
+	{
+		return NumMisses;
+	}
+
+private:
+
+	// Create a new ball bearing, parked.
+	ABallBearing* CreateBallBearing(UClass* ballBearingClass);
+
+	// Remove a ball bearing from the in-use list.
+	void RemoveBallBearing(ABallBearing* ballBearing);
+
+	// Update the pool's stats.
+	void UpdateStats();
+
+	// The parked ball bearings of each class.
+	UPROPERTY(Transient)
+		TMap<UClass*, FBallBearingPoolBucket> Buckets;
+
+	// The ball bearings currently spawned from the pool.
+	UPROPERTY(Transient)
+		TArray<ABallBearing*> InUse;
+
+	// The number of ball bearings the pool has created.
+	int32 NumCreated = 0;
+
+	// The largest number of ball bearings ever spawned from the pool at once.
+	int32 HighWaterMark = 0;
+
+	// The number of spawns that had to create a ball bearing after warming up.
+	int32 NumMisses = 0;
+};
@@ -0,0 +1,833 @@
+/**
+
+Replay recording and playback for Metal in Motion.
+
+Original author: Rob Baker.
+Current maintainer: Rob Baker.
+
+A replay file starts with a header block, followed by one block per frame, each
+block prefixed with its size in bytes.
+
+The header block holds a magic number, a version and the path names of the
+recorded ball bearings, in the order their states appear in each frame. Sizes
+are little-endian, as written by the platforms we ship on.
+
+A frame block holds a flags byte, the frame's delta time in microseconds, a bit
+for each ball bearing saying whether it has changed, and for each one that has,
+the zigzag variable-length differences of its location, rotation, velocity and
+input. Keyframes mark every ball bearing as changed and encode against zero.
+
+*********************************************************************************/
+
+#include "BallBearingReplay.h"
+#include "MetalInMotion.h"
+#include "BallBearing.h"
+#include "PlayerBallBearing.h"
+#include "EngineUtils.h"
+#include "Engine/World.h"
+#include "HAL/FileManager.h"
+#include "HAL/RunnableThread.h"
+#include "HAL/IConsoleManager.h"
+#include "Misc/FileHelper.h"
+#include "Misc/Paths.h"
+#include "Serialization/MemoryReader.h"
+#include "Serialization/MemoryWriter.h"
+
+
+// Magic number identifying a replay file.
+static const uint32 ReplayMagic = 0x524d494d;
+
+// The version of the replay file format.
+static const uint32 ReplayVersion = 1;
+
+// Flag marking a frame as a keyframe.
+static const uint8 ReplayKeyframe = 1;
+
+
+/**
+Append an unsigned variable-length integer to a buffer, seven bits per byte.
+*********************************************************************************/
+
+static void WriteVarint(TArray<uint8>& bytes, uint32 value)
+{
+	while (value >= 0x80)
+	{
+		bytes.Add((uint8)(value | 0x80));
+
+		value >>= 7;
+	}
+
+	bytes.Add((uint8)value);
+}
+
+
+/**
+Read an unsigned variable-length integer from a buffer, advancing through it.
+*********************************************************************************/
+
+static uint32 ReadVarint(const uint8*& data, const uint8* end)
+{
+	uint32 value = 0;
+
+	for (int32 shift = 0; data < end && shift < 32; shift += 7)
+	{
+		uint8 byte = *data++;
+
+		value |= (uint32)(byte & 0x7f) << shift;
+
+		if ((byte & 0x80) == 0)
+		{
+			break;
+		}
+	}
+
+	return value;
+}
+
+
+/**
+Append a signed difference to a buffer, zigzag encoded so small values of either sign stay small.
+*********************************************************************************/
+
+static void WriteDelta(TArray<uint8>& bytes, int32 delta)
+{
+	WriteVarint(bytes, ((uint32)delta << 1) ^ (uint32)(delta >> 31));
+}
+
+
+/**
+Read a zigzag encoded signed difference from a buffer, advancing through it.
+*********************************************************************************/
+
+static int32 ReadDelta(const uint8*& data, const uint8* end)
+{
+	uint32 value = ReadVarint(data, end);
+
+	return (int32)(value >> 1) ^ -(int32)(value & 1);
+}
+
+
+/**
+Are two quantized ball bearing states identical?
+*********************************************************************************/
+
+static bool operator == (const FBallBearingReplayState& a, const FBallBearingReplayState& b)
+{
+	return (a.Location == b.Location && a.Rotation == b.Rotation && a.Velocity == b.Velocity && a.InputLongitude == b.InputLongitude && a.InputLatitude == b.InputLatitude);
+}
+
+
+/**
+Record or play back a frame.
+*********************************************************************************/
+
+void FBallBearingReplayTickFunction::ExecuteTick(float deltaTime, ELevelTick tickType, ENamedThreads::Type currentThread, const FGraphEventRef& myCompletionGraphEvent)
+{
+	if (Subsystem != nullptr &&
+		tickType != LEVELTICK_ViewportsOnly)
+	{
+		Subsystem->Tick(deltaTime);
+	}
+}
+
+
+/**
+Start writing to an archive, which the writer takes ownership of.
+*********************************************************************************/
+
+FBallBearingReplayWriter::FBallBearingReplayWriter(FArchive* archive)
+	: Archive(archive)
+{
+	WorkEvent = FPlatformProcess::GetSynchEventFromPool();
+	Thread = FRunnableThread::Create(this, TEXT("BallBearingReplayWriter"), 0, TPri_BelowNormal);
+}
+
+
+/**
+Finish writing everything queued and close the archive.
+*********************************************************************************/
+
+FBallBearingReplayWriter::~FBallBearingReplayWriter()
+{
+	if (Thread != nullptr)
+	{
+		Stop();
+
+		Thread->WaitForCompletion();
+
+		delete Thread;
+	}
+
+	Drain();
+
+	Archive->Close();
+
+	delete Archive;
+
+	FPlatformProcess::ReturnSynchEventToPool(WorkEvent);
+}
+
+
+/**
+Queue a block of bytes for writing.
+*********************************************************************************/
+
+void FBallBearingReplayWriter::Write(TArray<uint8>&& bytes)
+{
+	Queue.Enqueue(MoveTemp(bytes));
+
+	// Without threading there's nobody else to do the writing.
+
+	if (Thread == nullptr)
+	{
+		Drain();
+	}
+	else
+	{
+		WorkEvent->Trigger();
+	}
+}
+
+
+/**
+Write blocks as they're queued, until stopped.
+*********************************************************************************/
+
+uint32 FBallBearingReplayWriter::Run()
+{
+	while (Stopping == false)
+	{
+		WorkEvent->Wait(100);
+
+		Drain();
+	}
+
+	return 0;
+}
+
+
+/**
+Ask the writer to stop once it's written everything queued.
+*********************************************************************************/
+
+void FBallBearingReplayWriter::Stop()
+{
+	Stopping = true;
+
+	WorkEvent->Trigger();
+}
+
+
+/**
+Write everything currently queued.
+*********************************************************************************/
+
+void FBallBearingReplayWriter::Drain()
+{
+	TArray<uint8> bytes;
+
+	while (Queue.Dequeue(bytes) == true)
+	{
+		Archive->Serialize(bytes.GetData(), bytes.Num());
+	}
+}
+
+
+/**
+Stop any recording or playback when the subsystem is torn down along with its world.
+*********************************************************************************/
+
+void UBallBearingReplaySubsystem::Deinitialize()
+{
+	StopRecording();
+
+	// The ball bearings are going along with the world, so there's no handing them back.
+
+	FrameOffsets.Empty();
+	PlaybackBytes.Empty();
+
+	SetTicking(false);
+
+	Super::Deinitialize();
+}
+
+
+/**
+Get the path of the file used for a replay of a given name.
+*********************************************************************************/
+
+FString UBallBearingReplaySubsystem::GetReplayPath(const FString& name)
+{
+	return FPaths::ProjectSavedDir() / TEXT("Replays") / name + TEXT(".mimreplay");
+}
+
+
+/**
+Start recording all of the ball bearings in the world to a file.
+*********************************************************************************/
+
+bool UBallBearingReplaySubsystem::StartRecording(const FString& path)
+{
+	StopRecording();
+	StopPlayback();
+
+	FArchive* archive = IFileManager::Get().CreateFileWriter(*path);
+
+	if (archive == nullptr)
+	{
+		UE_LOG(LogMetalInMotion, Error, TEXT("Failed to open %s for recording a replay"), *path);
+
+		return false;
+	}
+
+	// Gather the ball bearings in a stable order, so recordings of the same level
+	// always list them the same way.
+
+	BallBearings.Reset();
+
+	for (TActorIterator<ABallBearing> iterator(GetWorld()); iterator; ++iterator)
+	{
+		BallBearings.Add(*iterator);
+	}
+
+	BallBearings.Sort([] (const ABallBearing& a, const ABallBearing& b)
+	{
+		return a.GetPathName() < b.GetPathName();
+	});
+
+	States.Reset();
+	States.SetNum(BallBearings.Num());
+
+	// Write the header block.
+
+	TArray<uint8> header;
+	FMemoryWriter writer(header);
+	uint32 headerSize = 0;
+	uint32 magic = ReplayMagic;
+	uint32 version = ReplayVersion;
+	int32 numBallBearings = BallBearings.Num();
+
+	writer << headerSize << magic << version << numBallBearings;
+
+	for (ABallBearing* ballBearing : BallBearings)
+	{
+		FString name = ballBearing->GetPathName();
+
+		writer << name;
+	}
+
+	headerSize = header.Num() - 4;
+
+	FMemory::Memcpy(header.GetData(), &headerSize, sizeof(headerSize));
+
+	Writer = MakeUnique<FBallBearingReplayWriter>(archive);
+	Writer->Write(MoveTemp(header));
+
+	RecordedFrames = 0;
+
+	SetTicking(true);
+
+	UE_LOG(LogMetalInMotion, Log, TEXT("Recording a replay of %d ball bearings to %s"), numBallBearings, *path);
+
+	return true;
+}
+
+
+/**
+Stop recording, flushing the rest of the replay to disk.
+*********************************************************************************/
+
+void UBallBearingReplaySubsystem::StopRecording()
+{
+	if (Writer.IsValid() == true)
+	{
+		Writer.Reset();
+
+		UE_LOG(LogMetalInMotion, Log, TEXT("Recorded %d frames of replay"), RecordedFrames);
+
+		BallBearings.Reset();
+		States.Reset();
+
+		SetTicking(false);
+	}
+}
+
+
+/**
+Start playing back a replay from a file, taking over the ball bearings it recorded.
+*********************************************************************************/
+
+bool UBallBearingReplaySubsystem::StartPlayback(const FString& path)
+{
+	StopRecording();
+	StopPlayback();
+
+	if (FFileHelper::LoadFileToArray(PlaybackBytes, *path) == false)
+	{
+		UE_LOG(LogMetalInMotion, Error, TEXT("Failed to load the replay %s"), *path);
+
+		return false;
+	}
+
+	// Read the header block and find the ball bearings it lists in this world.
+
+	FMemoryReader reader(PlaybackBytes);
+	uint32 headerSize = 0;
+	uint32 magic = 0;
+	uint32 version = 0;
+	int32 numBallBearings = 0;
+
+	reader << headerSize << magic << version << numBallBearings;
+
+	if (magic != ReplayMagic ||
+		version != ReplayVersion ||
+		numBallBearings < 0)
+	{
+		UE_LOG(LogMetalInMotion, Error, TEXT("%s isn't a replay this version of the game can play"), *path);
+
+		PlaybackBytes.Empty();
+
+		return false;
+	}
+
+	BallBearings.SetNumZeroed(numBallBearings);
+	States.Reset();
+	States.SetNum(numBallBearings);
+
+	for (int32 i = 0; i < numBallBearings; i++)
+	{
+		FString name;
+
+		reader << name;
+
+		BallBearings[i] = FindObject<ABallBearing>(nullptr, *name);
+
+		if (BallBearings[i] == nullptr)
+		{
+			UE_LOG(LogMetalInMotion, Warning, TEXT("The replayed ball bearing %s isn't in this world"), *name);
+		}
+	}
+
+	// Index the frame blocks, noting where each starts and the time it happens at.
+
+	int32 offset = 4 + headerSize;
+	double time = 0.0;
+
+	while (offset + 4 <= PlaybackBytes.Num())
+	{
+		uint32 size = 0;
+
+		FMemory::Memcpy(&size, &PlaybackBytes[offset], sizeof(size));
+
+		if (offset + 4 + (int32)size > PlaybackBytes.Num())
+		{
+			break;
+		}
+
+		const uint8* data = &PlaybackBytes[offset + 5];
+		uint32 microseconds = ReadVarint(data, &PlaybackBytes[offset + 4] + size);
+
+		time += (FrameOffsets.Num() > 0) ? microseconds / 1000000.0 : 0.0;
+
+		FrameOffsets.Add(offset);
+		FrameTimes.Add(time);
+
+		offset += 4 + size;
+	}
+
+	if (FrameOffsets.Num() == 0)
+	{
+		UE_LOG(LogMetalInMotion, Error, TEXT("The replay %s has no frames"), *path);
+
+		StopPlayback();
+
+		return false;
+	}
+
+	// Freeze the ball bearings, to be driven kinematically. Freezing for the replay
+	// keeps them frozen even if they're thawed for any other reason meanwhile, and
+	// parked ball bearings are left alone.
+
+	for (ABallBearing* ballBearing : BallBearings)
+	{
+		if (ballBearing != nullptr)
+		{
+			ballBearing->SetFrozen(EBallBearingFreezeReason::Replay, true);
+		}
+	}
+
+	SeekPlayback(0);
+	SetTicking(true);
+
+	UE_LOG(LogMetalInMotion, Log, TEXT("Playing back %d frames of replay from %s"), FrameOffsets.Num(), *path);
+
+	return true;
+}
+
+
+/**
+Stop playing back, handing the ball bearings back to physics.
+*********************************************************************************/
+
+void UBallBearingReplaySubsystem::StopPlayback()
+{
+	if (IsPlayingBack() == true)
+	{
+		// Carry on from where the replay left off, velocity and all. Ball bearings still
+		// frozen for streaming or simulation LOD keep that velocity until they thaw.
+
+		for (int32 i = 0; i < BallBearings.Num(); i++)
+		{
+			ABallBearing* ballBearing = BallBearings[i];
+
+			if (IsValid(ballBearing) == true)
+			{
+				ballBearing->SetVelocities(FVector(States[i].Velocity), FVector::ZeroVector);
+				ballBearing->SetFrozen(EBallBearingFreezeReason::Replay, false);
+			}
+		}
+
+		SetTicking(false);
+	}
+
+	BallBearings.Reset();
+	States.Reset();
+	PlaybackBytes.Empty();
+	FrameOffsets.Empty();
+	FrameTimes.Empty();
+
+	PlaybackFrame = INDEX_NONE;
+	PlaybackTime = 0.0;
+}
+
+
+/**
+Seek playback to a given frame.
+*********************************************************************************/
+
+void UBallBearingReplaySubsystem::SeekPlayback(int32 frame)
+{
+	if (IsPlayingBack() == false)
+	{
+		return;
+	}
+
+	frame = FMath::Clamp(frame, 0, FrameOffsets.Num() - 1);
+
+	// Decode forwards from the keyframe at or before the frame, which is never more
+	// than a keyframe interval's worth of frames.
+
+	int32 keyframe = frame;
+
+	while (keyframe > 0 &&
+		(PlaybackBytes[FrameOffsets[keyframe] + 4] & ReplayKeyframe) == 0)
+	{
+		keyframe--;
+	}
+
+	for (int32 i = keyframe; i <= frame; i++)
+	{
+		DecodeFrame(i);
+	}
+
+	PlaybackFrame = frame;
+	PlaybackTime = FrameTimes[frame];
+
+	ApplyStates();
+}
+
+
+/**
+Record or play back a frame, called once per frame after physics.
+*********************************************************************************/
+
+void UBallBearingReplaySubsystem::Tick(float deltaSeconds)
+{
+	if (IsRecording() == true)
+	{
+		RecordFrame(deltaSeconds);
+	}
+	else if (IsPlayingBack() == true)
+	{
+		// Decode as many frames as the time played back has passed, holding on the
+		// last frame once the replay has run out.
+
+		PlaybackTime += deltaSeconds;
+
+		int32 frame = PlaybackFrame;
+
+		while (frame + 1 < FrameOffsets.Num() &&
+			FrameTimes[frame + 1] <= PlaybackTime)
+		{
+			DecodeFrame(++frame);
+		}
+
+		if (frame != PlaybackFrame)
+		{
+			PlaybackFrame = frame;
+
+			ApplyStates();
+		}
+	}
+}
+
+
+/**
+Start or stop the tick function.
+*********************************************************************************/
+
+void UBallBearingReplaySubsystem::SetTicking(bool ticking)
+{
+	// Tick after physics, so recordings capture the results of this frame's simulation.
+
+	if (ticking == true &&
+		ReplayTickFunction.IsTickFunctionRegistered() == false)
+	{
+		ReplayTickFunction.Subsystem = this;
+		ReplayTickFunction.TickGroup = TG_PostPhysics;
+		ReplayTickFunction.bCanEverTick = true;
+		ReplayTickFunction.RegisterTickFunction(GetWorld()->PersistentLevel);
+	}
+	else if (ticking == false &&
+		ReplayTickFunction.IsTickFunctionRegistered() == true)
+	{
+		ReplayTickFunction.UnRegisterTickFunction();
+	}
+}
+
+
+/**
+Record the state of every ball bearing for this frame.
+*********************************************************************************/
+
+void UBallBearingReplaySubsystem::RecordFrame(float deltaSeconds)
+{
+	int32 numBallBearings = BallBearings.Num();
+	bool keyframe = (RecordedFrames % KeyframeInterval == 0);
+
+	// Reserve the block's size, then write the flags, the delta time and the mask of
+	// changed ball bearings, which is filled in as we go.
+
+	FrameBytes.Reset();
+	FrameBytes.AddZeroed(4);
+	FrameBytes.Add((keyframe == true) ? ReplayKeyframe : 0);
+
+	WriteVarint(FrameBytes, (uint32)FMath::RoundToInt(FMath::Max(deltaSeconds, 0.0f) * 1000000.0f));
+
+	int32 maskOffset = FrameBytes.Num();
+
+	FrameBytes.AddZeroed((numBallBearings + 7) / 8);
+
+	for (int32 i = 0; i < numBallBearings; i++)
+	{
+		ABallBearing* ballBearing = BallBearings[i];
+
+		// Ball bearings that have left play just stay where they were last seen.
+
+		FBallBearingReplayState state = (IsValid(ballBearing) == true) ? QuantizeState(ballBearing) : States[i];
+		FBallBearingReplayState previous = (keyframe == true) ? FBallBearingReplayState() : States[i];
+
+		if (keyframe == true ||
+			(state == previous) == false)
+		{
+			FrameBytes[maskOffset + i / 8] |= 1 << (i % 8);
+
+			// Rotation axes wrap around, so take the shortest way round.
+
+			WriteDelta(FrameBytes, state.Location.X - previous.Location.X);
+			WriteDelta(FrameBytes, state.Location.Y - previous.Location.Y);
+			WriteDelta(FrameBytes, state.Location.Z - previous.Location.Z);
+			WriteDelta(FrameBytes, (int16)(state.Rotation.X - previous.Rotation.X));
+			WriteDelta(FrameBytes, (int16)(state.Rotation.Y - previous.Rotation.Y));
+			WriteDelta(FrameBytes, (int16)(state.Rotation.Z - previous.Rotation.Z));
+			WriteDelta(FrameBytes, state.Velocity.X - previous.Velocity.X);
+			WriteDelta(FrameBytes, state.Velocity.Y - previous.Velocity.Y);
+			WriteDelta(FrameBytes, state.Velocity.Z - previous.Velocity.Z);
+			WriteDelta(FrameBytes, state.InputLongitude - previous.InputLongitude);
+			WriteDelta(FrameBytes, state.InputLatitude - previous.InputLatitude);
+		}
+
+		States[i] = state;
+	}
+
+	uint32 size = FrameBytes.Num() - 4;
+
+	FMemory::Memcpy(FrameBytes.GetData(), &size, sizeof(size));
+
+	Writer->Write(TArray<uint8>(FrameBytes));
+
+	RecordedFrames++;
+}
+
+
+/**
+Decode a frame of the replay being played back on top of the previous frame's states.
+*********************************************************************************/
+
+void UBallBearingReplaySubsystem::DecodeFrame(int32 frame)
+{
+	int32 offset = FrameOffsets[frame];
+	uint32 size = 0;
+
+	FMemory::Memcpy(&size, &PlaybackBytes[offset], sizeof(size));
+
+	const uint8* data = &PlaybackBytes[offset + 4];
+	const uint8* end = data + size;
+	bool keyframe = (*data++ & ReplayKeyframe) != 0;
+
+	ReadVarint(data, end);
+
+	const uint8* mask = data;
+
+	data += (States.Num() + 7) / 8;
+
+	for (int32 i = 0; i < States.Num(); i++)
+	{
+		FBallBearingReplayState& state = States[i];
+
+		if (keyframe == true)
+		{
+			state = FBallBearingReplayState();
+		}
+
+		if ((mask[i / 8] & (1 << (i % 8))) != 0)
+		{
+			state.Location.X += ReadDelta(data, end);
+			state.Location.Y += ReadDelta(data, end);
+			state.Location.Z += ReadDelta(data, end);
+			state.Rotation.X = (state.Rotation.X + ReadDelta(data, end)) & 0xffff;
+			state.Rotation.Y = (state.Rotation.Y + ReadDelta(data, end)) & 0xffff;
+			state.Rotation.Z = (state.Rotation.Z + ReadDelta(data, end)) & 0xffff;
+			state.Velocity.X += ReadDelta(data, end);
+			state.Velocity.Y += ReadDelta(data, end);
+			state.Velocity.Z += ReadDelta(data, end);
+			state.InputLongitude += ReadDelta(data, end);
+			state.InputLatitude += ReadDelta(data, end);
+		}
+	}
+}
+
+
+/**
+Move the ball bearings to the states last decoded.
+*********************************************************************************/
+
+void UBallBearingReplaySubsystem::ApplyStates()
+{
+	for (int32 i = 0; i < BallBearings.Num(); i++)
+	{
+		ABallBearing* ballBearing = BallBearings[i];
+
+		if (IsValid(ballBearing) == true)
+		{
+			const FBallBearingReplayState& state = States[i];
+			FVector location = FVector(state.Location) / 10.0f;
+			FRotator rotation(FRotator::DecompressAxisFromShort(state.Rotation.X), FRotator::DecompressAxisFromShort(state.Rotation.Y), FRotator::DecompressAxisFromShort(state.Rotation.Z));
+
+			ballBearing->BallMesh->SetWorldLocationAndRotation(location, rotation, false, nullptr, ETeleportType::TeleportPhysics);
+
+			// The mesh reports this as its velocity while it's not simulating.
+
+			ballBearing->BallMesh->ComponentVelocity = FVector(state.Velocity);
+
+			APlayerBallBearing* player = Cast<APlayerBallBearing>(ballBearing);
+
+			if (player != nullptr)
+			{
+				player->InputLongitude = state.InputLongitude / 127.0f;
+				player->InputLatitude = state.InputLatitude / 127.0f;
+			}
+		}
+	}
+}
+
+
+/**
+Get the quantized state of a ball bearing.
+*********************************************************************************/
+
+FBallBearingReplayState UBallBearingReplaySubsystem::QuantizeState(const ABallBearing* ballBearing)
+{
+	FBallBearingReplayState state;
+	FVector location = ballBearing->GetActorLocation() * 10.0f;
+	FRotator rotation = ballBearing->GetActorRotation();
+	FVector velocity = ballBearing->GetVelocity();
+
+	state.Location = FIntVector(FMath::RoundToInt(location.X), FMath::RoundToInt(location.Y), FMath::RoundToInt(location.Z));
+	state.Rotation = FIntVector(FRotator::CompressAxisToShort(rotation.Pitch), FRotator::CompressAxisToShort(rotation.Yaw), FRotator::CompressAxisToShort(rotation.Roll));
+	state.Velocity = FIntVector(FMath::RoundToInt(velocity.X), FMath::RoundToInt(velocity.Y), FMath::RoundToInt(velocity.Z));
+
+	const APlayerBallBearing* player = Cast<APlayerBallBearing>(ballBearing);
+
+	if (player != nullptr)
+	{
+		state.InputLongitude = FMath::RoundToInt(FMath::Clamp(player->InputLongitude, -1.0f, 1.0f) * 127.0f);
+		state.InputLatitude = FMath::RoundToInt(FMath::Clamp(player->InputLatitude, -1.0f, 1.0f) * 127.0f);
+	}
+
+	return state;
+}
+
+
+/**
+Console commands for recording and playing back replays.
+*********************************************************************************/
+
+static UBallBearingReplaySubsystem* GetReplaySubsystem(UWorld* world)
+{
+	return (world != nullptr) ? world->GetSubsystem<UBallBearingReplaySubsystem>() : nullptr;
+}
+
+static FAutoConsoleCommandWithWorldAndArgs CReplayRecord(
+	TEXT("OurGame.ReplayRecord"),
+	TEXT("Start recording a replay of the ball bearings, optionally giving its name."),
+	FConsoleCommandWithWorldAndArgsDelegate::CreateLambda([] (const TArray<FString>& args, UWorld* world)
+	{
+		UBallBearingReplaySubsystem* replay = GetReplaySubsystem(world);
+
+		if (replay != nullptr)
+		{
+			replay->StartRecording(UBallBearingReplaySubsystem::GetReplayPath((args.Num() > 0) ? args[0] : TEXT("Replay")));
+		}
+	}));
+
+static FAutoConsoleCommandWithWorldAndArgs CReplayPlay(
+	TEXT("OurGame.ReplayPlay"),
+	TEXT("Start playing back a replay of the ball bearings, optionally giving its name."),
+	FConsoleCommandWithWorldAndArgsDelegate::CreateLambda([] (const TArray<FString>& args, UWorld* world)
+	{
+		UBallBearingReplaySubsystem* replay = GetReplaySubsystem(world);
+
+		if (replay != nullptr)
+		{
+			replay->StartPlayback(UBallBearingReplaySubsystem::GetReplayPath((args.Num() > 0) ? args[0] : TEXT("Replay")));
+		}
+	}));
+
+static FAutoConsoleCommandWithWorldAndArgs CReplaySeek(
+	TEXT("OurGame.ReplaySeek"),
+	TEXT("Seek the replay being played back to a given frame."),
+	FConsoleCommandWithWorldAndArgsDelegate::CreateLambda([] (const TArray<FString>& args, UWorld* world)
+	{
+		UBallBearingReplaySubsystem* replay = GetReplaySubsystem(world);
+
+		if (replay != nullptr &&
+			args.Num() > 0)
+		{
+			replay->SeekPlayback(FCString::Atoi(*args[0]));
+		}
+	}));
+
+static FAutoConsoleCommandWithWorldAndArgs CReplayStop(
+	TEXT("OurGame.ReplayStop"),
+	TEXT("Stop recording or playing back a replay of the ball bearings."),
+	FConsoleCommandWithWorldAndArgsDelegate::CreateLambda([] (const TArray<FString>& args, UWorld* world)
+	{
+		UBallBearingReplaySubsystem* replay = GetReplaySubsystem(world);
+
+		if (replay != nullptr)
+		{
+			replay->StopRecording();
+			replay->StopPlayback();
+		}
+	}));
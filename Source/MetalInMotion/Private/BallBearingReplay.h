@@ -0,0 +1,236 @@
+/**
+
+Replay recording and playback for Metal in Motion.
+
+Original author: Rob Baker.
+Current maintainer: Rob Baker.
+
+Every ball bearing's transform and velocity, along with the players' input, are
+recorded each frame into a compact binary stream, written to disk by a
+background thread so the game thread never waits on the file system.
+
+Positions are quantized to a millimeter, velocities to a centimeter per second
+and rotations to 16 bits per axis, then each frame is encoded as the difference
+from the one before as zigzag variable-length integers. Ball bearings that
+haven't changed at all are skipped through a bitmask, so sleeping bearings cost
+a single bit per frame. Every so often a keyframe is encoded against nothing
+instead, so playback can seek to any frame without decoding from the start.
+
+Playback freezes the ball bearings and drives them kinematically, so a long
+session can be watched, or scrubbed through, without re-simulating it. Ball
+bearings stay frozen for the replay whatever else thaws them meanwhile.
+Use the OurGame.Replay* console commands to record and play back replays, which
+are kept in Saved/Replays.
+
+*********************************************************************************/
+
+#pragma once
+
+#include "CoreMinimal.h"
+#include "Subsystems/WorldSubsystem.h"
+#include "Engine/EngineBaseTypes.h"
+#include "HAL/Runnable.h"
+#include "Containers/Queue.h"
+#include "Templates/Atomic.h"
+#include "BallBearingReplay.generated.h"
+
+class ABallBearing;
+class UBallBearingReplaySubsystem;
+
+
+/**
+Tick function used to record or play back a replay once per frame, after physics.
+*********************************************************************************/
+
+struct FBallBearingReplayTickFunction : public FTickFunction
+{
+	// The replay subsystem to record or play back with.
+	UBallBearingReplaySubsystem* Subsystem = nullptr;
+
+	// Record or play back a frame.
+	virtual void ExecuteTick(float deltaTime, ELevelTick tickType, ENamedThreads::Type currentThread, const FGraphEventRef& myCompletionGraphEvent) override;
+
+	// Describe the tick function for diagnostics.
+	virtual FString DiagnosticMessage() override
+	{
+		return TEXT("FBallBearingReplayTickFunction");
+	}
+};
+
+
+/**
+Writes the blocks of a replay to disk on a background thread.
+*********************************************************************************/
+
+class FBallBearingReplayWriter : public FRunnable
+{
+public:
+
+	// Start writing to an archive, which the writer takes ownership of.
+	explicit FBallBearingReplayWriter(FArchive* archive);
+
+	// Finish writing everything queued and close the archive.
+	virtual ~FBallBearingReplayWriter();
+
+	// Queue a block of bytes for writing.
+	void Write(TArray<uint8>&& bytes);
+
+	// Write blocks as they're queued, until stopped.
+	virtual uint32 Run() override;
+
+	// Ask the writer to stop once it's written everything queued.
+	virtual void Stop() override;
+
+private:
+
+	// Write everything currently queued.
+	void Drain();
+
+	// The archive being written to.
+	FArchive* Archive = nullptr;
+
+	// The blocks waiting to be written, passed from the game thread to the writer thread.
+	TQueue<TArray<uint8>, EQueueMode::Spsc> Queue;
+
+	// Event used to wake the writer thread when there's something to write.
+	FEvent* WorkEvent = nullptr;
+
+	// The writer thread.
+	FRunnableThread* Thread = nullptr;
+
+	// Has the writer been asked to stop?
+	TAtomic<bool> Stopping { false };
+};
+
+
+/**
+The quantized state of a ball bearing in a replay frame.
+*********************************************************************************/
+
+struct FBallBearingReplayState
+{
+	// The location in millimeters.
+	FIntVector Location = FIntVector::ZeroValue;
+
+	// The rotation, each axis compressed to 16 bits.
+	FIntVector Rotation = FIntVector::ZeroValue;
+
+	// The linear velocity in centimeters per second.
+	FIntVector Velocity = FIntVector::ZeroValue;
+
+	// The player input, longitude and latitude, each compressed to 8 bits.
+	int32 InputLongitude = 0;
+	int32 InputLatitude = 0;
+};
+
+
+/**
+World subsystem for recording and playing back replays of ball bearings.
+*********************************************************************************/
+
+UCLASS()
+class METALINMOTION_API UBallBearingReplaySubsystem : public UWorldSubsystem
+{
+	GENERATED_BODY()
+
+public:
+
+	// Stop any recording or playback when the subsystem is torn down along with its world.
+	virtual void Deinitialize() override;
+
+	// Start recording all of the ball bearings in the world to a file.
+	bool StartRecording(const FString& path);
+
+	// Stop recording, flushing the rest of the replay to disk.
+	void StopRecording();
+
+	// Start playing back a replay from a file, taking over the ball bearings it recorded.
+	bool StartPlayback(const FString& path);
+
+	// Stop playing back, handing the ball bearings back to physics.
+	void StopPlayback();
+
+	// Seek playback to a given frame.
+	void SeekPlayback(int32 frame);
+
+	// Is a replay being recorded?
+	bool IsRecording() const
+	{
+		return Writer.IsValid();
+	}
+
+	// Is a replay being played back?
+	bool IsPlayingBack() const
+	{
+		return FrameOffsets.Num() > 0;
+	}
+
+	// Get the number of frames in the replay being recorded or played back.
+	int32 GetNumFrames() const
+	{
+		return (IsPlayingBack() == true) ? FrameOffsets.Num() : RecordedFrames;
+	}
+
+	// Get the path of the file used for a replay of a given name.
+	static FString GetReplayPath(const FString& name);
+
+private:
+
+	// Record or play back a frame, called once per frame after physics.
+	void Tick(float deltaSeconds);
+
+	// Start or stop the tick function.
+	void SetTicking(bool ticking);
+
+	// Record the state of every ball bearing for this frame.
+	void RecordFrame(float deltaSeconds);
+
+	// Decode a frame of the replay being played back on top of the previous frame's states.
+	void DecodeFrame(int32 frame);
+
+	// Move the ball bearings to the states last decoded.
+	void ApplyStates();
+
+	// Get the quantized state of a ball bearing.
+	static FBallBearingReplayState QuantizeState(const ABallBearing* ballBearing);
+
+	// The number of frames between keyframes.
+	static constexpr int32 KeyframeInterval = 60;
+
+	// The tick function used to record or play back once per frame.
+	FBallBearingReplayTickFunction ReplayTickFunction;
+
+	// Allow the tick function to update the subsystem.
+	friend struct FBallBearingReplayTickFunction;
+
+	// The ball bearings being recorded or played back, matching the states.
+	UPROPERTY(Transient)
+		TArray<ABallBearing*> BallBearings;
+
+	// The state of each ball bearing as of the last frame recorded or decoded.
+	TArray<FBallBearingReplayState> States;
+
+	// Scratch buffer for encoding a frame.
+	TArray<uint8> FrameBytes;
+
+	// The writer for the replay being recorded.
+	TUniquePtr<FBallBearingReplayWriter> Writer;
+
+	// The number of frames recorded so far.
+	int32 RecordedFrames = 0;
+
+	// The whole of the replay being played back.
+	TArray<uint8> PlaybackBytes;
+
+	// The offset of each frame in the replay being played back.
+	TArray<int32> FrameOffsets;
+
+	// The time of each frame in the replay being played back, from the start.
+	TArray<double> FrameTimes;
+
+	// The last frame decoded during playback.
+	int32 PlaybackFrame = INDEX_NONE;
+
+	// The time played back so far.
+	double PlaybackTime = 0.0;
+};
@@ -0,0 +1,45 @@
+/**
+
+Simulation LOD for passive ball bearings in Metal in Motion.
+
+Original author: Rob Baker.
+Current maintainer: Rob Baker.
+
+*********************************************************************************/
+
+#include "BallBearingSimulationLOD.h"
+#include "PhysicsEngine/BodyInstance.h"
+#include "Physics/PhysicsInterfaceCore.h"
+
+
+/**
+Set the solver iteration counts of a ball bearing's physics body for its tier.
+*********************************************************************************/
+
+void FBallBearingSimulationLOD::SetSolverIterations(FBodyInstance* body, EBallBearingSimulationTier tier) const
+{
+	if (body == nullptr ||
+		body->IsValidBodyInstance() == false)
+	{
+		return;
+	}
+
+	// The body instance keeps the counts it was set up with, which are those used for
+	// near ball bearings and restored when they come back near. Far ball bearings are
+	// frozen, so their counts don't matter.
+
+	uint32 positionIterations = body->PositionSolverIterationCount;
+	uint32 velocityIterations = body->VelocitySolverIterationCount;
+
+	if (tier == EBallBearingSimulationTier::Mid)
+	{
+		positionIterations = FMath::Min(positionIterations, (uint32)FMath::Max(MidPositionIterations, 1));
+		velocityIterations = 1;
+	}
+
+	FPhysicsCommand::ExecuteWrite(body->GetPhysicsActorHandle(), [positionIterations, velocityIterations](const FPhysicsActorHandle& actor)
+	{
+		FPhysicsInterface::SetSolverPositionIterationCount_AssumesLocked(actor, positionIterations);
+		FPhysicsInterface::SetSolverVelocityIterationCount_AssumesLocked(actor, velocityIterations);
+	});
+}
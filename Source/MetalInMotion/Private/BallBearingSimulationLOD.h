@@ -0,0 +1,97 @@
+/**
+
+Simulation LOD for passive ball bearings in Metal in Motion.
+
+Original author: Rob Baker.
+Current maintainer: Rob Baker.
+
+Passive ball bearings are put into tiers by their distance from the nearest
+player's camera. Near bearings are simulated in full. Mid-range bearings only
+have magnetism applied every few frames, scaled up to match, with the frames
+staggered across bearings so the work is spread evenly, and their physics bodies
+are solved with fewer position and velocity iterations. Far bearings are frozen,
+their physics turned off, until they come back into range.
+
+*********************************************************************************/
+
+#pragma once
+
+#include "CoreMinimal.h"
+
+struct FBodyInstance;
+
+
+/**
+The simulation tiers of passive ball bearings.
+*********************************************************************************/
+
+enum class EBallBearingSimulationTier : uint8
+{
+	Near,
+	Mid,
+	Far,
+	Num
+};
+
+
+/**
+The settings for placing passive ball bearings in simulation tiers, updated once per frame.
+*********************************************************************************/
+
+struct FBallBearingSimulationLOD
+{
+	// Get the simulation tier for a ball bearing at a given location.
+	EBallBearingSimulationTier GetTier(const FVector& location) const
+	{
+		float distanceSquared = MAX_flt;
+
+		for (const FVector& viewLocation : ViewLocations)
+		{
+			distanceSquared = FMath::Min(distanceSquared, FVector::DistSquared(location, viewLocation));
+		}
+
+		if (distanceSquared > FarDistanceSquared)
+		{
+			return EBallBearingSimulationTier::Far;
+		}
+
+		return (distanceSquared > MidDistanceSquared) ? EBallBearingSimulationTier::Mid : EBallBearingSimulationTier::Near;
+	}
+
+	// Get the scale for this frame's magnetism on a ball bearing in a tier, staggered by an index.
+	float GetMagnetismScale(EBallBearingSimulationTier tier, int32 stagger) const
+	{
+		switch (tier)
+		{
+		case EBallBearingSimulationTier::Near:
+			return 1.0f;
+
+		case EBallBearingSimulationTier::Mid:
+			return ((Frame + stagger) % MidInterval == 0) ? (float)MidInterval : 0.0f;
+
+		default:
+			return 0.0f;
+		}
+	}
+
+	// Set the solver iteration counts of a ball bearing's physics body for its tier.
+	void SetSolverIterations(FBodyInstance* body, EBallBearingSimulationTier tier) const;
+
+	// The locations of the players' cameras.
+	TArray<FVector> ViewLocations;
+
+	// The squared distance beyond which ball bearings are mid-range.
+	float MidDistanceSquared = MAX_flt;
+
+	// The squared distance beyond which ball bearings are far away.
+	float FarDistanceSquared = MAX_flt;
+
+	// The number of frames between each application of magnetism to mid-range ball bearings.
+	int32 MidInterval = 1;
+
+	// The most position solver iterations for the physics bodies of mid-range ball bearings.
+	int32 MidPositionIterations = 2;
+
+	// The frame being simulated.
+	int64 Frame = 0;
+};
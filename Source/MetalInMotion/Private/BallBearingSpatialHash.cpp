@@ -0,0 +1,171 @@
+/**
+
+Spatial hash for ball bearings in Metal in Motion.
+
+Original author: Rob Baker.
+Current maintainer: Rob Baker.
+
+*********************************************************************************/
+
+#include "BallBearingSpatialHash.h"
+
+
+/**
+Add an entry at the given location, returning a handle for it.
+*********************************************************************************/
+
+int32 FBallBearingSpatialHash::Add(const FVector& location)
+{
+	int32 handle = (FreeEntries.Num() > 0) ? FreeEntries.Pop(false) : Entries.AddDefaulted();
+
+	Entries[handle].Location = location;
+
+	LinkToCell(handle, GetCell(location));
+
+	return handle;
+}
+
+
+/**
+Remove the entry with the given handle.
+*********************************************************************************/
+
+void FBallBearingSpatialHash::Remove(int32 handle)
+{
+	check(Entries.IsValidIndex(handle) == true && Entries[handle].IndexInCell != INDEX_NONE);
+
+	UnlinkFromCell(handle);
+
+	FreeEntries.Add(handle);
+}
+
+
+/**
+Update the location of the entry with the given handle, returning whether it changed cell.
+*********************************************************************************/
+
+bool FBallBearingSpatialHash::Update(int32 handle, const FVector& location)
+{
+	FEntry& entry = Entries[handle];
+
+	entry.Location = location;
+
+	FIntVector cell = GetCell(location);
+
+	// Only touch the cells if the entry has actually moved between them.
+
+	if (cell != entry.Cell)
+	{
+		UnlinkFromCell(handle);
+		LinkToCell(handle, cell);
+
+		return true;
+	}
+
+	return false;
+}
+
+
+/**
+Find the handles of all entries within a radius of a location.
+*********************************************************************************/
+
+void FBallBearingSpatialHash::QuerySphere(const FVector& center, float radius, TArray<int32>& handles) const
+{
+	FIntVector minimum = GetCell(center - FVector(radius));
+	FIntVector maximum = GetCell(center + FVector(radius));
+	float radiusSquared = radius * radius;
+
+	for (int32 z = minimum.Z; z <= maximum.Z; z++)
+	{
+		for (int32 y = minimum.Y; y <= maximum.Y; y++)
+		{
+			for (int32 x = minimum.X; x <= maximum.X; x++)
+			{
+				const TArray<int32>* cell = Cells.Find(FIntVector(x, y, z));
+
+				if (cell != nullptr)
+				{
+					for (int32 handle : *cell)
+					{
+						if (FVector::DistSquared(Entries[handle].Location, center) <= radiusSquared)
+						{
+							handles.Add(handle);
+						}
+					}
+				}
+			}
+		}
+	}
+}
+
+
+/**
+Are there any entries in the cells overlapping a box?
+*********************************************************************************/
+
+bool FBallBearingSpatialHash::IsAnyInBox(const FBox& box) const
+{
+	FIntVector minimum = GetCell(box.Min);
+	FIntVector maximum = GetCell(box.Max);
+
+	// Empty cells are always removed from the map, so any cell present is occupied.
+
+	for (int32 z = minimum.Z; z <= maximum.Z; z++)
+	{
+		for (int32 y = minimum.Y; y <= maximum.Y; y++)
+		{
+			for (int32 x = minimum.X; x <= maximum.X; x++)
+			{
+				if (Cells.Contains(FIntVector(x, y, z)) == true)
+				{
+					return true;
+				}
+			}
+		}
+	}
+
+	return false;
+}
+
+
+/**
+Link an entry into a cell.
+*********************************************************************************/
+
+void FBallBearingSpatialHash::LinkToCell(int32 handle, const FIntVector& cell)
+{
+	FEntry& entry = Entries[handle];
+	TArray<int32>& handles = Cells.FindOrAdd(cell);
+
+	entry.Cell = cell;
+	entry.IndexInCell = handles.Add(handle);
+}
+
+
+/**
+Unlink an entry from its cell.
+*********************************************************************************/
+
+void FBallBearingSpatialHash::UnlinkFromCell(int32 handle)
+{
+	FEntry& entry = Entries[handle];
+	TArray<int32>* handles = Cells.Find(entry.Cell);
+
+	check(handles != nullptr);
+
+	// Swap the last entry of the cell into this one's place and patch up its index.
+
+	handles->RemoveAtSwap(entry.IndexInCell, 1, false);
+
+	if (handles->IsValidIndex(entry.IndexInCell) == true)
+	{
+		Entries[(*handles)[entry.IndexInCell]].IndexInCell = entry.IndexInCell;
+	}
+	else if (handles->Num() == 0)
+	{
+		Cells.Remove(entry.Cell);
+	}
+
+	entry.IndexInCell = INDEX_NONE;
+}
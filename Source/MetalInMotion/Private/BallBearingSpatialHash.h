@@ -0,0 +1,108 @@
+/**
+
+Spatial hash for ball bearings in Metal in Motion.
+
+Original author: Rob Baker.
+Current maintainer: Rob Baker.
+
+A uniform grid of cells, hashed so that only occupied cells cost any memory.
+Entries are moved between cells incrementally as their locations are updated,
+so the common case of a bearing staying within its cell is just a comparison,
+and removal from a cell is constant time rather than a linear search.
+
+*********************************************************************************/
+
+#pragma once
+
+#include "CoreMinimal.h"
+
+
+/**
+Spatial hash for ball bearings in Metal in Motion.
+*********************************************************************************/
+
+class METALINMOTION_API FBallBearingSpatialHash
+{
+public:
+
+	// Construct a spatial hash with the given cell size.
+	explicit FBallBearingSpatialHash(float cellSize = 400.0f)
+		: CellSize(cellSize)
+		, InverseCellSize(1.0f / cellSize)
+	{ }
+
+	// Add an entry at the given location, returning a handle for it.
+	int32 Add(const FVector& location);
+
+	// Remove the entry with the given handle.
+	void Remove(int32 handle);
+
+	// Update the location of the entry with the given handle, returning whether it changed cell.
+	bool Update(int32 handle, const FVector& location);
+
+	// Find the handles of all entries within a radius of a location.
+	void QuerySphere(const FVector& center, float radius, TArray<int32>& handles) const;
+
+	// Are there any entries in the cells overlapping a box?
+	bool IsAnyInBox(const FBox& box) const;
+
+	// Get the cell containing a location.
+	FIntVector GetCell(const FVector& location) const
+	{
+		return FIntVector(FMath::FloorToInt(location.X * InverseCellSize), FMath::FloorToInt(location.Y * InverseCellSize), FMath::FloorToInt(location.Z * InverseCellSize));
+	}
+
+	// Get the size of each cell.
+	float GetCellSize() const
+	{
+		return CellSize;
+	}
+
+	// Get the number of entries in the hash.
+	int32 Num() const
+	{
+		return Entries.Num() - FreeEntries.Num();
+	}
+
+	// Get the number of occupied cells in the hash.
+	int32 GetNumCells() const
+	{
+		return Cells.Num();
+	}
+
+private:
+
+	// An entry in the hash.
+	struct FEntry
+	{
+		// The location of the entry.
+		FVector Location = FVector::ZeroVector;
+
+		// The cell the entry resides in.
+		FIntVector Cell = FIntVector::ZeroValue;
+
+		// The index of the entry within its cell, or INDEX_NONE if the entry is free.
+		int32 IndexInCell = INDEX_NONE;
+	};
+
+	// Link an entry into a cell.
+	void LinkToCell(int32 handle, const FIntVector& cell);
+
+	// Unlink an entry from its cell.
+	void UnlinkFromCell(int32 handle);
+
+	// The size of each cell.
+	float CellSize = 400.0f;
+
+	// The reciprocal of the size of each cell.
+	float InverseCellSize = 1.0f / 400.0f;
+
+	// All of the entries, indexed by handle.
+	TArray<FEntry> Entries;
+
+	// Handles of entries that are free for reuse.
+	TArray<int32> FreeEntries;
+
+	// The handles of the entries in each occupied cell.
+	TMap<FIntVector, TArray<int32>> Cells;
+};
@@ -0,0 +1,72 @@
+/**
+
+Startup timeline for Metal in Motion.
+
+Original author: Rob Baker.
+Current maintainer: Rob Baker.
+
+*********************************************************************************/
+
+#include "BallBearingStartup.h"
+#include "MetalInMotion.h"
+#include "BallBearingTrace.h"
+
+
+// The events recorded so far.
+TArray<FBallBearingStartupTimeline::FEvent> FBallBearingStartupTimeline::Events;
+
+// Has the startup timeline been reported?
+bool FBallBearingStartupTimeline::Reported = false;
+
+
+/**
+Record an event on the startup timeline, if it's not already been reported.
+*********************************************************************************/
+
+void FBallBearingStartupTimeline::Mark(const TCHAR* name)
+{
+	if (Reported == true)
+	{
+		return;
+	}
+
+	// GStartTime is taken as the process initializes its timing, before the engine
+	// is even loaded.
+
+	FEvent& event = Events.AddDefaulted_GetRef();
+
+	event.Name = name;
+	event.Seconds = FPlatformTime::Seconds() - GStartTime;
+
+	TRACE_BOOKMARK(TEXT("Startup: %s"), name);
+}
+
+
+/**
+Log the startup timeline, ending it at the first playable frame.
+*********************************************************************************/
+
+void FBallBearingStartupTimeline::Report()
+{
+	if (Reported == true)
+	{
+		return;
+	}
+
+	Mark(TEXT("First playable frame"));
+
+	Reported = true;
+
+	double lastSeconds = 0.0;
+
+	UE_LOG(LogMetalInMotion, Log, TEXT("Startup timeline, from process start:"));
+
+	for (const FEvent& event : Events)
+	{
+		UE_LOG(LogMetalInMotion, Log, TEXT("  %8.1fms (+%7.1fms) %s"), event.Seconds * 1000.0, (event.Seconds - lastSeconds) * 1000.0, event.Name);
+
+		lastSeconds = event.Seconds;
+	}
+
+	Events.Empty();
+}
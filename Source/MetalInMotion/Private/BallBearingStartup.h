@@ -0,0 +1,58 @@
+/**
+
+Startup timeline for Metal in Motion.
+
+Original author: Rob Baker.
+Current maintainer: Rob Baker.
+
+Records the points the game passes through on its way to the first playable
+frame, timed from process start, and logs them once that frame is reached so
+time-to-first-frame can be tracked from build to build. Each event is also
+traced as a bookmark, so it lines up with any capture being taken. In the
+editor, process start is when the editor launched rather than when play began.
+
+*********************************************************************************/
+
+#pragma once
+
+#include "CoreMinimal.h"
+
+
+/**
+The startup timeline, recorded once per process.
+*********************************************************************************/
+
+class METALINMOTION_API FBallBearingStartupTimeline
+{
+public:
+
+	// Record an event on the startup timeline, if it's not already been reported.
+	static void Mark(const TCHAR* name);
+
+	// Log the startup timeline, ending it at the first playable frame.
+	static void Report();
+
+	// Has the startup timeline been reported?
+	static bool IsReported()
+	{
+		return Reported;
+	}
+
+private:
+
+	// An event on the startup timeline.
+	struct FEvent
+	{
+		// The name of the event.
+		const TCHAR* Name = nullptr;
+
+		// The time of the event, in seconds since process start.
+		double Seconds = 0.0;
+	};
+
+	// The events recorded so far.
+	static TArray<FEvent> Events;
+
+	// Has the startup timeline been reported?
+	static bool Reported;
+};
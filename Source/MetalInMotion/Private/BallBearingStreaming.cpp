@@ -0,0 +1,322 @@
+/**
+
+Streaming of large tracks for Metal in Motion.
+
+Original author: Rob Baker.
+Current maintainer: Rob Baker.
+
+*********************************************************************************/
+
+#include "BallBearingStreaming.h"
+#include "BallBearing.h"
+#include "BallBearingGoal.h"
+#include "BallBearingSubsystem.h"
+#include "BallBearingTrace.h"
+#include "MetalInMotion.h"
+#include "Engine/World.h"
+#include "Engine/Level.h"
+#include "Engine/LevelStreamingDynamic.h"
+#include "GameFramework/PlayerController.h"
+
+#if WITH_EDITOR
+#include "AssetRegistryModule.h"
+#include "Misc/DelayedAutoRegister.h"
+#endif
+
+
+/**
+Construct the streaming manager, ticking before physics.
+*********************************************************************************/
+
+ABallBearingStreamingManager::ABallBearingStreamingManager()
+{
+	// Freezing happens before physics so that ball bearings streaming into distant
+	// cells are frozen before they've simulated a single frame.
+
+	PrimaryActorTick.bCanEverTick = true;
+	PrimaryActorTick.TickGroup = TG_PrePhysics;
+}
+
+
+/**
+Get the number of cells currently loaded and visible.
+*********************************************************************************/
+
+int32 ABallBearingStreamingManager::GetNumVisibleCells() const
+{
+	int32 numVisible = 0;
+
+	for (const FBallBearingStreamingCell& cell : Cells)
+	{
+		if (cell.Streaming != nullptr &&
+			cell.Streaming->IsLevelVisible() == true)
+		{
+			numVisible++;
+		}
+	}
+
+	return numVisible;
+}
+
+
+/**
+Count the goals in cells yet to stream in towards the number of goals.
+*********************************************************************************/
+
+void ABallBearingStreamingManager::BeginPlay()
+{
+	Super::BeginPlay();
+
+	UBallBearingSubsystem* subsystem = GetWorld()->GetSubsystem<UBallBearingSubsystem>();
+
+	if (subsystem != nullptr)
+	{
+		for (const FBallBearingStreamingCell& cell : Cells)
+		{
+			if (cell.Seen == false)
+			{
+				subsystem->AddUnseenGoals(cell.NumGoals);
+			}
+		}
+	}
+}
+
+
+/**
+Stop counting the goals in cells that never streamed in.
+*********************************************************************************/
+
+void ABallBearingStreamingManager::EndPlay(const EEndPlayReason::Type endPlayReason)
+{
+	UBallBearingSubsystem* subsystem = GetWorld()->GetSubsystem<UBallBearingSubsystem>();
+
+	if (subsystem != nullptr)
+	{
+		for (const FBallBearingStreamingCell& cell : Cells)
+		{
+			if (cell.Seen == false)
+			{
+				subsystem->AddUnseenGoals(-cell.NumGoals);
+			}
+		}
+	}
+
+	Super::EndPlay(endPlayReason);
+}
+
+
+/**
+Load and unload cells around the players, and freeze or thaw their ball bearings.
+*********************************************************************************/
+
+void ABallBearingStreamingManager::Tick(float deltaSeconds)
+{
+	Super::Tick(deltaSeconds);
+
+	BALL_BEARING_TRACE_SCOPE(BallBearingStreaming);
+
+	// Gather the locations of the players' pawns, normally their ball bearings.
+	// Clients only know of their own, so they stream around those.
+
+	PlayerLocations.Reset();
+
+	for (FConstPlayerControllerIterator iterator = GetWorld()->GetPlayerControllerIterator(); iterator; ++iterator)
+	{
+		APlayerController* controller = iterator->Get();
+
+		if (controller != nullptr &&
+			controller->GetPawn() != nullptr)
+		{
+			PlayerLocations.Add(controller->GetPawn()->GetActorLocation());
+		}
+	}
+
+	// With nobody to stream around, leave everything as it is.
+
+	if (PlayerLocations.Num() == 0)
+	{
+		return;
+	}
+
+	for (FBallBearingStreamingCell& cell : Cells)
+	{
+		if (cell.Level.IsNull() == true)
+		{
+			continue;
+		}
+
+		float distanceSquared = MAX_flt;
+
+		for (const FVector& location : PlayerLocations)
+		{
+			distanceSquared = FMath::Min(distanceSquared, cell.Bounds.ComputeSquaredDistanceToPoint(location));
+		}
+
+		// Cells unload further out than they load, so one sitting near the boundary
+		// doesn't keep streaming in and out.
+
+		bool loaded = (cell.Streaming != nullptr && cell.Streaming->ShouldBeLoaded() == true);
+		bool shouldBeLoaded = distanceSquared < FMath::Square((loaded == true) ? UnloadDistance : LoadDistance);
+
+		if (shouldBeLoaded != loaded)
+		{
+			if (cell.Streaming == nullptr)
+			{
+				bool success = false;
+
+				cell.Streaming = ULevelStreamingDynamic::LoadLevelInstanceBySoftObjectPtr(this, cell.Level, FVector::ZeroVector, FRotator::ZeroRotator, success);
+			}
+			else
+			{
+				cell.Streaming->SetShouldBeLoaded(shouldBeLoaded);
+				cell.Streaming->SetShouldBeVisible(shouldBeLoaded);
+			}
+		}
+
+		// Only the authority simulates, so only it freezes anything. A level that has
+		// streamed in afresh has all of its ball bearings thawed.
+
+		ULevel* level = (cell.Streaming != nullptr && cell.Streaming->IsLevelVisible() == true) ? cell.Streaming->GetLoadedLevel() : nullptr;
+
+		if (level != cell.VisibleLevel.Get())
+		{
+			cell.VisibleLevel = level;
+			cell.Frozen = false;
+		}
+
+		// Once a cell has been seen its goals have registered themselves, and are
+		// persisted from then on when it streams out, so stop counting them here.
+
+		if (level != nullptr &&
+			cell.Seen == false)
+		{
+			cell.Seen = true;
+
+			UBallBearingSubsystem* subsystem = GetWorld()->GetSubsystem<UBallBearingSubsystem>();
+
+			if (subsystem != nullptr)
+			{
+				subsystem->AddUnseenGoals(-cell.NumGoals);
+			}
+		}
+
+		if (level != nullptr &&
+			HasAuthority() == true)
+		{
+			bool frozen = distanceSquared > FMath::Square(FreezeDistance);
+
+			if (frozen != cell.Frozen)
+			{
+				cell.Frozen = frozen;
+
+				SetLevelFrozen(level, frozen);
+			}
+		}
+	}
+}
+
+
+/**
+Freeze or thaw all of the ball bearings in a loaded level.
+*********************************************************************************/
+
+void ABallBearingStreamingManager::SetLevelFrozen(ULevel* level, bool frozen) const
+{
+	for (AActor* actor : level->Actors)
+	{
+		ABallBearing* ballBearing = Cast<ABallBearing>(actor);
+
+		if (ballBearing != nullptr)
+		{
+			ballBearing->SetFrozen(EBallBearingFreezeReason::Streaming, frozen);
+		}
+	}
+}
+
+
+#if WITH_EDITOR
+
+// The asset registry tag on a level holding the number of goals in it.
+static const FName GoalCountTag(TEXT("BallBearingGoals"));
+
+
+/**
+Record the number of goals in a level in its asset registry tags, as it's saved.
+*********************************************************************************/
+
+static void GetGoalCountTag(const UWorld* world, TArray<UObject::FAssetRegistryTag>& outTags)
+{
+	if (world->PersistentLevel == nullptr)
+	{
+		return;
+	}
+
+	int32 numGoals = 0;
+
+	for (AActor* actor : world->PersistentLevel->Actors)
+	{
+		if (Cast<ABallBearingGoal>(actor) != nullptr)
+		{
+			numGoals++;
+		}
+	}
+
+	outTags.Add(UObject::FAssetRegistryTag(GoalCountTag, FString::FromInt(numGoals), UObject::FAssetRegistryTag::TT_Numerical));
+}
+
+// Have every level record its goal count when it's saved, so cells are counted
+// without being loaded.
+static FDelayedAutoRegisterHelper GBallBearingGoalCountRegistration(EDelayedRegisterRunPhase::EndOfEngineInit, []()
+{
+	FWorldDelegates::GetAssetTags.AddStatic(&GetGoalCountTag);
+});
+
+
+/**
+Count the goals in each cell from the asset registry, as recorded when its level was saved.
+*********************************************************************************/
+
+void ABallBearingStreamingManager::CountGoals()
+{
+	IAssetRegistry& assetRegistry = FModuleManager::LoadModuleChecked<FAssetRegistryModule>(TEXT("AssetRegistry")).Get();
+
+	for (FBallBearingStreamingCell& cell : Cells)
+	{
+		if (cell.Level.IsNull() == true)
+		{
+			cell.NumGoals = 0;
+
+			continue;
+		}
+
+		// Cells saved before their goals were recorded keep the count they had until
+		// they're saved again.
+
+		FAssetData assetData = assetRegistry.GetAssetByObjectPath(cell.Level.ToSoftObjectPath().GetAssetPathName());
+		int32 numGoals = 0;
+
+		if (assetData.IsValid() == false ||
+			assetData.GetTagValue(GoalCountTag, numGoals) == false)
+		{
+			UE_LOG(LogMetalInMotion, Warning, TEXT("The streaming cell %s has no goal count recorded, save it to count its goals"), *cell.Level.ToString());
+
+			continue;
+		}
+
+		cell.NumGoals = numGoals;
+	}
+}
+
+
+/**
+Count the goals in each cell before the streaming manager is saved.
+*********************************************************************************/
+
+void ABallBearingStreamingManager::PreSave(const class ITargetPlatform* targetPlatform)
+{
+	Super::PreSave(targetPlatform);
+
+	CountGoals();
+}
+
+#endif
@@ -0,0 +1,134 @@
+/**
+
+Streaming of large tracks for Metal in Motion.
+
+Original author: Rob Baker.
+Current maintainer: Rob Baker.
+
+A large track is split into cells, each its own level holding a part of the
+track along with its goals and ball bearings. Place a streaming manager in the
+persistent level, along with the player ball bearing, and list the cells on it
+with their bounds. Cells are then loaded and unloaded asynchronously around the
+players, so memory and load times stay flat however large the track gets.
+
+Ball bearings in cells that are loaded but distant are frozen, their physics
+turned off with their velocities kept for when they're thawed. Ball bearings
+and goals in cells that unload have their state persisted in the ball bearing
+subsystem, keyed by their path names, and rehydrate exactly where they were when
+their cell streams back in.
+
+The number of goals in each cell is recorded in the asset registry tags of its
+level when the cell is saved in the editor, and read from there, without loading
+the cells, when the streaming manager is saved. So the goals in cells yet to
+stream in still count towards the goals to fill, and the game can't finish
+before they've even been seen.
+
+*********************************************************************************/
+
+#pragma once
+
+#include "CoreMinimal.h"
+#include "GameFramework/Actor.h"
+#include "BallBearingStreaming.generated.h"
+
+class ULevel;
+class ULevelStreamingDynamic;
+
+
+/**
+A cell of a streamed track.
+*********************************************************************************/
+
+USTRUCT(BlueprintType)
+struct FBallBearingStreamingCell
+{
+	GENERATED_BODY()
+
+	// The level holding the cell's part of the track.
+	UPROPERTY(EditAnywhere, BlueprintReadOnly, Category = Streaming)
+		TSoftObjectPtr<UWorld> Level;
+
+	// The bounds of the cell, from which the distance to the players is measured.
+	UPROPERTY(EditAnywhere, BlueprintReadOnly, Category = Streaming)
+		FBox Bounds = FBox(ForceInit);
+
+	// The number of goals in the cell, counted when the streaming manager is saved.
+	UPROPERTY(VisibleAnywhere, BlueprintReadOnly, Category = Streaming)
+		int32 NumGoals = 0;
+
+	// The streaming level for the cell, once it's first been asked to load.
+	UPROPERTY(Transient)
+		ULevelStreamingDynamic* Streaming = nullptr;
+
+	// The loaded level whose ball bearings are frozen or not, as last seen visible.
+	TWeakObjectPtr<ULevel> VisibleLevel;
+
+	// Are the cell's ball bearings frozen?
+	bool Frozen = false;
+
+	// Has the cell ever been visible, registering its goals with the subsystem?
+	bool Seen = false;
+};
+
+
+/**
+Streams the cells of a large track in and out around the players.
+*********************************************************************************/
+
+UCLASS()
+class METALINMOTION_API ABallBearingStreamingManager : public AActor
+{
+	GENERATED_BODY()
+
+public:
+
+	// Construct the streaming manager, ticking before physics.
+	ABallBearingStreamingManager();
+
+	// The cells of the track.
+	UPROPERTY(EditAnywhere, BlueprintReadOnly, Category = Streaming)
+		TArray<FBallBearingStreamingCell> Cells;
+
+	// The distance from a player within which a cell is loaded.
+	UPROPERTY(EditAnywhere, BlueprintReadOnly, Category = Streaming)
+		float LoadDistance = 8000.0f;
+
+	// The distance from every player beyond which a loaded cell is unloaded.
+	UPROPERTY(EditAnywhere, BlueprintReadOnly, Category = Streaming)
+		float UnloadDistance = 10000.0f;
+
+	// The distance from every player beyond which a loaded cell's ball bearings are frozen.
+	UPROPERTY(EditAnywhere, BlueprintReadOnly, Category = Streaming)
+		float FreezeDistance = 5000.0f;
+
+	// Get the number of cells currently loaded and visible.
+	int32 GetNumVisibleCells() const;
+
+#if WITH_EDITOR
+	// Count the goals in each cell from the asset registry, as recorded when its level was saved.
+	UFUNCTION(CallInEditor, Category = Streaming)
+		void CountGoals();
+
+	// Count the goals in each cell before the streaming manager is saved.
+	virtual void PreSave(const class ITargetPlatform* targetPlatform) override;
+#endif
+
+protected:
+
+	// Count the goals in cells yet to stream in towards the number of goals.
+	virtual void BeginPlay() override;
+
+	// Stop counting the goals in cells that never streamed in.
+	virtual void EndPlay(const EEndPlayReason::Type endPlayReason) override;
+
+	// Load and unload cells around the players, and freeze or thaw their ball bearings.
+	virtual void Tick(float deltaSeconds) override;
+
+private:
+
+	// Freeze or thaw all of the ball bearings in a loaded level.
+	void SetLevelFrozen(ULevel* level, bool frozen) const;
+
+	// Scratch buffer for the locations of the players.
+	TArray<FVector> PlayerLocations;
+};
@@ -0,0 +1,1119 @@
+/**
+
+World subsystem for ball bearings in Metal in Motion.
+
+Original author: Rob Baker.
+Current maintainer: Rob Baker.
+
+*********************************************************************************/
+
+#include "BallBearingSubsystem.h"
+#include "MetalInMotion.h"
+#include "BallBearingGoal.h"
+#include "BallBearingField.h"
+#include "PlayerBallBearing.h"
+#include "BallBearingTimings.h"
+#include "BallBearingTrace.h"
+#include "Components/SphereComponent.h"
+#include "GameFramework/PlayerController.h"
+#include "Camera/PlayerCameraManager.h"
+#include "HAL/IConsoleManager.h"
+#include "PhysicsPublic.h"
+#include "PhysicsEngine/PhysicsSettings.h"
+#include "Algo/Sort.h"
+
+
+TRACE_DECLARE_INT_COUNTER(BallBearingActiveGoals, TEXT("MetalInMotion/ActiveGoals"));
+TRACE_DECLARE_INT_COUNTER(BallBearingDormantGoals, TEXT("MetalInMotion/DormantGoals"));
+TRACE_DECLARE_INT_COUNTER(BallBearingMagnetizedBearings, TEXT("MetalInMotion/MagnetizedBearings"));
+TRACE_DECLARE_INT_COUNTER(BallBearingMagnetismPairs, TEXT("MetalInMotion/MagnetismPairs"));
+
+// The number of worlds applying player control and magnetism per physics step.
+static int32 NumPhysicsStepWorlds = 0;
+
+// Did we turn substepping on for them, rather than the project already substepping?
+static bool PhysicsStepSubstepping = false;
+
+
+/**
+Should an actor come before another in the stable order used in deterministic mode?
+*********************************************************************************/
+
+static bool IsOrderedBefore(const AActor* actor, const AActor* other)
+{
+	// Names are stable from run to run where pointers and registration order aren't.
+	// Null entries go last.
+
+	if (actor == nullptr ||
+		other == nullptr)
+	{
+		return actor != nullptr;
+	}
+
+	return actor->GetFName().Compare(other->GetFName()) < 0;
+}
+
+
+/**
+Update the subsystem.
+*********************************************************************************/
+
+void FBallBearingSubsystemTickFunction::ExecuteTick(float deltaTime, ELevelTick tickType, ENamedThreads::Type currentThread, const FGraphEventRef& myCompletionGraphEvent)
+{
+	if (Subsystem != nullptr &&
+		tickType != LEVELTICK_ViewportsOnly)
+	{
+		Subsystem->Tick(deltaTime);
+	}
+}
+
+
+/**
+Count the physics frame just completed.
+*********************************************************************************/
+
+void FBallBearingSubsystemPostPhysicsTickFunction::ExecuteTick(float deltaTime, ELevelTick tickType, ENamedThreads::Type currentThread, const FGraphEventRef& myCompletionGraphEvent)
+{
+	if (Subsystem != nullptr &&
+		tickType != LEVELTICK_ViewportsOnly)
+	{
+		Subsystem->TickPostPhysics();
+	}
+}
+
+
+/**
+Establish whether the spatial broadphase is to be used for this world.
+*********************************************************************************/
+
+void UBallBearingSubsystem::Initialize(FSubsystemCollectionBase& collection)
+{
+	Super::Initialize(collection);
+
+	static const IConsoleVariable* spatialBroadphase = IConsoleManager::Get().FindConsoleVariable(TEXT("OurGame.SpatialBroadphase"));
+	static const IConsoleVariable* cellSize = IConsoleManager::Get().FindConsoleVariable(TEXT("OurGame.SpatialBroadphaseCellSize"));
+	static const IConsoleVariable* physicsStepControl = IConsoleManager::Get().FindConsoleVariable(TEXT("OurGame.PhysicsStepControl"));
+	static const IConsoleVariable* deterministicStep = IConsoleManager::Get().FindConsoleVariable(TEXT("OurGame.DeterministicStep"));
+	static const IConsoleVariable* deterministicStepRate = IConsoleManager::Get().FindConsoleVariable(TEXT("OurGame.DeterministicStepRate"));
+	static const IConsoleVariable* simulationLOD = IConsoleManager::Get().FindConsoleVariable(TEXT("OurGame.SimulationLOD"));
+	static const IConsoleVariable* bakedMagnetism = IConsoleManager::Get().FindConsoleVariable(TEXT("OurGame.BakedMagnetism"));
+
+	UseSpatialBroadphase = (spatialBroadphase != nullptr && spatialBroadphase->GetInt() != 0);
+	UsePhysicsStep = (physicsStepControl != nullptr && physicsStepControl->GetInt() != 0);
+	UseSimulationLOD = (simulationLOD != nullptr && simulationLOD->GetInt() != 0);
+	UseBakedMagnetism = (bakedMagnetism != nullptr && bakedMagnetism->GetInt() != 0);
+
+	// Applying player control and magnetism per physics step only gives a fixed rate
+	// with substepping, so turn it on at 120Hz while any world is doing that, unless
+	// the project already substeps. Nothing else pays for substepping that way.
+
+	if (UsePhysicsStep == true &&
+		NumPhysicsStepWorlds++ == 0)
+	{
+		UPhysicsSettings* physicsSettings = UPhysicsSettings::Get();
+
+		if (physicsSettings->bSubstepping == false)
+		{
+			physicsSettings->bSubstepping = true;
+			physicsSettings->MaxSubstepDeltaTime = 1.0f / 120.0f;
+			physicsSettings->MaxSubsteps = FMath::Max(physicsSettings->MaxSubsteps, 8);
+
+			PhysicsStepSubstepping = true;
+		}
+	}
+
+	if (deterministicStep != nullptr &&
+		deterministicStep->GetInt() != 0)
+	{
+		DeterministicStepSeconds = 1.0f / FMath::Max((deterministicStepRate != nullptr) ? deterministicStepRate->GetFloat() : 60.0f, 1.0f);
+	}
+
+	// The hash's cells are also used for goal coverage, so they must match those of
+	// the fields of passive ball bearings, which use the same setting.
+
+	SpatialHash = FBallBearingSpatialHash((cellSize != nullptr) ? FMath::Max(cellSize->GetFloat(), 1.0f) : 400.0f);
+}
+
+
+/**
+Stop running magnetism when the subsystem is torn down along with its world.
+*********************************************************************************/
+
+void UBallBearingSubsystem::Deinitialize()
+{
+	if (SubsystemTickFunction.IsTickFunctionRegistered() == true)
+	{
+		SubsystemTickFunction.UnRegisterTickFunction();
+	}
+
+	if (PostPhysicsTickFunction.IsTickFunctionRegistered() == true)
+	{
+		PostPhysicsTickFunction.UnRegisterTickFunction();
+	}
+
+	// The physics scene may already have gone with the world, taking our delegate with it.
+
+	if (SteppedPhysicsScene != nullptr &&
+		SteppedPhysicsScene == GetWorld()->GetPhysicsScene())
+	{
+		SteppedPhysicsScene->OnPhysSceneStep.Remove(PhysicsStepHandle);
+	}
+
+	SteppedPhysicsScene = nullptr;
+
+	// Put substepping back as the project had it once no world is using it.
+
+	if (UsePhysicsStep == true &&
+		--NumPhysicsStepWorlds == 0 &&
+		PhysicsStepSubstepping == true)
+	{
+		UPhysicsSettings* physicsSettings = UPhysicsSettings::Get();
+
+		physicsSettings->ReloadConfig();
+
+		PhysicsStepSubstepping = false;
+	}
+
+	Super::Deinitialize();
+}
+
+
+/**
+Register a goal with the subsystem, normally from its BeginPlay.
+*********************************************************************************/
+
+void UBallBearingSubsystem::RegisterGoal(ABallBearingGoal* goal)
+{
+	check(goal != nullptr);
+
+	if (Goals.Contains(goal) == true)
+	{
+		return;
+	}
+
+	Goals.Add(goal);
+
+	BakedMagnetismDirty = true;
+
+	// Pick up the goal's occupancy if its level has streamed back in. It was still
+	// being counted as filled, so this is set without notifying anyone.
+
+	bool filled = false;
+
+	if (PersistedGoals.RemoveAndCopyValue(goal->GetPathName(), filled) == true)
+	{
+		goal->Filled = filled;
+	}
+
+	// Record the spatial hash cells the goal covers, which is its sphere expanded by a
+	// cell's width to allow for the size of ball bearings, so that ball bearings moving
+	// into them can wake it from dormancy.
+
+	float sphereRadius = Cast<USphereComponent>(goal->GetCollisionComponent())->GetScaledSphereRadius();
+
+	goal->CoverageBox = FBox::BuildAABB(goal->GetActorLocation(), FVector(sphereRadius + SpatialHash.GetCellSize()));
+
+	FIntVector minimum = SpatialHash.GetCell(goal->CoverageBox.Min);
+	FIntVector maximum = SpatialHash.GetCell(goal->CoverageBox.Max);
+
+	for (int32 z = minimum.Z; z <= maximum.Z; z++)
+	{
+		for (int32 y = minimum.Y; y <= maximum.Y; y++)
+		{
+			for (int32 x = minimum.X; x <= maximum.X; x++)
+			{
+				GoalCoverage.FindOrAdd(FIntVector(x, y, z)).Add(goal);
+			}
+		}
+	}
+
+	// Goals start active, going dormant on the next update if there's nothing near.
+
+	WakeGoal(goal);
+
+	StartTicking();
+}
+
+
+/**
+Unregister a goal from the subsystem, normally from its EndPlay.
+*********************************************************************************/
+
+void UBallBearingSubsystem::UnregisterGoal(ABallBearingGoal* goal)
+{
+	if (Goals.RemoveSingleSwap(goal) == 0)
+	{
+		return;
+	}
+
+	SleepGoal(goal);
+
+	BakedMagnetismDirty = true;
+
+	// Keep the solved goals lined up with the solver's goal indices.
+
+	int32 solvedIndex = SolvedGoals.Find(goal);
+
+	if (solvedIndex != INDEX_NONE)
+	{
+		SolvedGoals[solvedIndex] = nullptr;
+	}
+
+	FIntVector minimum = SpatialHash.GetCell(goal->CoverageBox.Min);
+	FIntVector maximum = SpatialHash.GetCell(goal->CoverageBox.Max);
+
+	for (int32 z = minimum.Z; z <= maximum.Z; z++)
+	{
+		for (int32 y = minimum.Y; y <= maximum.Y; y++)
+		{
+			for (int32 x = minimum.X; x <= maximum.X; x++)
+			{
+				FIntVector cell(x, y, z);
+				TArray<ABallBearingGoal*>* goals = GoalCoverage.Find(cell);
+
+				if (goals != nullptr &&
+					goals->RemoveSingleSwap(goal) > 0 &&
+					goals->Num() == 0)
+				{
+					GoalCoverage.Remove(cell);
+				}
+			}
+		}
+	}
+}
+
+
+/**
+Empty and wake every goal, including those streamed out, as part of a fast reset.
+*********************************************************************************/
+
+void UBallBearingSubsystem::ResetGoals()
+{
+	// Any pairings gathered for the physics steps are for where the ball bearings were.
+
+	if (UsePhysicsStep == true)
+	{
+		FScopeLock lock(&PhysicsStepLock);
+
+		DiscardPhysicsStepPairings();
+	}
+
+	// Emptying each goal notifies the change, so anything counting filled goals keeps
+	// its count. Goals start active, as they do when registered.
+
+	for (ABallBearingGoal* goal : Goals)
+	{
+		goal->SetFilled(false);
+
+		WakeGoal(goal);
+	}
+
+	// Goals streamed out are emptied silently, so anything counting filled goals
+	// needs to account for them itself.
+
+	for (TPair<FString, bool>& persistedGoal : PersistedGoals)
+	{
+		persistedGoal.Value = false;
+	}
+}
+
+
+/**
+Persist the state of a ball bearing as its level streams out.
+*********************************************************************************/
+
+void UBallBearingSubsystem::PersistBallBearingState(ABallBearing* ballBearing)
+{
+	FBallBearingPersistedState& state = PersistedBallBearings.FindOrAdd(ballBearing->GetPathName());
+
+	state.Transform = ballBearing->BallMesh->GetComponentTransform();
+
+	ballBearing->GetVelocities(state.LinearVelocity, state.AngularVelocity);
+}
+
+
+/**
+Restore the state of a ball bearing as its level streams back in, if it was persisted.
+*********************************************************************************/
+
+void UBallBearingSubsystem::RestoreBallBearingState(ABallBearing* ballBearing)
+{
+	FBallBearingPersistedState state;
+
+	if (PersistedBallBearings.RemoveAndCopyValue(ballBearing->GetPathName(), state) == true)
+	{
+		UStaticMeshComponent* ballMesh = ballBearing->BallMesh;
+
+		ballMesh->SetWorldTransform(state.Transform, false, nullptr, ETeleportType::TeleportPhysics);
+		ballMesh->SetPhysicsLinearVelocity(state.LinearVelocity);
+		ballMesh->SetPhysicsAngularVelocityInDegrees(state.AngularVelocity);
+	}
+}
+
+
+/**
+Persist the occupancy of a goal as its level streams out.
+*********************************************************************************/
+
+void UBallBearingSubsystem::PersistGoalState(ABallBearingGoal* goal)
+{
+	PersistedGoals.Add(goal->GetPathName(), goal->HasBallBearing());
+}
+
+
+/**
+Wake a goal from dormancy, if it's dormant.
+*********************************************************************************/
+
+void UBallBearingSubsystem::WakeGoal(ABallBearingGoal* goal)
+{
+	if (goal->ActiveGoalIndex == INDEX_NONE)
+	{
+		goal->ActiveGoalIndex = ActiveGoals.Add(goal);
+
+		ActiveGoalsSorted = false;
+	}
+}
+
+
+/**
+Wake any dormant goals covering the spatial hash cell containing a location.
+*********************************************************************************/
+
+void UBallBearingSubsystem::WakeGoalsNear(const FVector& location)
+{
+	const TArray<ABallBearingGoal*>* goals = GoalCoverage.Find(SpatialHash.GetCell(location));
+
+	if (goals != nullptr)
+	{
+		for (ABallBearingGoal* goal : *goals)
+		{
+			WakeGoal(goal);
+		}
+	}
+}
+
+
+/**
+Put a goal into dormancy, if it's active.
+*********************************************************************************/
+
+void UBallBearingSubsystem::SleepGoal(ABallBearingGoal* goal)
+{
+	int32 index = goal->ActiveGoalIndex;
+
+	if (index != INDEX_NONE)
+	{
+		// Swap the last active goal into this one's place and patch up its index.
+
+		ActiveGoals.RemoveAtSwap(index, 1, false);
+
+		if (ActiveGoals.IsValidIndex(index) == true)
+		{
+			ActiveGoals[index]->ActiveGoalIndex = index;
+		}
+
+		goal->ActiveGoalIndex = INDEX_NONE;
+		goal->SetFilled(false);
+
+		ActiveGoalsSorted = false;
+	}
+}
+
+
+/**
+Sort the active goals into a stable order, patching up their indices.
+*********************************************************************************/
+
+void UBallBearingSubsystem::SortActiveGoals()
+{
+	Algo::Sort(ActiveGoals, IsOrderedBefore);
+
+	for (int32 i = 0; i < ActiveGoals.Num(); i++)
+	{
+		ActiveGoals[i]->ActiveGoalIndex = i;
+	}
+
+	ActiveGoalsSorted = true;
+}
+
+
+/**
+Should an active goal go dormant, having no ball bearings anywhere near it?
+*********************************************************************************/
+
+bool UBallBearingSubsystem::ShouldGoalSleep(const ABallBearingGoal* goal) const
+{
+	// With overlaps, the goal's list of proximate bearings is maintained even while
+	// it's dormant. With the spatial hash, anything in the cells the goal covers could
+	// move into range without changing cell, so only empty cells let it sleep.
+
+	if (UseSpatialBroadphase == true)
+	{
+		if (SpatialHash.IsAnyInBox(goal->CoverageBox) == true)
+		{
+			return false;
+		}
+	}
+	else if (goal->BallBearings.Num() > 0)
+	{
+		return false;
+	}
+
+	for (const ABallBearingField* field : Fields)
+	{
+		if (field->HasBallBearingsNear(goal->CoverageBox) == true)
+		{
+			return false;
+		}
+	}
+
+	return true;
+}
+
+
+/**
+Register a ball bearing with the subsystem, normally from its BeginPlay.
+*********************************************************************************/
+
+void UBallBearingSubsystem::RegisterBallBearing(ABallBearing* ballBearing)
+{
+	check(ballBearing != nullptr);
+
+	StartTicking();
+
+	APlayerBallBearing* player = Cast<APlayerBallBearing>(ballBearing);
+
+	if (UsePhysicsStep == true &&
+		player != nullptr)
+	{
+		FScopeLock lock(&PhysicsStepLock);
+
+		PhysicsStepPlayers.AddUnique(player);
+	}
+
+	if (UseSimulationLOD == true &&
+		player == nullptr &&
+		ballBearing->SimulationLODIndex == INDEX_NONE)
+	{
+		ballBearing->SimulationLODIndex = SimulationLODBallBearings.Add(ballBearing);
+	}
+
+	if (UseSpatialBroadphase == true &&
+		ballBearing->Magnetized == true &&
+		ballBearing->SpatialHashHandle == INDEX_NONE)
+	{
+		int32 handle = SpatialHash.Add(ballBearing->GetActorLocation());
+
+		if (HashedBallBearings.Num() <= handle)
+		{
+			HashedBallBearings.SetNumZeroed(handle + 1);
+		}
+
+		HashedBallBearings[handle] = ballBearing;
+		ballBearing->SpatialHashHandle = handle;
+
+		MaximumBallBearingRadius = FMath::Max(MaximumBallBearingRadius, ballBearing->BallMesh->Bounds.SphereRadius);
+
+		WakeGoalsNear(ballBearing->GetActorLocation());
+	}
+}
+
+
+/**
+Unregister a ball bearing from the subsystem, normally from its EndPlay.
+*********************************************************************************/
+
+void UBallBearingSubsystem::UnregisterBallBearing(ABallBearing* ballBearing)
+{
+	if (UsePhysicsStep == true)
+	{
+		FScopeLock lock(&PhysicsStepLock);
+
+		PhysicsStepPlayers.RemoveSingleSwap(Cast<APlayerBallBearing>(ballBearing));
+
+		// Only this ball bearing's pairings go, the rest of the frame's magnetism is
+		// still applied by the physics steps to come.
+
+		MagnetismSolver.RemoveBody(ballBearing->BallMesh->GetBodyInstance());
+	}
+
+	// Swap the last ball bearing subject to simulation LOD into this one's place and
+	// patch up its index.
+
+	int32 simulationLODIndex = ballBearing->SimulationLODIndex;
+
+	if (simulationLODIndex != INDEX_NONE)
+	{
+		SimulationLODBallBearings.RemoveAtSwap(simulationLODIndex, 1, false);
+
+		if (SimulationLODBallBearings.IsValidIndex(simulationLODIndex) == true)
+		{
+			SimulationLODBallBearings[simulationLODIndex]->SimulationLODIndex = simulationLODIndex;
+		}
+
+		ballBearing->SimulationLODIndex = INDEX_NONE;
+		ballBearing->SimulationTier = EBallBearingSimulationTier::Near;
+		ballBearing->MagnetismScale = 1.0f;
+
+		SimulationLOD.SetSolverIterations(ballBearing->BallMesh->GetBodyInstance(), EBallBearingSimulationTier::Near);
+		ballBearing->SetFrozen(EBallBearingFreezeReason::SimulationLOD, false);
+	}
+
+	if (ballBearing->SpatialHashHandle != INDEX_NONE)
+	{
+		SpatialHash.Remove(ballBearing->SpatialHashHandle);
+
+		HashedBallBearings[ballBearing->SpatialHashHandle] = nullptr;
+		ballBearing->SpatialHashHandle = INDEX_NONE;
+	}
+}
+
+
+/**
+Register a field of passive ball bearings with the subsystem, normally from its BeginPlay.
+*********************************************************************************/
+
+void UBallBearingSubsystem::RegisterBallBearingField(ABallBearingField* field)
+{
+	check(field != nullptr);
+
+	Fields.AddUnique(field);
+
+	if (IsUsingDeterministicStep() == true)
+	{
+		Algo::Sort(Fields, IsOrderedBefore);
+	}
+}
+
+
+/**
+Unregister a field of passive ball bearings from the subsystem, normally from its EndPlay.
+*********************************************************************************/
+
+void UBallBearingSubsystem::UnregisterBallBearingField(ABallBearingField* field)
+{
+	if (UsePhysicsStep == true)
+	{
+		FScopeLock lock(&PhysicsStepLock);
+
+		field->RemoveMagnetism(MagnetismSolver);
+	}
+
+	Fields.RemoveSingle(field);
+}
+
+
+/**
+Record that a goal has become filled or emptied of a ball bearing.
+*********************************************************************************/
+
+void UBallBearingSubsystem::NotifyGoalOccupancyChanged(ABallBearingGoal* goal, bool filled)
+{
+	OnGoalOccupancyChanged.Broadcast(goal, filled);
+}
+
+
+/**
+Start the subsystem's tick function if it's not already running.
+*********************************************************************************/
+
+void UBallBearingSubsystem::StartTicking()
+{
+	// Tick in the same tick group that goals used to tick in, so magnetism forces
+	// still land on the physics step of the current frame.
+
+	if (SubsystemTickFunction.IsTickFunctionRegistered() == false)
+	{
+		SubsystemTickFunction.Subsystem = this;
+		SubsystemTickFunction.TickGroup = TG_PrePhysics;
+		SubsystemTickFunction.bCanEverTick = true;
+		SubsystemTickFunction.RegisterTickFunction(GetWorld()->PersistentLevel);
+	}
+
+	// Hits are dispatched at the end of physics, so count physics frames after that.
+
+	if (PostPhysicsTickFunction.IsTickFunctionRegistered() == false)
+	{
+		PostPhysicsTickFunction.Subsystem = this;
+		PostPhysicsTickFunction.TickGroup = TG_PostPhysics;
+		PostPhysicsTickFunction.bCanEverTick = true;
+		PostPhysicsTickFunction.RegisterTickFunction(GetWorld()->PersistentLevel);
+	}
+
+	// The physics scene broadcasts each step it takes, once per substep when substepping.
+
+	if (UsePhysicsStep == true &&
+		SteppedPhysicsScene == nullptr)
+	{
+		SteppedPhysicsScene = GetWorld()->GetPhysicsScene();
+
+		if (SteppedPhysicsScene != nullptr)
+		{
+			PhysicsStepHandle = SteppedPhysicsScene->OnPhysSceneStep.AddWeakLambda(this, [this](FPhysScene* physicsScene, float deltaSeconds)
+			{
+				PhysicsStep(deltaSeconds);
+			});
+		}
+	}
+}
+
+
+/**
+Update the subsystem, called once per frame before physics.
+*********************************************************************************/
+
+void UBallBearingSubsystem::Tick(float deltaSeconds)
+{
+	if (UseSimulationLOD == true)
+	{
+		UpdateSimulationLOD();
+	}
+
+	UpdateMagnetism(deltaSeconds);
+}
+
+
+/**
+Count the physics frame just completed, called once per frame after physics.
+*********************************************************************************/
+
+void UBallBearingSubsystem::TickPostPhysics()
+{
+	// Contacts reported from here on belong to the next physics frame to be simulated.
+
+	PhysicsFrame++;
+}
+
+
+/**
+Gather all the goals and their proximate bearings, solve their magnetism and apply it.
+*********************************************************************************/
+
+void UBallBearingSubsystem::UpdateMagnetism(float deltaSeconds)
+{
+	SCOPE_CYCLE_COUNTER(STAT_BallBearingMagnetism);
+	FScopedBallBearingTiming timing(EBallBearingTiming::Magnetism);
+	BALL_BEARING_TRACE_SCOPE(BallBearingMagnetism);
+
+	// If we're cheating then give our goals extra magnetism.
+
+	static const IConsoleVariable* extraForce = IConsoleManager::Get().FindConsoleVariable(TEXT("OurGame.ExtraMagnetism"));
+	static const IConsoleVariable* parallelMagnetism = IConsoleManager::Get().FindConsoleVariable(TEXT("OurGame.ParallelMagnetism"));
+	static const IConsoleVariable* goalsPerChunk = IConsoleManager::Get().FindConsoleVariable(TEXT("OurGame.MagnetismGoalsPerChunk"));
+
+	float magnetismScale = (extraForce != nullptr && extraForce->GetInt() != 0) ? 4.0f : 1.0f;
+
+	// Physics steps never overlap with this, as they run between the start and end of
+	// physics, but the lock costs nothing uncontended and keeps that from mattering.
+
+	FScopeLock lock(&PhysicsStepLock);
+
+	// Bake the magnetism field if the goals have changed since it was last baked,
+	// which is normally just the once, when the level has loaded.
+
+	if (UseBakedMagnetism == true &&
+		BakedMagnetismDirty == true)
+	{
+		BakeMagnetism();
+	}
+
+	// When magnetism is applied per physics step, the solver still holds the last
+	// frame's pairings as solved by its final step, so read the goals' occupancy from
+	// that before gathering again. Goals that have since gone dormant stay empty.
+
+	if (UsePhysicsStep == true)
+	{
+		for (int32 i = 0; i < SolvedGoals.Num(); i++)
+		{
+			ABallBearingGoal* goal = SolvedGoals[i];
+
+			if (goal != nullptr &&
+				goal->ActiveGoalIndex != INDEX_NONE &&
+				i < MagnetismSolver.GetNumGoals())
+			{
+				goal->SetFilled(MagnetismSolver.IsGoalFilled(i));
+			}
+		}
+
+		UpdateSettling(deltaSeconds);
+	}
+
+	// Have the goals find their proximate ball bearings from the spatial hash if we're using it.
+
+	if (UseSpatialBroadphase == true)
+	{
+		BALL_BEARING_TRACE_SCOPE(BallBearingSpatialBroadphase);
+
+		UpdateSpatialBroadphase();
+	}
+
+	// Gather the active goals and their proximate ball bearings into the solver,
+	// including any from fields of passive ball bearings. The solver's goal indices
+	// match those of the active goals. In deterministic mode, goals and bearings are
+	// gathered in their stable order, so each body's forces are summed in it too.
+
+	{
+		BALL_BEARING_TRACE_SCOPE(BallBearingMagnetismGather);
+
+		bool deterministic = IsUsingDeterministicStep();
+
+		if (deterministic == true &&
+			ActiveGoalsSorted == false)
+		{
+			SortActiveGoals();
+		}
+
+		MagnetismSolver.Reset();
+		MagnetismSolver.SetGoalsPerChunk((goalsPerChunk != nullptr) ? goalsPerChunk->GetInt() : 32);
+		MagnetismSolver.SetBakedField((UseBakedMagnetism == true) ? &BakedMagnetism : nullptr, magnetismScale);
+
+		for (ABallBearingGoal* goal : ActiveGoals)
+		{
+			float sphereRadius = Cast<USphereComponent>(goal->GetCollisionComponent())->GetScaledSphereRadius();
+			int32 goalIndex = MagnetismSolver.AddGoal(goal->GetActorLocation(), sphereRadius, goal->Magnetism * magnetismScale);
+
+			if (deterministic == true)
+			{
+				Algo::Sort(goal->BallBearings, IsOrderedBefore);
+			}
+
+			for (ABallBearing* ballBearing : goal->BallBearings)
+			{
+				if (ballBearing != nullptr)
+				{
+					int32 bodyIndex = MagnetismSolver.AddBody(ballBearing->BallMesh->GetBodyInstance(), ballBearing->GetActorLocation(), ballBearing->MagnetismScale);
+
+					MagnetismSolver.AddPair(goalIndex, bodyIndex);
+				}
+			}
+
+			for (ABallBearingField* field : Fields)
+			{
+				field->GatherMagnetism(MagnetismSolver, goalIndex, goal->GetActorLocation(), sphereRadius);
+			}
+		}
+	}
+
+	// Solve the forces for every pairing and apply them in one batch, unless that's
+	// left to the physics steps, in which case remember which goals were gathered.
+
+	if (UsePhysicsStep == true)
+	{
+		SolvedGoals = ActiveGoals;
+	}
+	else
+	{
+		{
+			BALL_BEARING_TRACE_SCOPE(BallBearingMagnetismSolve);
+
+			MagnetismSolver.Solve(parallelMagnetism == nullptr || parallelMagnetism->GetInt() != 0);
+		}
+
+		{
+			BALL_BEARING_TRACE_SCOPE(BallBearingMagnetismApply);
+
+			MagnetismSolver.ApplyForces();
+		}
+
+		UpdateSettling(deltaSeconds);
+	}
+
+	TRACE_COUNTER_SET(BallBearingMagnetizedBearings, MagnetismSolver.GetNumBodies());
+	TRACE_COUNTER_SET(BallBearingMagnetismPairs, MagnetismSolver.GetNumPairs());
+
+	SET_DWORD_STAT(STAT_ActiveBallBearings, MagnetismSolver.GetNumBodies());
+	SET_DWORD_STAT(STAT_MagnetismForces, MagnetismSolver.GetNumForcesApplied());
+	SET_DWORD_STAT(STAT_SleepingBallBearings, MagnetismSolver.GetNumBodiesAsleep());
+
+	// Update the occupancy of the active goals, which will notify any changes, and put
+	// those with nothing near them into dormancy. This runs backwards as going dormant
+	// swaps the last active goal into the dormant goal's place.
+
+	for (int32 i = ActiveGoals.Num() - 1; i >= 0; i--)
+	{
+		ABallBearingGoal* goal = ActiveGoals[i];
+
+		if (UsePhysicsStep == false)
+		{
+			goal->SetFilled(MagnetismSolver.IsGoalFilled(i));
+		}
+
+		if (ShouldGoalSleep(goal) == true)
+		{
+			SleepGoal(goal);
+		}
+	}
+
+	TRACE_COUNTER_SET(BallBearingActiveGoals, GetNumActiveGoals());
+	TRACE_COUNTER_SET(BallBearingDormantGoals, GetNumDormantGoals());
+
+	SET_DWORD_STAT(STAT_ActiveGoals, GetNumActiveGoals());
+	SET_DWORD_STAT(STAT_DormantGoals, GetNumDormantGoals());
+}
+
+
+/**
+Update the spatial hash and have the goals find their proximate bearings from it.
+*********************************************************************************/
+
+void UBallBearingSubsystem::UpdateSpatialBroadphase()
+{
+	// Move the ball bearings around the hash. Sleeping bearings haven't moved so
+	// they're skipped, and the hash only touches its cells when a bearing changes cell.
+
+	for (int32 handle = 0; handle < HashedBallBearings.Num(); handle++)
+	{
+		ABallBearing* ballBearing = HashedBallBearings[handle];
+
+		if (ballBearing != nullptr &&
+			ballBearing->BallMesh->IsAnyRigidBodyAwake() == true &&
+			SpatialHash.Update(handle, ballBearing->GetActorLocation()) == true)
+		{
+			WakeGoalsNear(ballBearing->GetActorLocation());
+		}
+	}
+
+	// Replace each active goal's proximate bearings with those the hash finds overlapping
+	// the goal's sphere, allowing for the size of the bearings as the overlaps would.
+
+	for (ABallBearingGoal* goal : ActiveGoals)
+	{
+		float sphereRadius = Cast<USphereComponent>(goal->GetCollisionComponent())->GetScaledSphereRadius();
+
+		QueryHandles.Reset();
+		SpatialHash.QuerySphere(goal->GetActorLocation(), sphereRadius + MaximumBallBearingRadius, QueryHandles);
+
+		goal->BallBearings.Reset();
+
+		for (int32 handle : QueryHandles)
+		{
+			ABallBearing* ballBearing = HashedBallBearings[handle];
+
+			if (ballBearing->Magnetized == true)
+			{
+				goal->BallBearings.Add(ballBearing);
+			}
+		}
+	}
+}
+
+
+/**
+Place each passive ball bearing in its simulation tier by its distance from the players' cameras.
+*********************************************************************************/
+
+void UBallBearingSubsystem::UpdateSimulationLOD()
+{
+	BALL_BEARING_TRACE_SCOPE(BallBearingSimulationLOD);
+
+	static const IConsoleVariable* midDistance = IConsoleManager::Get().FindConsoleVariable(TEXT("OurGame.SimulationLODMidDistance"));
+	static const IConsoleVariable* farDistance = IConsoleManager::Get().FindConsoleVariable(TEXT("OurGame.SimulationLODFarDistance"));
+	static const IConsoleVariable* midInterval = IConsoleManager::Get().FindConsoleVariable(TEXT("OurGame.SimulationLODMidInterval"));
+	static const IConsoleVariable* midIterations = IConsoleManager::Get().FindConsoleVariable(TEXT("OurGame.SimulationLODMidIterations"));
+
+	FMemory::Memzero(NumInTier);
+
+	// Gather the players' camera locations, falling back on their pawns' locations
+	// if they've no camera yet.
+
+	SimulationLOD.ViewLocations.Reset();
+
+	for (FConstPlayerControllerIterator iterator = GetWorld()->GetPlayerControllerIterator(); iterator; ++iterator)
+	{
+		APlayerController* controller = iterator->Get();
+
+		if (controller != nullptr)
+		{
+			if (controller->PlayerCameraManager != nullptr)
+			{
+				SimulationLOD.ViewLocations.Add(controller->PlayerCameraManager->GetCameraLocation());
+			}
+			else if (controller->GetPawn() != nullptr)
+			{
+				SimulationLOD.ViewLocations.Add(controller->GetPawn()->GetActorLocation());
+			}
+		}
+	}
+
+	// With nobody looking, simulate everything in full rather than freeze it all.
+
+	if (SimulationLOD.ViewLocations.Num() == 0)
+	{
+		SimulationLOD.MidDistanceSquared = MAX_flt;
+		SimulationLOD.FarDistanceSquared = MAX_flt;
+	}
+	else
+	{
+		SimulationLOD.MidDistanceSquared = FMath::Square((midDistance != nullptr) ? midDistance->GetFloat() : 3000.0f);
+		SimulationLOD.FarDistanceSquared = FMath::Square((farDistance != nullptr) ? farDistance->GetFloat() : 8000.0f);
+	}
+
+	SimulationLOD.MidInterval = FMath::Max((midInterval != nullptr) ? midInterval->GetInt() : 4, 1);
+	SimulationLOD.MidPositionIterations = FMath::Max((midIterations != nullptr) ? midIterations->GetInt() : 2, 1);
+	SimulationLOD.Frame = PhysicsFrame;
+
+	// Freeze ball bearings going far away and thaw those coming back, and coarsen the
+	// solver for those in mid-range. Mid-range ball bearings are staggered by their
+	// index so they don't all get magnetism at once.
+
+	for (int32 i = 0; i < SimulationLODBallBearings.Num(); i++)
+	{
+		ABallBearing* ballBearing = SimulationLODBallBearings[i];
+		EBallBearingSimulationTier tier = SimulationLOD.GetTier(ballBearing->GetActorLocation());
+
+		if (tier != ballBearing->SimulationTier)
+		{
+			ballBearing->SetFrozen(EBallBearingFreezeReason::SimulationLOD, tier == EBallBearingSimulationTier::Far);
+			ballBearing->SimulationTier = tier;
+
+			SimulationLOD.SetSolverIterations(ballBearing->BallMesh->GetBodyInstance(), tier);
+		}
+
+		ballBearing->MagnetismScale = SimulationLOD.GetMagnetismScale(tier, i);
+
+		NumInTier[(int32)tier]++;
+	}
+
+	for (ABallBearingField* field : Fields)
+	{
+		field->UpdateSimulationLOD(SimulationLOD, NumInTier);
+	}
+
+	SET_DWORD_STAT(STAT_NearBallBearings, NumInTier[(int32)EBallBearingSimulationTier::Near]);
+	SET_DWORD_STAT(STAT_MidBallBearings, NumInTier[(int32)EBallBearingSimulationTier::Mid]);
+	SET_DWORD_STAT(STAT_FarBallBearings, NumInTier[(int32)EBallBearingSimulationTier::Far]);
+}
+
+
+/**
+Bake the combined magnetism of all the registered goals into the magnetism field.
+*********************************************************************************/
+
+void UBallBearingSubsystem::BakeMagnetism()
+{
+	BALL_BEARING_TRACE_SCOPE(BallBearingBakeMagnetism);
+
+	static const IConsoleVariable* cellSize = IConsoleManager::Get().FindConsoleVariable(TEXT("OurGame.BakedMagnetismCellSize"));
+	static const IConsoleVariable* errorSamples = IConsoleManager::Get().FindConsoleVariable(TEXT("OurGame.BakedMagnetismErrorSamples"));
+
+	double startTime = FPlatformTime::Seconds();
+
+	// The field is baked at each goal's own magnetism, any cheat being applied as a
+	// scale when it's sampled. In deterministic mode, goals are summed into the field
+	// in their stable order.
+
+	TArray<ABallBearingGoal*> sortedGoals = Goals;
+
+	if (IsUsingDeterministicStep() == true)
+	{
+		Algo::Sort(sortedGoals, IsOrderedBefore);
+	}
+
+	TArray<FBallBearingMagnetismField::FGoal> goals;
+
+	goals.Reserve(sortedGoals.Num());
+
+	for (ABallBearingGoal* goal : sortedGoals)
+	{
+		FBallBearingMagnetismField::FGoal& bakedGoal = goals.AddDefaulted_GetRef();
+
+		bakedGoal.Location = goal->GetActorLocation();
+		bakedGoal.Radius = Cast<USphereComponent>(goal->GetCollisionComponent())->GetScaledSphereRadius();
+		bakedGoal.Magnetism = goal->Magnetism;
+	}
+
+	BakedMagnetism.Bake(goals, (cellSize != nullptr) ? cellSize->GetFloat() : 50.0f);
+	BakedMagnetismDirty = false;
+
+	UE_LOG(LogMetalInMotion, Log, TEXT("Baked the magnetism of %d goals into %d bricks, %.1fKB, in %.2fms"), goals.Num(), BakedMagnetism.GetNumBricks(), BakedMagnetism.GetAllocatedSize() / 1024.0f, (FPlatformTime::Seconds() - startTime) * 1000.0);
+
+	BakedMagnetism.ReportError((errorSamples != nullptr) ? errorSamples->GetInt() : 0, 1);
+}
+
+
+/**
+Put ball bearings that have rested in a goal's center for long enough to sleep.
+*********************************************************************************/
+
+void UBallBearingSubsystem::UpdateSettling(float deltaSeconds)
+{
+	static const IConsoleVariable* settleSleepTime = IConsoleManager::Get().FindConsoleVariable(TEXT("OurGame.SettleSleepTime"));
+	static const IConsoleVariable* settleSleepSpeed = IConsoleManager::Get().FindConsoleVariable(TEXT("OurGame.SettleSleepSpeed"));
+
+	float sleepTime = (settleSleepTime != nullptr) ? settleSleepTime->GetFloat() : 1.0f;
+	float sleepSpeed = (settleSleepSpeed != nullptr) ? settleSleepSpeed->GetFloat() : 20.0f;
+
+	NextSettleTimes.Reset();
+
+	if (sleepTime > 0.0f)
+	{
+		// A body's dwell time only carries over from the last frame while it stays
+		// resting, so anything that disturbs it starts the count again.
+
+		for (int32 i = 0; i < MagnetismSolver.GetNumBodies(); i++)
+		{
+			FBodyInstance* body = MagnetismSolver.GetBody(i);
+
+			if (body != nullptr &&
+				MagnetismSolver.IsBodySettled(i) == true &&
+				MagnetismSolver.IsBodyAsleep(i) == false &&
+				body->GetUnrealWorldVelocity().SizeSquared() < FMath::Square(sleepSpeed))
+			{
+				const float* settleTime = SettleTimes.Find(body);
+				float time = ((settleTime != nullptr) ? *settleTime : 0.0f) + deltaSeconds;
+
+				if (time >= sleepTime)
+				{
+					body->PutInstanceToSleep();
+				}
+				else
+				{
+					NextSettleTimes.Add(body, time);
+				}
+			}
+		}
+	}
+
+	Swap(SettleTimes, NextSettleTimes);
+}
+
+
+/**
+Apply player control and magnetism for one physics step, called from the physics scene.
+*********************************************************************************/
+
+void UBallBearingSubsystem::PhysicsStep(float deltaSeconds)
+{
+	BALL_BEARING_TRACE_SCOPE(BallBearingPhysicsStep);
+
+	static const IConsoleVariable* parallelMagnetism = IConsoleManager::Get().FindConsoleVariable(TEXT("OurGame.ParallelMagnetism"));
+
+	FScopeLock lock(&PhysicsStepLock);
+
+	for (APlayerBallBearing* player : PhysicsStepPlayers)
+	{
+		player->PhysicsStep(deltaSeconds);
+	}
+
+	// Solve the pairings gathered for this frame again from where the bodies are now.
+
+	MagnetismSolver.RefreshLocations();
+	MagnetismSolver.Solve(parallelMagnetism == nullptr || parallelMagnetism->GetInt() != 0);
+	MagnetismSolver.ApplyForces(false);
+}
+
+
+/**
+Forget the magnetism pairings gathered this frame, as the game is being reset.
+*********************************************************************************/
+
+void UBallBearingSubsystem::DiscardPhysicsStepPairings()
+{
+	// Every ball bearing is being put back where it started, so none of the frame's
+	// magnetism applies any more. Single bodies leaving play are removed instead.
+
+	MagnetismSolver.Reset();
+
+	SolvedGoals.Reset();
+}
@@ -0,0 +1,463 @@
+/**
+
+World subsystem for ball bearings in Metal in Motion.
+
+Original author: Rob Baker.
+Current maintainer: Rob Baker.
+
+Goals register themselves here when they begin play so that nothing needs to
+scan the world for them, and they report changes in their occupancy so that
+interested parties, mainly the game mode, can simply count filled goals.
+
+The subsystem also runs the magnetism for all of the goals in one batch each
+frame, from a tick function in the same tick group goals used to tick in. A
+second tick function, after physics, counts physics frames, which ball bearings
+use to stamp their contacts so that they don't need to tick at all themselves.
+Counting after physics means that anything before physics, such as a player's
+input, sees the contacts from the last physics frame whatever order it ticks in.
+
+Optionally, magnetized ball bearings are kept in a spatial hash and goals find
+their proximate bearings by querying it, rather than through trigger overlaps.
+Fields of passive ball bearings always work this way, through their own hashes.
+
+Goals with no ball bearings anywhere near them are dormant, costing nothing per
+frame. They're woken by an overlap, or by a ball bearing moving into one of the
+spatial hash cells that they cover.
+
+Goals and ball bearings whose levels stream out have their state persisted here,
+keyed by their path names, until their levels stream back in. Goals that have
+streamed out still count towards the number of goals, and their occupancy still
+counts towards anything counting filled goals. So do goals in cells that have yet
+to stream in at all, from the counts baked into the streaming manager.
+
+Optionally, passive ball bearings are simulated in tiers by their distance from
+the players' cameras, as described in BallBearingSimulationLOD.h.
+
+Optionally, the combined magnetism of all the goals is baked into a field, as
+described in BallBearingMagnetismField.h, and ball bearings take their forces
+from that. It's baked again whenever a goal is registered, unregistered or has
+its properties changed in the editor.
+
+Ball bearings that rest in a goal's center for long enough are put to sleep, so
+that magnetism stops keeping them awake forever. They still fill the goal while
+asleep, and wake as normal when anything disturbs them.
+
+Optionally, player control and magnetism are applied for each physics step from
+the physics scene, rather than once per game frame. The game frame then only
+gathers the magnetism pairings, and reads goal occupancy back from the previous
+frame's steps. Substepping is turned on at 120Hz while that's the case, unless the
+project already substeps, which gives a fixed rate independent of the frame rate
+and moves the solve off the game thread.
+
+In deterministic mode, the active goals, each goal's proximate bearings and the
+fields are gathered in a stable order, sorted by name, rather than in whatever
+order they happened to register, wake or overlap. The solver already sums forces
+in gather order, so identical inputs then give bit-identical forces. For PhysX to
+follow suit, enable bEnableEnhancedDeterminism in the project's physics settings.
+
+*********************************************************************************/
+
+#pragma once
+
+#include "CoreMinimal.h"
+#include "Subsystems/WorldSubsystem.h"
+#include "Engine/EngineBaseTypes.h"
+#include "BallBearingMagnetismSolver.h"
+#include "BallBearingMagnetismField.h"
+#include "BallBearingSpatialHash.h"
+#include "BallBearingSimulationLOD.h"
+#include "HAL/CriticalSection.h"
+#include "Physics/PhysicsInterfaceDeclares.h"
+#include "BallBearingSubsystem.generated.h"
+
+class ABallBearing;
+class ABallBearingGoal;
+class ABallBearingField;
+class APlayerBallBearing;
+class UBallBearingSubsystem;
+
+
+/**
+The state of a ball bearing persisted while its level is streamed out.
+*********************************************************************************/
+
+struct FBallBearingPersistedState
+{
+	// The transform of the ball bearing.
+	FTransform Transform = FTransform::Identity;
+
+	// The linear velocity of the ball bearing.
+	FVector LinearVelocity = FVector::ZeroVector;
+
+	// The angular velocity of the ball bearing, in degrees.
+	FVector AngularVelocity = FVector::ZeroVector;
+};
+
+// Delegate broadcast when a goal becomes filled or emptied of a ball bearing.
+DECLARE_MULTICAST_DELEGATE_TwoParams(FBallBearingGoalOccupancyChanged, ABallBearingGoal*, bool);
+
+
+/**
+Tick function used to update the subsystem once per frame, before physics.
+*********************************************************************************/
+
+struct FBallBearingSubsystemTickFunction : public FTickFunction
+{
+	// The subsystem to run the magnetism for.
+	UBallBearingSubsystem* Subsystem = nullptr;
+
+	// Update the subsystem.
+	virtual void ExecuteTick(float deltaTime, ELevelTick tickType, ENamedThreads::Type currentThread, const FGraphEventRef& myCompletionGraphEvent) override;
+
+	// Describe the tick function for diagnostics.
+	virtual FString DiagnosticMessage() override
+	{
+		return TEXT("FBallBearingSubsystemTickFunction");
+	}
+};
+
+
+/**
+Tick function used to count physics frames, once per frame after physics.
+*********************************************************************************/
+
+struct FBallBearingSubsystemPostPhysicsTickFunction : public FTickFunction
+{
+	// The subsystem to count the physics frames for.
+	UBallBearingSubsystem* Subsystem = nullptr;
+
+	// Count the physics frame just completed.
+	virtual void ExecuteTick(float deltaTime, ELevelTick tickType, ENamedThreads::Type currentThread, const FGraphEventRef& myCompletionGraphEvent) override;
+
+	// Describe the tick function for diagnostics.
+	virtual FString DiagnosticMessage() override
+	{
+		return TEXT("FBallBearingSubsystemPostPhysicsTickFunction");
+	}
+};
+
+
+/**
+World subsystem for ball bearings in Metal in Motion.
+*********************************************************************************/
+
+UCLASS()
+class METALINMOTION_API UBallBearingSubsystem : public UWorldSubsystem
+{
+	GENERATED_BODY()
+
+public:
+
+	// Establish whether the spatial broadphase is to be used for this world.
+	virtual void Initialize(FSubsystemCollectionBase& collection) override;
+
+	// Stop running magnetism when the subsystem is torn down along with its world.
+	virtual void Deinitialize() override;
+
+	// Register a goal with the subsystem, normally from its BeginPlay.
+	void RegisterGoal(ABallBearingGoal* goal);
+
+	// Unregister a goal from the subsystem, normally from its EndPlay.
+	void UnregisterGoal(ABallBearingGoal* goal);
+
+	// Register a ball bearing with the subsystem, normally from its BeginPlay.
+	void RegisterBallBearing(ABallBearing* ballBearing);
+
+	// Unregister a ball bearing from the subsystem, normally from its EndPlay.
+	void UnregisterBallBearing(ABallBearing* ballBearing);
+
+	// Register a field of passive ball bearings with the subsystem, normally from its BeginPlay.
+	void RegisterBallBearingField(ABallBearingField* field);
+
+	// Unregister a field of passive ball bearings from the subsystem, normally from its EndPlay.
+	void UnregisterBallBearingField(ABallBearingField* field);
+
+	// Get the number of the physics frame about to be, or currently being, simulated.
+	int64 GetPhysicsFrame() const
+	{
+		return PhysicsFrame;
+	}
+
+	// Get the number of the last physics frame to have been completely simulated.
+	int64 GetCompletedPhysicsFrame() const
+	{
+		return PhysicsFrame - 1;
+	}
+
+	// Are goals finding their proximate bearings through the spatial hash rather than overlaps?
+	bool IsUsingSpatialBroadphase() const
+	{
+		return UseSpatialBroadphase;
+	}
+
+	// Are player control and magnetism being applied per physics step rather than per frame?
+	bool IsUsingPhysicsStep() const
+	{
+		return UsePhysicsStep;
+	}
+
+	// Are passive ball bearings being simulated in tiers by their distance from the camera?
+	bool IsUsingSimulationLOD() const
+	{
+		return UseSimulationLOD;
+	}
+
+	// Is magnetism being taken from a baked field rather than solved exactly?
+	bool IsUsingBakedMagnetism() const
+	{
+		return UseBakedMagnetism;
+	}
+
+	// Have the magnetism field baked again before it's next used, as a goal has changed.
+	void InvalidateBakedMagnetism()
+	{
+		BakedMagnetismDirty = true;
+	}
+
+	// Get the baked magnetism field.
+	const FBallBearingMagnetismField& GetBakedMagnetism() const
+	{
+		return BakedMagnetism;
+	}
+
+	// Get the number of passive ball bearings in a simulation tier this frame.
+	int32 GetNumBallBearingsInTier(EBallBearingSimulationTier tier) const
+	{
+		return NumInTier[(int32)tier];
+	}
+
+	// Is gameplay running deterministically at a fixed step?
+	bool IsUsingDeterministicStep() const
+	{
+		return DeterministicStepSeconds > 0.0f;
+	}
+
+	// Get the size of the deterministic fixed step, or zero if not running deterministically.
+	float GetDeterministicStepSeconds() const
+	{
+		return DeterministicStepSeconds;
+	}
+
+	// Record that a goal has become filled or emptied of a ball bearing.
+	void NotifyGoalOccupancyChanged(ABallBearingGoal* goal, bool filled);
+
+	// Get the goals currently registered with the subsystem.
+	const TArray<ABallBearingGoal*>& GetGoals() const
+	{
+		return Goals;
+	}
+
+	// Get the number of goals, whether registered with the subsystem, streamed out or yet to stream in.
+	int32 GetNumGoals() const
+	{
+		return Goals.Num() + PersistedGoals.Num() + NumUnseenGoals;
+	}
+
+	// Add to the number of goals in streamed cells that have yet to stream in for the first time.
+	void AddUnseenGoals(int32 numGoals)
+	{
+		NumUnseenGoals += numGoals;
+	}
+
+	// Persist the state of a ball bearing as its level streams out.
+	void PersistBallBearingState(ABallBearing* ballBearing);
+
+	// Restore the state of a ball bearing as its level streams back in, if it was persisted.
+	void RestoreBallBearingState(ABallBearing* ballBearing);
+
+	// Persist the occupancy of a goal as its level streams out.
+	void PersistGoalState(ABallBearingGoal* goal);
+
+	// Forget the state of any ball bearings streamed out, as part of a fast reset.
+	void ForgetPersistedBallBearings()
+	{
+		PersistedBallBearings.Reset();
+	}
+
+	// Get the number of goals that are active, having ball bearings nearby.
+	int32 GetNumActiveGoals() const
+	{
+		return ActiveGoals.Num();
+	}
+
+	// Get the number of goals that are dormant, having no ball bearings nearby.
+	int32 GetNumDormantGoals() const
+	{
+		return Goals.Num() - ActiveGoals.Num();
+	}
+
+	// Get the number of ball bearings that magnetism was solved for this frame.
+	int32 GetNumMagnetizedBallBearings() const
+	{
+		return MagnetismSolver.GetNumBodies();
+	}
+
+	// Get the number of magnetic forces applied to ball bearings this frame.
+	int32 GetNumMagnetismForcesApplied() const
+	{
+		return MagnetismSolver.GetNumForcesApplied();
+	}
+
+	// Empty and wake every goal, including those streamed out, as part of a fast reset.
+	void ResetGoals();
+
+	// Wake a goal from dormancy, if it's dormant.
+	void WakeGoal(ABallBearingGoal* goal);
+
+	// Wake any dormant goals covering the spatial hash cell containing a location.
+	void WakeGoalsNear(const FVector& location);
+
+	// Broadcast whenever a goal becomes filled or emptied of a ball bearing.
+	FBallBearingGoalOccupancyChanged OnGoalOccupancyChanged;
+
+private:
+
+	// Put a goal into dormancy, if it's active.
+	void SleepGoal(ABallBearingGoal* goal);
+
+	// Sort the active goals into a stable order, patching up their indices.
+	void SortActiveGoals();
+
+	// Should an active goal go dormant, having no ball bearings anywhere near it?
+	bool ShouldGoalSleep(const ABallBearingGoal* goal) const;
+
+	// Start the subsystem's tick function if it's not already running.
+	void StartTicking();
+
+	// Update the subsystem, called once per frame before physics.
+	void Tick(float deltaSeconds);
+
+	// Count the physics frame just completed, called once per frame after physics.
+	void TickPostPhysics();
+
+	// Update the spatial hash and have the goals find their proximate bearings from it.
+	void UpdateSpatialBroadphase();
+
+	// Gather all the goals and their proximate bearings, solve their magnetism and apply it.
+	void UpdateMagnetism(float deltaSeconds);
+
+	// Place each passive ball bearing in its simulation tier by its distance from the players' cameras.
+	void UpdateSimulationLOD();
+
+	// Bake the combined magnetism of all the registered goals into the magnetism field.
+	void BakeMagnetism();
+
+	// Put ball bearings that have rested in a goal's center for long enough to sleep.
+	void UpdateSettling(float deltaSeconds);
+
+	// Apply player control and magnetism for one physics step, called from the physics scene.
+	void PhysicsStep(float deltaSeconds);
+
+	// Forget the magnetism pairings gathered this frame, as the game is being reset.
+	void DiscardPhysicsStepPairings();
+
+	// The tick function used to update the subsystem once per frame.
+	FBallBearingSubsystemTickFunction SubsystemTickFunction;
+
+	// The solver used to compute the magnetism for all goals in one batch.
+	FBallBearingMagnetismSolver MagnetismSolver;
+
+	// The tick function used to count physics frames once per frame.
+	FBallBearingSubsystemPostPhysicsTickFunction PostPhysicsTickFunction;
+
+	// Allow the tick functions to update the subsystem.
+	friend struct FBallBearingSubsystemTickFunction;
+	friend struct FBallBearingSubsystemPostPhysicsTickFunction;
+
+	// The goals currently registered with the subsystem.
+	UPROPERTY(Transient)
+		TArray<ABallBearingGoal*> Goals;
+
+	// The goals that are currently active, having ball bearings nearby.
+	UPROPERTY(Transient)
+		TArray<ABallBearingGoal*> ActiveGoals;
+
+	// The goals covering each spatial hash cell, used to wake them from dormancy.
+	TMap<FIntVector, TArray<ABallBearingGoal*>> GoalCoverage;
+
+	// The fields of passive ball bearings currently registered with the subsystem.
+	UPROPERTY(Transient)
+		TArray<ABallBearingField*> Fields;
+
+	// The magnetized ball bearings in the spatial hash, indexed by their handles.
+	UPROPERTY(Transient)
+		TArray<ABallBearing*> HashedBallBearings;
+
+	// The number of the physics frame about to be, or currently being, simulated.
+	int64 PhysicsFrame = 1;
+
+	// Are goals finding their proximate bearings through the spatial hash rather than overlaps?
+	bool UseSpatialBroadphase = false;
+
+	// Are player control and magnetism being applied per physics step rather than per frame?
+	bool UsePhysicsStep = false;
+
+	// The size of the deterministic fixed step, or zero if not running deterministically.
+	float DeterministicStepSeconds = 0.0f;
+
+	// Are passive ball bearings being simulated in tiers by their distance from the camera?
+	bool UseSimulationLOD = false;
+
+	// Is magnetism being taken from a baked field rather than solved exactly?
+	bool UseBakedMagnetism = false;
+
+	// Does the magnetism field need baking again before it's next used?
+	bool BakedMagnetismDirty = true;
+
+	// The combined magnetism of all the registered goals, baked into a field.
+	FBallBearingMagnetismField BakedMagnetism;
+
+	// The passive ball bearings subject to simulation LOD, indexed by their simulation LOD indices.
+	UPROPERTY(Transient)
+		TArray<ABallBearing*> SimulationLODBallBearings;
+
+	// The settings for placing passive ball bearings in simulation tiers this frame.
+	FBallBearingSimulationLOD SimulationLOD;
+
+	// The number of passive ball bearings in each simulation tier this frame.
+	int32 NumInTier[(int32)EBallBearingSimulationTier::Num] = { 0 };
+
+	// Are the active goals in their stable order?
+	bool ActiveGoalsSorted = true;
+
+	// The physics scene we're stepping with, if any.
+	FPhysScene* SteppedPhysicsScene = nullptr;
+
+	// The handle of our physics step delegate on the physics scene.
+	FDelegateHandle PhysicsStepHandle;
+
+	// Lock on the state shared with the physics steps, which may run off the game thread.
+	FCriticalSection PhysicsStepLock;
+
+	// The player ball bearings to control per physics step.
+	UPROPERTY(Transient)
+		TArray<APlayerBallBearing*> PhysicsStepPlayers;
+
+	// The active goals as they were gathered into the solver, matching its goal indices.
+	UPROPERTY(Transient)
+		TArray<ABallBearingGoal*> SolvedGoals;
+
+	// The persisted state of ball bearings streamed out, keyed by their path names.
+	TMap<FString, FBallBearingPersistedState> PersistedBallBearings;
+
+	// The persisted occupancy of goals streamed out, keyed by their path names.
+	TMap<FString, bool> PersistedGoals;
+
+	// The number of goals in streamed cells that have yet to stream in for the first time.
+	int32 NumUnseenGoals = 0;
+
+	// The time each physics body has been resting in a goal's center, as of the last frame.
+	TMap<FBodyInstance*, float> SettleTimes;
+
+	// The settle times being built for this frame, swapped with those of the last.
+	TMap<FBodyInstance*, float> NextSettleTimes;
+
+	// The largest radius of any ball bearing in the spatial hash.
+	float MaximumBallBearingRadius = 0.0f;
+
+	// The spatial hash of magnetized ball bearings.
+	FBallBearingSpatialHash SpatialHash;
+
+	// Scratch buffer for spatial hash queries.
+	TArray<int32> QueryHandles;
+};
@@ -0,0 +1,72 @@
+/**
+
+Game thread timings for ball bearing systems in Metal in Motion.
+
+Original author: Rob Baker.
+Current maintainer: Rob Baker.
+
+*********************************************************************************/
+
+#include "BallBearingTimings.h"
+#include "Misc/CoreDelegates.h"
+#include "Misc/DelayedAutoRegister.h"
+
+
+DEFINE_STAT(STAT_BallBearingMagnetism);
+DEFINE_STAT(STAT_PlayerBallBearingTick);
+DEFINE_STAT(STAT_GameModeTick);
+DEFINE_STAT(STAT_BallBearingHit);
+DEFINE_STAT(STAT_GameReset);
+DEFINE_STAT(STAT_ImpactAudio);
+
+DEFINE_STAT(STAT_ActiveBallBearings);
+DEFINE_STAT(STAT_ActiveGoals);
+DEFINE_STAT(STAT_DormantGoals);
+DEFINE_STAT(STAT_MagnetismForces);
+DEFINE_STAT(STAT_BallBearingHits);
+DEFINE_STAT(STAT_SleepingBallBearings);
+DEFINE_STAT(STAT_NearBallBearings);
+DEFINE_STAT(STAT_MidBallBearings);
+DEFINE_STAT(STAT_FarBallBearings);
+DEFINE_STAT(STAT_ImpactsReported);
+DEFINE_STAT(STAT_ImpactsPlayed);
+DEFINE_STAT(STAT_ImpactVoicesStolen);
+
+DEFINE_STAT(STAT_PooledBallBearings);
+DEFINE_STAT(STAT_PooledBallBearingsInUse);
+DEFINE_STAT(STAT_PooledBallBearingsHighWater);
+
+// The accumulated cycles for each system over the current frame.
+uint64 FBallBearingTimings::Cycles[(int32)EBallBearingTiming::Num] = { 0 };
+
+// The accumulated cycles for each system over the last frame.
+uint64 FBallBearingTimings::FrameCycles[(int32)EBallBearingTiming::Num] = { 0 };
+
+// Start a new frame of timings at the beginning of each engine frame, once, rather
+// than leaving it to whoever happens to be reading them.
+static FDelayedAutoRegisterHelper GBallBearingTimingsRegistration(EDelayedRegisterRunPhase::EndOfEngineInit, []()
+{
+	FCoreDelegates::OnBeginFrame.AddStatic(&FBallBearingTimings::StartFrame);
+});
+
+
+/**
+Get the name of a system, for reporting.
+*********************************************************************************/
+
+const TCHAR* FBallBearingTimings::GetName(EBallBearingTiming timing)
+{
+	switch (timing)
+	{
+	case EBallBearingTiming::Magnetism:
+		return TEXT("magnetism");
+	case EBallBearingTiming::PlayerTick:
+		return TEXT("playerTick");
+	case EBallBearingTiming::EndGameCheck:
+		return TEXT("endGameCheck");
+	case EBallBearingTiming::HitNotifications:
+		return TEXT("hitNotifications");
+	default:
+		return TEXT("unknown");
+	}
+}
@@ -0,0 +1,136 @@
+/**
+
+Game thread timings for ball bearing systems in Metal in Motion.
+
+Original author: Rob Baker.
+Current maintainer: Rob Baker.
+
+Very cheap accumulators for the time spent in each of the main game systems.
+A new frame is started at the beginning of each engine frame, keeping the last
+frame's timings for anything interested in them to read, such as the ball bearing
+HUD's performance page, however many of those there are, if any. The benchmark
+commandlet ticks its world itself, so starts its own frames. They're only ever
+touched on the game thread.
+
+The same systems also have cycle stats, along with some counters, in the
+MetalInMotion stats group, viewable with "stat MetalInMotion".
+
+*********************************************************************************/
+
+#pragma once
+
+#include "CoreMinimal.h"
+#include "HAL/PlatformTime.h"
+#include "Stats/Stats.h"
+
+
+// Stats for the ball bearing systems.
+DECLARE_STATS_GROUP(TEXT("MetalInMotion"), STATGROUP_MetalInMotion, STATCAT_Advanced);
+
+DECLARE_CYCLE_STAT_EXTERN(TEXT("Goal magnetism"), STAT_BallBearingMagnetism, STATGROUP_MetalInMotion, METALINMOTION_API);
+DECLARE_CYCLE_STAT_EXTERN(TEXT("Player ball bearing tick"), STAT_PlayerBallBearingTick, STATGROUP_MetalInMotion, METALINMOTION_API);
+DECLARE_CYCLE_STAT_EXTERN(TEXT("Game mode tick"), STAT_GameModeTick, STATGROUP_MetalInMotion, METALINMOTION_API);
+DECLARE_CYCLE_STAT_EXTERN(TEXT("Ball bearing hit notification"), STAT_BallBearingHit, STATGROUP_MetalInMotion, METALINMOTION_API);
+DECLARE_CYCLE_STAT_EXTERN(TEXT("Game reset"), STAT_GameReset, STATGROUP_MetalInMotion, METALINMOTION_API);
+DECLARE_CYCLE_STAT_EXTERN(TEXT("Impact audio"), STAT_ImpactAudio, STATGROUP_MetalInMotion, METALINMOTION_API);
+
+DECLARE_DWORD_COUNTER_STAT_EXTERN(TEXT("Active ball bearings"), STAT_ActiveBallBearings, STATGROUP_MetalInMotion, METALINMOTION_API);
+DECLARE_DWORD_COUNTER_STAT_EXTERN(TEXT("Active goals"), STAT_ActiveGoals, STATGROUP_MetalInMotion, METALINMOTION_API);
+DECLARE_DWORD_COUNTER_STAT_EXTERN(TEXT("Dormant goals"), STAT_DormantGoals, STATGROUP_MetalInMotion, METALINMOTION_API);
+DECLARE_DWORD_COUNTER_STAT_EXTERN(TEXT("Magnetism forces applied"), STAT_MagnetismForces, STATGROUP_MetalInMotion, METALINMOTION_API);
+DECLARE_DWORD_COUNTER_STAT_EXTERN(TEXT("Ball bearing hits"), STAT_BallBearingHits, STATGROUP_MetalInMotion, METALINMOTION_API);
+DECLARE_DWORD_COUNTER_STAT_EXTERN(TEXT("Sleeping ball bearings"), STAT_SleepingBallBearings, STATGROUP_MetalInMotion, METALINMOTION_API);
+DECLARE_DWORD_COUNTER_STAT_EXTERN(TEXT("Near ball bearings"), STAT_NearBallBearings, STATGROUP_MetalInMotion, METALINMOTION_API);
+DECLARE_DWORD_COUNTER_STAT_EXTERN(TEXT("Mid-range ball bearings"), STAT_MidBallBearings, STATGROUP_MetalInMotion, METALINMOTION_API);
+DECLARE_DWORD_COUNTER_STAT_EXTERN(TEXT("Far ball bearings"), STAT_FarBallBearings, STATGROUP_MetalInMotion, METALINMOTION_API);
+DECLARE_DWORD_COUNTER_STAT_EXTERN(TEXT("Impacts reported"), STAT_ImpactsReported, STATGROUP_MetalInMotion, METALINMOTION_API);
+DECLARE_DWORD_COUNTER_STAT_EXTERN(TEXT("Impacts played"), STAT_ImpactsPlayed, STATGROUP_MetalInMotion, METALINMOTION_API);
+DECLARE_DWORD_COUNTER_STAT_EXTERN(TEXT("Impact voices stolen"), STAT_ImpactVoicesStolen, STATGROUP_MetalInMotion, METALINMOTION_API);
+
+DECLARE_DWORD_ACCUMULATOR_STAT_EXTERN(TEXT("Pooled ball bearings"), STAT_PooledBallBearings, STATGROUP_MetalInMotion, METALINMOTION_API);
+DECLARE_DWORD_ACCUMULATOR_STAT_EXTERN(TEXT("Pooled ball bearings in use"), STAT_PooledBallBearingsInUse, STATGROUP_MetalInMotion, METALINMOTION_API);
+DECLARE_DWORD_ACCUMULATOR_STAT_EXTERN(TEXT("Pooled ball bearings high water"), STAT_PooledBallBearingsHighWater, STATGROUP_MetalInMotion, METALINMOTION_API);
+
+
+/**
+The game systems that are timed.
+*********************************************************************************/
+
+enum class EBallBearingTiming : uint8
+{
+	Magnetism,
+	PlayerTick,
+	EndGameCheck,
+	HitNotifications,
+	Num
+};
+
+
+/**
+Accumulated game thread timings for ball bearing systems.
+*********************************************************************************/
+
+class METALINMOTION_API FBallBearingTimings
+{
+public:
+
+	// Start timing a new frame, keeping the timings accumulated over the last one for reporting.
+	static void StartFrame()
+	{
+		FMemory::Memcpy(FrameCycles, Cycles, sizeof(Cycles));
+		FMemory::Memzero(Cycles);
+	}
+
+	// Add some cycles to the accumulated timing for a system.
+	static void Add(EBallBearingTiming timing, uint64 cycles)
+	{
+		Cycles[(int32)timing] += cycles;
+	}
+
+	// Get the timing for a system over the last frame in seconds.
+	static double GetSeconds(EBallBearingTiming timing)
+	{
+		return FPlatformTime::ToSeconds64(FrameCycles[(int32)timing]);
+	}
+
+	// Get the name of a system, for reporting.
+	static const TCHAR* GetName(EBallBearingTiming timing);
+
+private:
+
+	// The accumulated cycles for each system over the current frame.
+	static uint64 Cycles[(int32)EBallBearingTiming::Num];
+
+	// The accumulated cycles for each system over the last frame.
+	static uint64 FrameCycles[(int32)EBallBearingTiming::Num];
+};
+
+
+/**
+Accumulate the time spent within a scope to the timing for a system.
+*********************************************************************************/
+
+class FScopedBallBearingTiming
+{
+public:
+
+	// Start timing the scope.
+	explicit FScopedBallBearingTiming(EBallBearingTiming timing)
+		: Timing(timing)
+		, StartCycles(FPlatformTime::Cycles64())
+	{ }
+
+	// Stop timing the scope and accumulate it.
+	~FScopedBallBearingTiming()
+	{
+		FBallBearingTimings::Add(Timing, FPlatformTime::Cycles64() - StartCycles);
+	}
+
+private:
+
+	// The system being timed.
+	EBallBearingTiming Timing;
+
+	// The cycle count at the start of the scope.
+	uint64 StartCycles;
+};
@@ -0,0 +1,13 @@
+/**
+
+Unreal Insights tracing for Metal in Motion.
+
+Original author: Rob Baker.
+Current maintainer: Rob Baker.
+
+*********************************************************************************/
+
+#include "BallBearingTrace.h"
+
+
+UE_TRACE_CHANNEL_DEFINE(MetalInMotionChannel)
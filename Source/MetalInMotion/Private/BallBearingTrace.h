@@ -0,0 +1,38 @@
+/**
+
+Unreal Insights tracing for Metal in Motion.
+
+Original author: Rob Baker.
+Current maintainer: Rob Baker.
+
+The ball bearing systems trace their hot paths as CPU scopes on their own
+MetalInMotion channel, so they can be turned on for a capture with
+-trace=cpu,metalinmotion without paying for them otherwise. Gameplay events are
+traced as bookmarks, so a spike in a capture can be matched to what was
+happening in the game at the time, and a few counters track the state of the
+simulation. Counters only exist from 4.26, so they compile away before then.
+
+*********************************************************************************/
+
+#pragma once
+
+#include "CoreMinimal.h"
+#include "Trace/Trace.h"
+#include "ProfilingDebugging/CpuProfilerTrace.h"
+#include "ProfilingDebugging/MiscTrace.h"
+
+#if __has_include("ProfilingDebugging/CountersTrace.h")
+#include "ProfilingDebugging/CountersTrace.h"
+#endif
+
+// The trace channel for the ball bearing systems.
+UE_TRACE_CHANNEL_EXTERN(MetalInMotionChannel, METALINMOTION_API)
+
+// Trace a CPU scope on the MetalInMotion channel.
+#define BALL_BEARING_TRACE_SCOPE(Name) TRACE_CPUPROFILER_EVENT_SCOPE_ON_CHANNEL(Name, MetalInMotionChannel)
+
+#ifndef TRACE_DECLARE_INT_COUNTER
+#define TRACE_DECLARE_INT_COUNTER(CounterName, CounterDisplayName)
+#define TRACE_DECLARE_FLOAT_COUNTER(CounterName, CounterDisplayName)
+#define TRACE_COUNTER_SET(CounterName, Value)
+#endif
@@ -0,0 +1,391 @@
+/**
+
+Headless simulation benchmark for Metal in Motion.
+
+Original author: Rob Baker.
+Current maintainer: Rob Baker.
+
+*********************************************************************************/
+
+#include "BearingBenchCommandlet.h"
+#include "MetalInMotion.h"
+#include "MetalInMotionGameModeBase.h"
+#include "PlayerBallBearing.h"
+#include "BallBearingGoal.h"
+#include "BallBearingSubsystem.h"
+#include "BallBearingTimings.h"
+#include "BallBearingMath.h"
+#include "Engine/Engine.h"
+#include "Engine/World.h"
+#include "Engine/StaticMesh.h"
+#include "Engine/StaticMeshActor.h"
+#include "GameFramework/WorldSettings.h"
+#include "Components/SphereComponent.h"
+#include "Misc/FileHelper.h"
+#include "Dom/JsonObject.h"
+#include "Serialization/JsonWriter.h"
+#include "Serialization/JsonSerializer.h"
+
+
+/**
+The settings for a benchmark run, parsed from the command line.
+*********************************************************************************/
+
+struct FBearingBenchSettings
+{
+	// Parse the settings from the command line parameters.
+	explicit FBearingBenchSettings(const FString& params)
+	{
+		FParse::Value(*params, TEXT("goals="), NumGoals);
+		FParse::Value(*params, TEXT("bearings="), NumBallBearings);
+		FParse::Value(*params, TEXT("players="), NumPlayers);
+		FParse::Value(*params, TEXT("frames="), NumFrames);
+		FParse::Value(*params, TEXT("warmup="), NumWarmupFrames);
+		FParse::Value(*params, TEXT("fps="), FramesPerSecond);
+		FParse::Value(*params, TEXT("arena="), ArenaSize);
+		FParse::Value(*params, TEXT("goalradius="), GoalRadius);
+		FParse::Value(*params, TEXT("seed="), Seed);
+		FParse::Value(*params, TEXT("mathpairs="), NumMathPairs);
+		FParse::Value(*params, TEXT("output="), OutputPath);
+
+		NumFrames = FMath::Max(NumFrames, 1);
+		FramesPerSecond = FMath::Max(FramesPerSecond, 1.0f);
+	}
+
+	// Number of goals to spawn.
+	int32 NumGoals = 100;
+
+	// Number of magnetized ball bearings to spawn.
+	int32 NumBallBearings = 1000;
+
+	// Number of player ball bearings to spawn.
+	int32 NumPlayers = 1;
+
+	// Number of frames to measure.
+	int32 NumFrames = 1000;
+
+	// Number of frames to step before measuring.
+	int32 NumWarmupFrames = 60;
+
+	// The fixed frame rate to step at.
+	float FramesPerSecond = 60.0f;
+
+	// The half-width of the floor in centimeters.
+	float ArenaSize = 5000.0f;
+
+	// The radius of each goal's sphere in centimeters.
+	float GoalRadius = 300.0f;
+
+	// Seed for placing goals and bearings.
+	int32 Seed = 1;
+
+	// Number of pairings to microbenchmark the magnetism math over, or 0 for none.
+	int32 NumMathPairs = 0;
+
+	// File to write the JSON report to, if any.
+	FString OutputPath;
+};
+
+
+/**
+Get a percentile from a sorted array of samples, using the nearest-rank method.
+*********************************************************************************/
+
+static double GetPercentile(const TArray<double>& sorted, double percentile)
+{
+	if (sorted.Num() == 0)
+	{
+		return 0.0;
+	}
+
+	int32 index = FMath::CeilToInt(percentile * sorted.Num()) - 1;
+
+	return sorted[FMath::Clamp(index, 0, sorted.Num() - 1)];
+}
+
+
+/**
+Construct the commandlet, setting it up to run without a client or editor.
+*********************************************************************************/
+
+UBearingBenchCommandlet::UBearingBenchCommandlet()
+{
+	IsClient = false;
+	IsServer = false;
+	IsEditor = false;
+	LogToConsole = true;
+}
+
+
+/**
+Run the benchmark.
+*********************************************************************************/
+
+int32 UBearingBenchCommandlet::Main(const FString& params)
+{
+	FBearingBenchSettings settings(params);
+	float deltaSeconds = 1.0f / settings.FramesPerSecond;
+
+	// Create a game world to run in. There's no game instance here so the game mode
+	// is spawned by hand, and play is begun directly rather than through it.
+
+	UWorld* world = UWorld::CreateWorld(EWorldType::Game, false, TEXT("BearingBench"));
+	FWorldContext& worldContext = GEngine->CreateNewWorldContext(EWorldType::Game);
+
+	worldContext.SetCurrentWorld(world);
+
+	world->InitializeActorsForPlay(FURL());
+	world->SpawnActor<AMetalInMotionGameModeBase>();
+
+	SpawnScene(world, settings);
+
+	world->BeginPlay();
+	world->GetWorldSettings()->NotifyBeginPlay();
+
+	// Step the world at the fixed timestep, timing each frame and the systems within it.
+
+	TArray<double> frameTimes;
+	double systemSeconds[(int32)EBallBearingTiming::Num] = { 0.0 };
+
+	frameTimes.Reserve(settings.NumFrames);
+
+	// The engine loop isn't running to start frames of timings, so start them ourselves,
+	// discarding anything timed while setting up.
+
+	FBallBearingTimings::StartFrame();
+
+	for (int32 frame = 0; frame < settings.NumWarmupFrames + settings.NumFrames; frame++)
+	{
+		double startTime = FPlatformTime::Seconds();
+
+		world->Tick(LEVELTICK_All, deltaSeconds);
+
+		double frameTime = FPlatformTime::Seconds() - startTime;
+
+		FBallBearingTimings::StartFrame();
+
+		GFrameCounter++;
+
+		if (frame >= settings.NumWarmupFrames)
+		{
+			frameTimes.Add(frameTime);
+
+			for (int32 i = 0; i < (int32)EBallBearingTiming::Num; i++)
+			{
+				systemSeconds[i] += FBallBearingTimings::GetSeconds((EBallBearingTiming)i);
+			}
+		}
+	}
+
+	// Build the report.
+
+	double totalSeconds = 0.0;
+
+	for (double frameTime : frameTimes)
+	{
+		totalSeconds += frameTime;
+	}
+
+	frameTimes.Sort();
+
+	TSharedRef<FJsonObject> frameMilliseconds = MakeShared<FJsonObject>();
+
+	frameMilliseconds->SetNumberField(TEXT("mean"), totalSeconds * 1000.0 / frameTimes.Num());
+	frameMilliseconds->SetNumberField(TEXT("p50"), GetPercentile(frameTimes, 0.50) * 1000.0);
+	frameMilliseconds->SetNumberField(TEXT("p95"), GetPercentile(frameTimes, 0.95) * 1000.0);
+	frameMilliseconds->SetNumberField(TEXT("p99"), GetPercentile(frameTimes, 0.99) * 1000.0);
+	frameMilliseconds->SetNumberField(TEXT("max"), frameTimes.Last() * 1000.0);
+
+	TSharedRef<FJsonObject> systemMilliseconds = MakeShared<FJsonObject>();
+
+	for (int32 i = 0; i < (int32)EBallBearingTiming::Num; i++)
+	{
+		systemMilliseconds->SetNumberField(FBallBearingTimings::GetName((EBallBearingTiming)i), systemSeconds[i] * 1000.0 / frameTimes.Num());
+	}
+
+	TSharedRef<FJsonObject> report = MakeShared<FJsonObject>();
+
+	report->SetNumberField(TEXT("goals"), settings.NumGoals);
+	report->SetNumberField(TEXT("bearings"), settings.NumBallBearings);
+	report->SetNumberField(TEXT("players"), settings.NumPlayers);
+	report->SetNumberField(TEXT("frames"), settings.NumFrames);
+	report->SetNumberField(TEXT("fixedDeltaSeconds"), deltaSeconds);
+	report->SetNumberField(TEXT("ticksPerSecond"), frameTimes.Num() / FMath::Max(totalSeconds, SMALL_NUMBER));
+	report->SetObjectField(TEXT("frameMilliseconds"), frameMilliseconds);
+	report->SetObjectField(TEXT("systemMillisecondsPerFrame"), systemMilliseconds);
+
+	UBallBearingSubsystem* subsystem = world->GetSubsystem<UBallBearingSubsystem>();
+
+	if (subsystem != nullptr)
+	{
+		report->SetNumberField(TEXT("activeGoals"), subsystem->GetNumActiveGoals());
+		report->SetNumberField(TEXT("dormantGoals"), subsystem->GetNumDormantGoals());
+	}
+
+	if (settings.NumMathPairs > 0)
+	{
+		report->SetObjectField(TEXT("magnetismMath"), BenchmarkMath(settings));
+	}
+
+	FString json;
+	TSharedRef<TJsonWriter<>> writer = TJsonWriterFactory<>::Create(&json);
+
+	FJsonSerializer::Serialize(report, writer);
+
+	UE_LOG(LogMetalInMotion, Display, TEXT("%s"), *json);
+
+	if (settings.OutputPath.IsEmpty() == false &&
+		FFileHelper::SaveStringToFile(json, *settings.OutputPath) == false)
+	{
+		UE_LOG(LogMetalInMotion, Error, TEXT("Failed to write the benchmark report to %s"), *settings.OutputPath);
+	}
+
+	// Tear the world down again.
+
+	GEngine->DestroyWorldContext(world);
+
+	world->DestroyWorld(false);
+
+	return 0;
+}
+
+
+/**
+Spawn the floor, goals and ball bearings for the benchmark into a world.
+*********************************************************************************/
+
+void UBearingBenchCommandlet::SpawnScene(UWorld* world, const FBearingBenchSettings& settings) const
+{
+	UStaticMesh* cubeMesh = LoadObject<UStaticMesh>(nullptr, TEXT("/Engine/BasicShapes/Cube.Cube"));
+	UStaticMesh* sphereMesh = LoadObject<UStaticMesh>(nullptr, TEXT("/Engine/BasicShapes/Sphere.Sphere"));
+	FRandomStream random(settings.Seed);
+
+	// Actors are spawned deferred so their meshes and sizes are set before their
+	// components are registered, as static mobility forbids changing them afterwards.
+
+	// The floor, from a 1m engine cube scaled out to the size of the arena.
+
+	FTransform floorTransform(FRotator::ZeroRotator, FVector(0.0f, 0.0f, -50.0f), FVector(settings.ArenaSize / 50.0f, settings.ArenaSize / 50.0f, 1.0f));
+	AStaticMeshActor* floor = world->SpawnActorDeferred<AStaticMeshActor>(AStaticMeshActor::StaticClass(), floorTransform);
+
+	floor->GetStaticMeshComponent()->SetStaticMesh(cubeMesh);
+	floor->FinishSpawning(floorTransform);
+
+	// The goals, scattered across the floor.
+
+	for (int32 i = 0; i < settings.NumGoals; i++)
+	{
+		FTransform transform(FVector(random.FRandRange(-settings.ArenaSize, settings.ArenaSize), random.FRandRange(-settings.ArenaSize, settings.ArenaSize), 50.0f));
+		ABallBearingGoal* goal = world->SpawnActorDeferred<ABallBearingGoal>(ABallBearingGoal::StaticClass(), transform);
+
+		Cast<USphereComponent>(goal->GetCollisionComponent())->SetSphereRadius(settings.GoalRadius);
+
+		goal->FinishSpawning(transform);
+	}
+
+	// The ball bearings, dropped onto the floor from a little height.
+
+	for (int32 i = 0; i < settings.NumBallBearings + settings.NumPlayers; i++)
+	{
+		UClass* ballBearingClass = (i < settings.NumPlayers) ? APlayerBallBearing::StaticClass() : ABallBearing::StaticClass();
+		FTransform transform(FRotator::ZeroRotator, FVector(random.FRandRange(-settings.ArenaSize, settings.ArenaSize), random.FRandRange(-settings.ArenaSize, settings.ArenaSize), random.FRandRange(100.0f, 300.0f)), FVector(0.5f));
+		ABallBearing* ballBearing = world->SpawnActorDeferred<ABallBearing>(ballBearingClass, transform);
+
+		ballBearing->BallMesh->SetStaticMesh(sphereMesh);
+		ballBearing->BallMesh->SetNotifyRigidBodyCollision(true);
+		ballBearing->FinishSpawning(transform);
+	}
+}
+
+
+/**
+Microbenchmark the scalar and batch magnetism math, returning the results for the report.
+*********************************************************************************/
+
+TSharedRef<FJsonObject> UBearingBenchCommandlet::BenchmarkMath(const FBearingBenchSettings& settings) const
+{
+	typedef TArray<float, TAlignedHeapAllocator<16>> FAlignedFloats;
+
+	// Pairings scattered around their goals out to beyond the goal radius, padded out
+	// to whole vector registers as the solver does.
+
+	int32 numPairs = Align(settings.NumMathPairs, 4);
+	FRandomStream random(settings.Seed);
+	FAlignedFloats inputs[5];
+	FAlignedFloats scalarOutputs[4];
+	FAlignedFloats batchOutputs[4];
+
+	for (int32 i = 0; i < 4; i++)
+	{
+		scalarOutputs[i].SetNumZeroed(numPairs);
+		batchOutputs[i].SetNumZeroed(numPairs);
+	}
+
+	for (int32 i = 0; i < numPairs; i++)
+	{
+		float range = settings.GoalRadius * 1.5f;
+
+		inputs[0].Add(random.FRandRange(-range, range));
+		inputs[1].Add(random.FRandRange(-range, range));
+		inputs[2].Add(random.FRandRange(-range, range));
+		inputs[3].Add(1.0f / settings.GoalRadius);
+		inputs[4].Add(random.FRandRange(1000.0f, 10000.0f));
+	}
+
+	// Time each version over the same pairings, once per measured frame.
+
+	double scalarSeconds = 0.0;
+	double batchSeconds = 0.0;
+
+	for (int32 frame = 0; frame < settings.NumFrames; frame++)
+	{
+		double startTime = FPlatformTime::Seconds();
+
+		for (int32 i = 0; i < numPairs; i++)
+		{
+			FBallBearingMath::GetMagnetismForce(inputs[0][i], inputs[1][i], inputs[2][i], inputs[3][i], inputs[4][i], scalarOutputs[0][i], scalarOutputs[1][i], scalarOutputs[2][i], scalarOutputs[3][i]);
+		}
+
+		double middleTime = FPlatformTime::Seconds();
+
+		FBallBearingMath::GetMagnetismForces(numPairs, inputs[0].GetData(), inputs[1].GetData(), inputs[2].GetData(), inputs[3].GetData(), inputs[4].GetData(), batchOutputs[0].GetData(), batchOutputs[1].GetData(), batchOutputs[2].GetData(), batchOutputs[3].GetData());
+
+		double endTime = FPlatformTime::Seconds();
+
+		scalarSeconds += middleTime - startTime;
+		batchSeconds += endTime - middleTime;
+	}
+
+	// The two versions should agree to the bit.
+
+	int32 numMismatches = 0;
+
+	for (int32 i = 0; i < numPairs; i++)
+	{
+		for (int32 j = 0; j < 4; j++)
+		{
+			if (FMemory::Memcmp(&scalarOutputs[j][i], &batchOutputs[j][i], sizeof(float)) != 0)
+			{
+				numMismatches++;
+
+				break;
+			}
+		}
+	}
+
+	if (numMismatches > 0)
+	{
+		UE_LOG(LogMetalInMotion, Error, TEXT("Scalar and batch magnetism disagree for %d of %d pairings"), numMismatches, numPairs);
+	}
+
+	double numSolved = (double)numPairs * settings.NumFrames;
+	TSharedRef<FJsonObject> results = MakeShared<FJsonObject>();
+
+	results->SetNumberField(TEXT("pairs"), numPairs);
+	results->SetBoolField(TEXT("simd"), BALL_BEARING_MATH_SSE != 0);
+	results->SetNumberField(TEXT("scalarNanosecondsPerPair"), scalarSeconds * 1.0e9 / numSolved);
+	results->SetNumberField(TEXT("batchNanosecondsPerPair"), batchSeconds * 1.0e9 / numSolved);
+	results->SetNumberField(TEXT("mismatches"), numMismatches);
+
+	return results;
+}
@@ -0,0 +1,67 @@
+/**
+
+Headless simulation benchmark for Metal in Motion.
+
+Original author: Rob Baker.
+Current maintainer: Rob Baker.
+
+Builds a world containing a floor, a number of goals and a number of ball
+bearings, steps it at a fixed timestep and reports how it scaled as JSON.
+Run it with something like:
+
+	UE4Editor-Cmd MetalInMotion.uproject -run=BearingBench -nullrhi -goals=100 -bearings=2000 -frames=1000 -output=bench.json
+
+Supported parameters, all optional:
+
+	-goals=N          Number of goals to spawn (100).
+	-bearings=N       Number of magnetized ball bearings to spawn (1000).
+	-players=N        Number of player ball bearings to spawn (1).
+	-frames=N         Number of frames to measure (1000).
+	-warmup=N         Number of frames to step before measuring (60).
+	-fps=N            The fixed frame rate to step at (60).
+	-arena=N          The half-width of the floor in centimeters (5000).
+	-goalradius=N     The radius of each goal's sphere in centimeters (300).
+	-seed=N           Seed for placing goals and bearings (1).
+	-mathpairs=N      Number of pairings to microbenchmark the magnetism math over (0, off).
+	-output=Path      File to write the JSON report to, as well as the log.
+
+The magnetism math microbenchmark times the scalar and batch versions from
+BallBearingMath.h over the same random pairings, once per measured frame, and
+reports any pairing where the two disagree, which should never happen.
+
+*********************************************************************************/
+
+#pragma once
+
+#include "CoreMinimal.h"
+#include "Commandlets/Commandlet.h"
+#include "BearingBenchCommandlet.generated.h"
+
+struct FBearingBenchSettings;
+
+
+/**
+Headless simulation benchmark for Metal in Motion.
+*********************************************************************************/
+
+UCLASS()
+class UBearingBenchCommandlet : public UCommandlet
+{
+	GENERATED_BODY()
+
+public:
+
+	// Construct the commandlet, setting it up to run without a client or editor.
+	UBearingBenchCommandlet();
+
+	// Run the benchmark.
+	virtual int32 Main(const FString& params) override;
+
+private:
+
+	// Spawn the floor, goals and ball bearings for the benchmark into a world.
+	void SpawnScene(UWorld* world, const FBearingBenchSettings& settings) const;
+
+	// Microbenchmark the scalar and batch magnetism math, returning the results for the report.
+	TSharedRef<class FJsonObject> BenchmarkMath(const FBearingBenchSettings& settings) const;
+};
@@ -8,7 +8,8 @@ Current maintainer: Rob Baker.
 *********************************************************************************/
 
 #include "DebugHUD.h"
-#include "UObject/ConstructorHelpers.h"
+#include "Engine/AssetManager.h"
+#include "Engine/Engine.h"
 
 
 /**
@@ -16,8 +17,137 @@ Construct the debugging HUD, mainly establishing a font to use for display.
 *********************************************************************************/
 
 ADebugHUD::ADebugHUD()
+	: MainFontAsset(FSoftObjectPath(TEXT("/Engine/EngineFonts/Roboto.Roboto")))
+{ }
+
+
+/**
+Pick up the display font, if it's loaded, falling back on the engine's own until it is.
+*********************************************************************************/
+
+void ADebugHUD::BeginPlay()
+{
+	Super::BeginPlay();
+
+	// The game mode normally has the font loaded along with the map, but if not then
+	// load it in the background rather than stall on it.
+
+	MainFont = MainFontAsset.Get();
+
+	if (MainFont == nullptr)
+	{
+		MainFont = GEngine->GetSmallFont();
+
+		if (MainFontAsset.IsNull() == false)
+		{
+			UAssetManager::GetStreamableManager().RequestAsyncLoad(MainFontAsset.ToSoftObjectPath(), FStreamableDelegate::CreateUObject(this, &ADebugHUD::OnMainFontLoaded));
+		}
+	}
+}
+
+
+/**
+Switch over to the display font once it's loaded.
+*********************************************************************************/
+
+void ADebugHUD::OnMainFontLoaded()
+{
+	if (MainFontAsset.Get() != nullptr)
+	{
+		MainFont = MainFontAsset.Get();
+
+		// Rows keep the font they were built with, so have them built again.
+
+		Rows.Reset();
+		NextRow = 0;
+	}
+}
+
+
+/**
+Add a float to the HUD for rendering.
+*********************************************************************************/
+
+void ADebugHUD::AddFloat(const TCHAR* title, float value)
+{
+	// Format much as FText::AsNumber would, with up to three fractional digits.
+
+	TCHAR buffer[ValueBufferSize];
+
+	FCString::Snprintf(buffer, ValueBufferSize, TEXT("%.3f"), value);
+
+	int32 length = FCString::Strlen(buffer);
+
+	while (length > 0 && buffer[length - 1] == TEXT('0'))
+	{
+		buffer[--length] = 0;
+	}
+
+	if (length > 0 && buffer[length - 1] == TEXT('.'))
+	{
+		buffer[--length] = 0;
+	}
+
+	SetRowValue(GetRow(title), buffer, FLinearColor::White);
+}
+
+
+/**
+Draw the HUD and then all of the rows it added in one pass.
+*********************************************************************************/
+
+void ADebugHUD::PostRender()
 {
-	static ConstructorHelpers::FObjectFinder<UFont> Font(TEXT("/Engine/EngineFonts/Roboto"));
+	// This calls DrawHUD, which is where the rows for this frame are added.
+
+	Super::PostRender();
+
+	// Forget any rows that weren't added this frame.
+
+	if (Rows.Num() > NextRow)
+	{
+		Rows.RemoveAt(NextRow, Rows.Num() - NextRow, false);
+	}
+
+	if (bShowHUD == true &&
+		Canvas != nullptr)
+	{
+		FVector2D position(X, Y);
+
+		for (FDebugHUDRow& row : Rows)
+		{
+			row.TitleItem.Position = position;
+			row.ValueItem.Position = FVector2D(position.X + HorizontalOffset, position.Y);
+
+			Canvas->DrawItem(row.TitleItem);
+			Canvas->DrawItem(row.ValueItem);
+
+			position.Y += LineHeight;
+		}
+	}
+}
+
+
+/**
+Get the next row for a title, registering it if it's not already there.
+*********************************************************************************/
+
+ADebugHUD::FDebugHUDRow& ADebugHUD::GetRow(const TCHAR* title)
+{
+	// Rows are matched by position and title pointer, so a HUD adding the same
+	// statistics in the same order each frame only ever registers them once. If the
+	// order changes, the rows from here on are simply registered again.
+
+	if (Rows.IsValidIndex(NextRow) == false ||
+		Rows[NextRow].Title != title)
+	{
+		if (Rows.IsValidIndex(NextRow) == true)
+		{
+			Rows.RemoveAt(NextRow, Rows.Num() - NextRow, false);
+		}
+
+		Rows.Emplace(title, MainFont);
+	}
 
-	MainFont = Font.Object;
+	return Rows[NextRow++];
 }
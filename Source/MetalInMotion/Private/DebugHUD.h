@@ -5,6 +5,12 @@ Debugging HUD for Metal in Motion.
 Original author: Rob Baker.
 Current maintainer: Rob Baker.
 
+The HUD is retained-mode: each statistic added becomes a row which is kept from
+frame to frame, identified by its title pointer and position, so its title text
+is only ever built once. Values are formatted into a fixed buffer in the row and
+only converted to text when they change, and all rows are then drawn together
+in a single pass after DrawHUD, so a steady HUD makes no allocations at all.
+
 *********************************************************************************/
 
 #pragma once
@@ -25,6 +31,12 @@ class METALINMOTION_API ADebugHUD : public AHUD
 {
 	GENERATED_BODY()
 
+public:
+
+	// The font to use for display, loaded asynchronously along with the map.
+	UPROPERTY(EditDefaultsOnly, Category = HUD)
+		TSoftObjectPtr<UFont> MainFontAsset;
+
 protected:
 
 	// Construct the debugging HUD, mainly establishing a font to use for display.
@@ -33,70 +45,127 @@ protected:
 	// Add a FText to the HUD for rendering.
 	void AddText(const TCHAR* title, const FText& value)
 	{
-		RenderStatistic(title, value);
+		FDebugHUDRow& row = GetRow(title);
+
+		if (row.ValueItem.Text.IdenticalTo(value) == false)
+		{
+			row.Value[0] = 0;
+			row.ValueItem.Text = value;
+		}
+
+		row.ValueItem.SetColor(FLinearColor::White);
 	}
 
 	// Add a float to the HUD for rendering.
-	void AddFloat(const TCHAR* title, float value)
-	{
-		RenderStatistic(title, FText::AsNumber(value));
-	}
+	void AddFloat(const TCHAR* title, float value);
 
 	// Add an int32 to the HUD for rendering.
 	void AddInt(const TCHAR* title, int32 value)
 	{
-		RenderStatistic(title, FText::AsNumber(value));
+		TCHAR buffer[ValueBufferSize];
+
+		FCString::Snprintf(buffer, ValueBufferSize, TEXT("%d"), value);
+
+		SetRowValue(GetRow(title), buffer, FLinearColor::White);
 	}
 
 	// Add a bool to the HUD for rendering.
 	void AddBool(const TCHAR* title, bool value)
 	{
-		RenderStatistic(title, BoolToText(value), (value == false) ? FLinearColor::Red : FLinearColor::Green);
+		SetRowValue(GetRow(title), (value == true) ? TEXT("true") : TEXT("false"), (value == false) ? FLinearColor::Red : FLinearColor::Green);
 	}
 
 	// Draw the HUD.
 	virtual void DrawHUD() override
 	{
-		X = Y = 50.0f;
+		NextRow = 0;
 	}
 
-	// The horizontal offset to render the statistic values at.
-	float HorizontalOffset = 150.0f;
+	// Draw the HUD and then all of the rows it added in one pass.
+	virtual void PostRender() override;
 
-private:
+	// Pick up the display font, if it's loaded, falling back on the engine's own until it is.
+	virtual void BeginPlay() override;
 
-	// Convert a TCHAR pointer to FText.
-	FText CStringToText(const TCHAR* text)
+	// Get the screen position that the next row added will be drawn at.
+	FVector2D GetNextRowPosition() const
 	{
-		return FText::FromString(text);
+		return FVector2D(X, Y + NextRow * LineHeight);
 	}
 
-	// Convert a bool to FText.
-	FText BoolToText(bool value)
+	// Get the line height separating each HUD entry.
+	float GetLineHeight() const
 	{
-		return CStringToText((value == true) ? TEXT("true") : TEXT("false"));
+		return LineHeight;
 	}
 
-	// Render a statistic onto the HUD canvas.
-	void RenderStatistic(const TCHAR* title, const FText& value, const FLinearColor& valueColor = FLinearColor::White)
+	// The horizontal offset to render the statistic values at.
+	float HorizontalOffset = 150.0f;
+
+private:
+
+	// The size of the buffer each row's value is formatted into.
+	static constexpr int32 ValueBufferSize = 32;
+
+	// A row of the HUD, retained from frame to frame.
+	struct FDebugHUDRow
 	{
-		FCanvasTextItem item0(FVector2D(X, Y), CStringToText(title), MainFont, FLinearColor::White);
-		item0.EnableShadow(FLinearColor(0.0f, 0.0f, 0.0f));
-		Canvas->DrawItem(item0);
-		FCanvasTextItem item1(FVector2D(X + HorizontalOffset, Y), value, MainFont, valueColor);
-		item1.EnableShadow(FLinearColor(0.0f, 0.0f, 0.0f));
-		Canvas->DrawItem(item1);
-		Y += LineHeight;
+		// Construct a row for a title.
+		FDebugHUDRow(const TCHAR* title, UFont* font)
+			: Title(title)
+			, TitleItem(FVector2D::ZeroVector, FText::FromString(title), font, FLinearColor::White)
+			, ValueItem(FVector2D::ZeroVector, FText::GetEmpty(), font, FLinearColor::White)
+		{
+			TitleItem.EnableShadow(FLinearColor(0.0f, 0.0f, 0.0f));
+			ValueItem.EnableShadow(FLinearColor(0.0f, 0.0f, 0.0f));
+		}
+
+		// The title of the row, whose pointer identifies the row.
+		const TCHAR* Title = nullptr;
+
+		// The canvas item for the title, built once.
+		FCanvasTextItem TitleItem;
+
+		// The canvas item for the value, whose text is only rebuilt when the value changes.
+		FCanvasTextItem ValueItem;
+
+		// The value of the row as last formatted.
+		TCHAR Value[ValueBufferSize] = { 0 };
+	};
+
+	// Switch over to the display font once it's loaded.
+	void OnMainFontLoaded();
+
+	// Get the next row for a title, registering it if it's not already there.
+	FDebugHUDRow& GetRow(const TCHAR* title);
+
+	// Set the formatted value of a row, only rebuilding its text if it has changed.
+	void SetRowValue(FDebugHUDRow& row, const TCHAR* value, const FLinearColor& valueColor)
+	{
+		if (FCString::Strcmp(row.Value, value) != 0)
+		{
+			FCString::Strncpy(row.Value, value, ValueBufferSize);
+
+			row.ValueItem.Text = FText::FromString(row.Value);
+		}
+
+		row.ValueItem.SetColor(valueColor);
 	}
 
 	// Font used to render the debug information.
 	UPROPERTY(Transient)
 		UFont* MainFont = nullptr;
 
-	// The current X coordinate.
+	// The rows of the HUD, retained from frame to frame.
+	TArray<FDebugHUDRow> Rows;
+
+	// The index of the next row to be added this frame.
+	int32 NextRow = 0;
+
+	// The X coordinate of the first row.
 	float X = 50.0f;
 
-	// The current Y coordinate.
+	// The Y coordinate of the first row.
 	float Y = 50.0f;
 
 	// The line height to separate each HUD entry.
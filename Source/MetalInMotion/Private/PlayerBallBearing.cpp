@@ -8,8 +8,52 @@ Current maintainer: Rob Baker.
 *********************************************************************************/
 
 #include "PlayerBallBearing.h"
+#include "BallBearingTimings.h"
+#include "BallBearingTrace.h"
+#include "BallBearingSubsystem.h"
+#include "BallBearingMath.h"
 #include "GameFramework/PlayerInput.h"
 #include "Components/InputComponent.h"
+#include "HAL/IConsoleManager.h"
+#include "Net/UnrealNetwork.h"
+
+
+/**
+Get the bits of a float, for passing through an atomic.
+*********************************************************************************/
+
+static uint32 FloatToBits(float value)
+{
+	uint32 bits;
+
+	FMemory::Memcpy(&bits, &value, sizeof(bits));
+
+	return bits;
+}
+
+
+/**
+Get a float from its bits, as passed through an atomic.
+*********************************************************************************/
+
+static float BitsToFloat(uint32 bits)
+{
+	float value;
+
+	FMemory::Memcpy(&value, &bits, sizeof(value));
+
+	return value;
+}
+
+
+/**
+Is one input sequence number newer than another, allowing for wrapping around?
+*********************************************************************************/
+
+static bool IsSequenceNewer(uint16 sequence, uint16 than)
+{
+	return (int16)(sequence - than) > 0;
+}
 
 
 /**
@@ -40,6 +84,75 @@ APlayerBallBearing::APlayerBallBearing()
 	Camera->SetupAttachment(SpringArm, USpringArmComponent::SocketName);
 
 	Magnetized = false;
+
+	// Unlike passive ball bearings, the player's ball bearing needs to tick to process its input.
+
+	PrimaryActorTick.bCanEverTick = true;
+}
+
+
+/**
+Establish whether the ball bearing is to be controlled per physics step or deterministically.
+*********************************************************************************/
+
+void APlayerBallBearing::BeginPlay()
+{
+	Super::BeginPlay();
+
+	UBallBearingSubsystem* subsystem = GetWorld()->GetSubsystem<UBallBearingSubsystem>();
+
+	UsePhysicsStep = (subsystem != nullptr && subsystem->IsUsingPhysicsStep() == true);
+
+	DashStep = FBallBearingFixedStep((subsystem != nullptr) ? subsystem->GetDeterministicStepSeconds() : 0.0f);
+}
+
+
+/**
+Reset the ball bearing's state, at rest at a given transform.
+*********************************************************************************/
+
+void APlayerBallBearing::ResetToTransform(const FTransform& transform)
+{
+	Super::ResetToTransform(transform);
+
+	DashTimer = 0.0f;
+	DashStep.Reset();
+	CorrectionOffset = FVector::ZeroVector;
+	CorrectionVelocity = FVector::ZeroVector;
+	ServerInputQueue.Reset();
+	ServerInputSeconds = 0.0f;
+
+	PhysicsStepDashTimer = FloatToBits(DashTimer);
+}
+
+
+/**
+Establish the properties to be replicated.
+*********************************************************************************/
+
+void APlayerBallBearing::GetLifetimeReplicatedProps(TArray<FLifetimeProperty>& outLifetimeProps) const
+{
+	Super::GetLifetimeReplicatedProps(outLifetimeProps);
+
+	// Only the owning client predicts, so only it needs the authoritative state.
+
+	DOREPLIFETIME_CONDITION(APlayerBallBearing, AuthoritativeState, COND_AutonomousOnly);
+}
+
+
+/**
+Apply replicated movement, unless we're predicting it ourselves.
+*********************************************************************************/
+
+void APlayerBallBearing::OnRep_ReplicatedMovement()
+{
+	// The authoritative state reconciles a predicted ball bearing instead, applying
+	// the replicated movement as well would just snap it back in time.
+
+	if (IsPredicting() == false)
+	{
+		Super::OnRep_ReplicatedMovement();
+	}
 }
 
 
@@ -99,10 +212,24 @@ Have the ball bearing perform a jump.
 
 void APlayerBallBearing::Jump()
 {
+	// Clients have the server jump, predicting the jump themselves if they can.
+
+	if (HasAuthority() == false)
+	{
+		ServerJump();
+
+		if (IsPredicting() == false)
+		{
+			return;
+		}
+	}
+
 	// Only jump if we're in contact with something, normally the ground.
 
-	if (InContact == true)
+	if (IsInContact() == true)
 	{
+		TRACE_BOOKMARK(TEXT("Jump"));
+
 		// Add the impulse to the ball to perform the jump.
 
 		BallMesh->AddImpulse(FVector(0.0f, 0.0f, JumpForce * 1000.0f));
@@ -116,6 +243,18 @@ Have the ball bearing perform a dash.
 
 void APlayerBallBearing::Dash()
 {
+	// Clients have the server dash, predicting the dash themselves if they can.
+
+	if (HasAuthority() == false)
+	{
+		ServerDash();
+
+		if (IsPredicting() == false)
+		{
+			return;
+		}
+	}
+
 	// Only dash if we're not dashing already.
 
 	if (DashTimer == 0.0f)
@@ -126,6 +265,8 @@ void APlayerBallBearing::Dash()
 
 		if (velocity.Size() > 1.0f)
 		{
+			TRACE_BOOKMARK(TEXT("Dash"));
+
 			velocity.Normalize();
 			velocity *= DashForce * 1000.0f;
 
@@ -136,6 +277,10 @@ void APlayerBallBearing::Dash()
 			// Set the length of time that we're to dash for.
 
 			DashTimer = 1.5f;
+
+			PhysicsStepDashTimer = FloatToBits(DashTimer);
+
+			PendingDash = (HasAuthority() == false);
 		}
 	}
 }
@@ -149,30 +294,448 @@ void APlayerBallBearing::Tick(float deltaSeconds)
 {
 	Super::Tick(deltaSeconds);
 
-	FVector velocity = BallMesh->GetPhysicsLinearVelocity();
-	float z = velocity.Z;
+	SCOPE_CYCLE_COUNTER(STAT_PlayerBallBearingTick);
+	FScopedBallBearingTiming timing(EBallBearingTiming::PlayerTick);
+	BALL_BEARING_TRACE_SCOPE(PlayerBallBearingSpeedControl);
+
+	// The server simulates the ball bearing and clients send it their input, also
+	// simulating it themselves if they're predicting its movement.
+
+	if (HasAuthority() == false)
+	{
+		if (IsLocallyControlled() == true)
+		{
+			SendInputToServer(deltaSeconds);
+		}
+
+		if (IsPredicting() == false)
+		{
+			return;
+		}
+
+		ApplyCorrection(deltaSeconds);
+	}
+	else
+	{
+		// The state is as the last frame's physics left it, so it acknowledges the input
+		// that physics simulated, not the input received since.
+
+		AuthoritativeState.InputSequence = SimulatedInputSequence;
+		AuthoritativeState.Location = BallMesh->GetComponentLocation();
+		AuthoritativeState.Velocity = BallMesh->GetPhysicsLinearVelocity();
+		AuthoritativeState.DashTimer = (UsePhysicsStep == true) ? BitsToFloat(PhysicsStepDashTimer.Load()) : DashTimer;
+
+		ConsumeServerInput(deltaSeconds);
+	}
 
-	velocity.Z = 0.0f;
+	// When controlled per physics step, all that's left to do here is to pick up the
+	// dash timer as the physics steps have counted it down.
 
-	if (velocity.Size() > MaximumSpeed * 100.0f)
+	if (UsePhysicsStep == true)
 	{
-		velocity.Normalize();
-		velocity *= MaximumSpeed * 100.0f;
-		velocity.Z = z;
+		DashTimer = BitsToFloat(PhysicsStepDashTimer.Load());
 
-		float brakingRatio = FMath::Pow(1.0f - FMath::Min(DashTimer, 1.0f), 2.0f);
+		return;
+	}
 
-		FVector mergedVelocity = FMath::Lerp(BallMesh->GetPhysicsLinearVelocity(), velocity, brakingRatio);
+	FVector clampedVelocity;
 
-		BallMesh->SetPhysicsLinearVelocity(mergedVelocity);
+	if (GetClampedVelocity(BallMesh->GetPhysicsLinearVelocity(), DashTimer, clampedVelocity) == true)
+	{
+		BallMesh->SetPhysicsLinearVelocity(clampedVelocity);
 	}
 	else
 	{
 		BallMesh->AddForce(FVector(InputLongitude, InputLatitude, 0.0f) * ControllerForce * BallMesh->GetMass());
 	}
 
+	// Count the dash timer down, in whole fixed steps if running deterministically.
+
+	float dashSeconds = DashStep.Advance(deltaSeconds);
+
 	if (DashTimer > 0.0f)
 	{
-		DashTimer = FMath::Max(0.0f, DashTimer - deltaSeconds);
+		DashTimer = FMath::Max(0.0f, DashTimer - dashSeconds);
+	}
+}
+
+
+/**
+Is this a client predicting the movement of its own ball bearing?
+*********************************************************************************/
+
+bool APlayerBallBearing::IsPredicting() const
+{
+	static const IConsoleVariable* playerPrediction = IConsoleManager::Get().FindConsoleVariable(TEXT("OurGame.PlayerPrediction"));
+
+	return GetLocalRole() == ROLE_AutonomousProxy && (playerPrediction == nullptr || playerPrediction->GetInt() != 0);
+}
+
+
+/**
+Send this frame's input to the server, keeping it in the history if predicting.
+*********************************************************************************/
+
+void APlayerBallBearing::SendInputToServer(float deltaSeconds)
+{
+	// Input is sent unreliably every frame, each stamped with a sequence number that
+	// the server returns in its authoritative state to acknowledge it, and with the
+	// length of the frame so the server can apply it for as long as we did.
+
+	int8 inputLongitude = (int8)FMath::RoundToInt(FMath::Clamp(InputLongitude, -1.0f, 1.0f) * 127.0f);
+	int8 inputLatitude = (int8)FMath::RoundToInt(FMath::Clamp(InputLatitude, -1.0f, 1.0f) * 127.0f);
+	uint8 deltaMilliseconds = (uint8)FMath::Clamp(FMath::RoundToInt(deltaSeconds * 1000.0f), 1, 255);
+
+	InputSequence++;
+
+	ServerSetInput(InputSequence, inputLongitude, inputLatitude, deltaMilliseconds);
+
+	if (IsPredicting() == true)
+	{
+		// Keep the input as the server will see it, so re-simulating it matches.
+
+		if (InputHistory.Num() >= MaxInputHistory)
+		{
+			InputHistory.RemoveAt(0, 1, false);
+		}
+
+		FPlayerBallBearingInput& input = InputHistory.AddDefaulted_GetRef();
+
+		input.Sequence = InputSequence;
+		input.InputLongitude = FMath::Max(inputLongitude / 127.0f, -1.0f);
+		input.InputLatitude = FMath::Max(inputLatitude / 127.0f, -1.0f);
+		input.DeltaSeconds = deltaMilliseconds / 1000.0f;
+		input.Dashed = PendingDash;
+	}
+	else
+	{
+		InputHistory.Reset();
+	}
+
+	PendingDash = false;
+}
+
+
+/**
+Receive the player's input on the server, quantized to a byte per axis and the frame to a millisecond.
+*********************************************************************************/
+
+bool APlayerBallBearing::ServerSetInput_Validate(uint16 sequence, int8 inputLongitude, int8 inputLatitude, uint8 deltaMilliseconds)
+{
+	return true;
+}
+
+void APlayerBallBearing::ServerSetInput_Implementation(uint16 sequence, int8 inputLongitude, int8 inputLatitude, uint8 deltaMilliseconds)
+{
+	// Input is unreliable and may arrive out of order, so ignore anything older than
+	// the input we already have.
+
+	if (IsSequenceNewer(sequence, InputSequence) == false)
+	{
+		return;
+	}
+
+	InputSequence = sequence;
+
+	// Queue the input rather than applying it straight away, as more than one may
+	// arrive in a frame and each is to be simulated for its own frame.
+
+	if (ServerInputQueue.Num() >= MaxInputHistory)
+	{
+		ServerInputQueue.RemoveAt(0, 1, false);
+	}
+
+	FPlayerBallBearingInput& input = ServerInputQueue.AddDefaulted_GetRef();
+
+	input.Sequence = sequence;
+	input.InputLongitude = FMath::Max(inputLongitude / 127.0f, -1.0f);
+	input.InputLatitude = FMath::Max(inputLatitude / 127.0f, -1.0f);
+	input.DeltaSeconds = FMath::Max(deltaMilliseconds, (uint8)1) / 1000.0f;
+}
+
+
+/**
+Take as much of the queued input as the server's frame covers, for it to simulate.
+*********************************************************************************/
+
+void APlayerBallBearing::ConsumeServerInput(float deltaSeconds)
+{
+	if (ServerInputQueue.Num() == 0)
+	{
+		ServerInputSeconds = 0.0f;
+
+		return;
+	}
+
+	// Take each input whose frame fits within the time simulated so far, averaging
+	// them by their frames as the force from each would have added up. Input that
+	// doesn't fit yet waits for the next frame, the current input carrying on until
+	// then, and the time is capped so a stall doesn't release a flood of input.
+
+	ServerInputSeconds = FMath::Min(ServerInputSeconds + deltaSeconds, 0.25f);
+
+	float inputLongitude = 0.0f;
+	float inputLatitude = 0.0f;
+	float inputSeconds = 0.0f;
+	int32 numConsumed = 0;
+
+	while (numConsumed < ServerInputQueue.Num() &&
+		inputSeconds + ServerInputQueue[numConsumed].DeltaSeconds <= ServerInputSeconds + KINDA_SMALL_NUMBER)
+	{
+		const FPlayerBallBearingInput& input = ServerInputQueue[numConsumed++];
+
+		inputLongitude += input.InputLongitude * input.DeltaSeconds;
+		inputLatitude += input.InputLatitude * input.DeltaSeconds;
+		inputSeconds += input.DeltaSeconds;
+	}
+
+	if (numConsumed > 0)
+	{
+		SimulatedInputSequence = ServerInputQueue[numConsumed - 1].Sequence;
+		ServerInputSeconds = FMath::Max(0.0f, ServerInputSeconds - inputSeconds);
+
+		InputLongitude = inputLongitude / inputSeconds;
+		InputLatitude = inputLatitude / inputSeconds;
+
+		ServerInputQueue.RemoveAt(0, numConsumed, false);
+
+		PublishInput();
+	}
+}
+
+
+/**
+Roll back to the authoritative state and re-simulate the unacknowledged input.
+*********************************************************************************/
+
+void APlayerBallBearing::OnRep_AuthoritativeState()
+{
+	if (IsPredicting() == false)
+	{
+		return;
+	}
+
+	BALL_BEARING_TRACE_SCOPE(PlayerBallBearingReconcile);
+
+	// Drop the input the server has acknowledged, it's already in the authoritative state.
+
+	int32 numAcknowledged = 0;
+
+	while (numAcknowledged < InputHistory.Num() &&
+		IsSequenceNewer(InputHistory[numAcknowledged].Sequence, AuthoritativeState.InputSequence) == false)
+	{
+		numAcknowledged++;
+	}
+
+	InputHistory.RemoveAt(0, numAcknowledged, false);
+
+	// Re-simulate the rest of the input from the authoritative state, using the same
+	// controller force, clamp, damping and dash as the simulation itself. Only the
+	// planar movement is re-simulated, the vertical movement is left to local physics.
+
+	FVector location = AuthoritativeState.Location;
+	FVector velocity = AuthoritativeState.Velocity;
+	float dashTimer = AuthoritativeState.DashTimer;
+	float mass = FMath::Max(BallMesh->GetMass(), KINDA_SMALL_NUMBER);
+	float linearDamping = BallMesh->GetLinearDamping();
+
+	for (const FPlayerBallBearingInput& input : InputHistory)
+	{
+		if (input.Dashed == true &&
+			dashTimer == 0.0f &&
+			velocity.Size() > 1.0f)
+		{
+			velocity += velocity.GetSafeNormal() * DashForce * 1000.0f / mass;
+			dashTimer = 1.5f;
+		}
+
+		FVector clampedVelocity;
+
+		if (GetClampedVelocity(velocity, dashTimer, clampedVelocity) == true)
+		{
+			velocity = clampedVelocity;
+		}
+		else
+		{
+			velocity += FVector(input.InputLongitude, input.InputLatitude, 0.0f) * ControllerForce * input.DeltaSeconds;
+		}
+
+		float damping = 1.0f / (1.0f + linearDamping * input.DeltaSeconds);
+
+		velocity.X *= damping;
+		velocity.Y *= damping;
+
+		location.X += velocity.X * input.DeltaSeconds;
+		location.Y += velocity.Y * input.DeltaSeconds;
+
+		dashTimer = FMath::Max(0.0f, dashTimer - input.DeltaSeconds);
+	}
+
+	// Snap to the reconciled location and velocity if we're way off, otherwise smooth
+	// the correction out over the next few frames. Only the planar movement is
+	// reconciled, the server's height being stale by the time it reaches us, so
+	// neither the test nor the snap take any notice of it.
+
+	// The re-simulation leaves out the forces local physics applies anyway, the
+	// rolling, contacts and magnetism, so the velocity it arrives at is only an
+	// estimate and is eased towards rather than imposed, for local physics to
+	// carry on from.
+
+	FVector currentLocation = BallMesh->GetComponentLocation();
+	FVector currentVelocity = BallMesh->GetPhysicsLinearVelocity();
+
+	if (FVector::Dist2D(location, currentLocation) > CorrectionSnapDistance)
+	{
+		BallMesh->SetWorldLocation(FVector(location.X, location.Y, currentLocation.Z), false, nullptr, ETeleportType::TeleportPhysics);
+		BallMesh->SetPhysicsLinearVelocity(FVector(velocity.X, velocity.Y, currentVelocity.Z));
+
+		CorrectionOffset = FVector::ZeroVector;
+		CorrectionVelocity = FVector::ZeroVector;
+	}
+	else
+	{
+		CorrectionOffset = FVector(location.X - currentLocation.X, location.Y - currentLocation.Y, 0.0f);
+		CorrectionVelocity = FVector(velocity.X - currentVelocity.X, velocity.Y - currentVelocity.Y, 0.0f);
+	}
+
+	DashTimer = dashTimer;
+
+	PhysicsStepDashTimer = FloatToBits(DashTimer);
+}
+
+
+/**
+Move some of the way towards the last reconciled location and velocity.
+*********************************************************************************/
+
+void APlayerBallBearing::ApplyCorrection(float deltaSeconds)
+{
+	float proportion = FMath::Min(CorrectionRate * deltaSeconds, 1.0f);
+
+	if (CorrectionOffset.IsNearlyZero() == false)
+	{
+		FVector correction = CorrectionOffset * proportion;
+
+		CorrectionOffset -= correction;
+
+		BallMesh->SetWorldLocation(BallMesh->GetComponentLocation() + correction, false, nullptr, ETeleportType::TeleportPhysics);
+	}
+
+	// The velocity correction is added to whatever local physics has done since,
+	// rather than replacing it.
+
+	if (CorrectionVelocity.IsNearlyZero() == false)
+	{
+		FVector correction = CorrectionVelocity * proportion;
+
+		CorrectionVelocity -= correction;
+
+		BallMesh->SetPhysicsLinearVelocity(correction, true);
+	}
+}
+
+
+/**
+Have the ball bearing perform a jump on the server.
+*********************************************************************************/
+
+bool APlayerBallBearing::ServerJump_Validate()
+{
+	return true;
+}
+
+void APlayerBallBearing::ServerJump_Implementation()
+{
+	Jump();
+}
+
+
+/**
+Have the ball bearing perform a dash on the server.
+*********************************************************************************/
+
+bool APlayerBallBearing::ServerDash_Validate()
+{
+	return true;
+}
+
+void APlayerBallBearing::ServerDash_Implementation()
+{
+	Dash();
+}
+
+
+/**
+Get the velocity the ball bearing should be braked towards if it's over its maximum speed.
+*********************************************************************************/
+
+bool APlayerBallBearing::GetClampedVelocity(const FVector& velocity, float dashTimer, FVector& clampedVelocity) const
+{
+	// Braking eases off while dashing, so the dash can take us over the maximum speed.
+
+	return FBallBearingMath::GetClampedVelocity(velocity.X, velocity.Y, velocity.Z, MaximumSpeed * 100.0f, dashTimer, clampedVelocity.X, clampedVelocity.Y, clampedVelocity.Z);
+}
+
+
+/**
+Publish the current input for the physics steps to pick up.
+*********************************************************************************/
+
+void APlayerBallBearing::PublishInput()
+{
+	if (UsePhysicsStep == true)
+	{
+		PhysicsStepInput = ((uint64)FloatToBits(InputLongitude) << 32) | FloatToBits(InputLatitude);
+	}
+}
+
+
+/**
+Apply the controller force, speed clamp and dash braking for one physics step.
+*********************************************************************************/
+
+void APlayerBallBearing::PhysicsStep(float deltaSeconds)
+{
+	// This may be called off the game thread, so only the body and the atomics are
+	// touched here, never the components or the game thread's copies of the input.
+
+	// Clients only control their own ball bearing, and then only when predicting it.
+
+	if (HasAuthority() == false &&
+		IsPredicting() == false)
+	{
+		return;
+	}
+
+	FBodyInstance* body = BallMesh->GetBodyInstance();
+
+	if (body == nullptr ||
+		body->IsValidBodyInstance() == false)
+	{
+		return;
+	}
+
+	uint64 input = PhysicsStepInput.Load();
+	uint32 dashTimerBits = PhysicsStepDashTimer.Load();
+	float inputLongitude = BitsToFloat((uint32)(input >> 32));
+	float inputLatitude = BitsToFloat((uint32)input);
+	float dashTimer = BitsToFloat(dashTimerBits);
+
+	FVector clampedVelocity;
+
+	if (GetClampedVelocity(body->GetUnrealWorldVelocity(), dashTimer, clampedVelocity) == true)
+	{
+		body->SetLinearVelocity(clampedVelocity, false);
+	}
+	else
+	{
+		body->AddForce(FVector(inputLongitude, inputLatitude, 0.0f) * ControllerForce * body->GetBodyMass(), false, false);
+	}
+
+	// Count the dash timer down, unless a new dash has just reset it.
+
+	if (dashTimer > 0.0f)
+	{
+		PhysicsStepDashTimer.CompareExchange(dashTimerBits, FloatToBits(FMath::Max(0.0f, dashTimer - deltaSeconds)));
 	}
 }
@@ -5,6 +5,19 @@ Player ball bearing implementation.
 Original author: Rob Baker.
 Current maintainer: Rob Baker.
 
+When the ball bearing subsystem is applying player control per physics step, the
+controller force, speed clamp and dash braking run from the physics scene rather
+than the tick. Input is passed across to the physics steps through atomics, so
+neither side ever waits on the other.
+
+In a networked game, clients send their input to the server, which simulates the
+ball bearing and replicates the results back. Clients also predict their own
+ball bearing's movement from their input, keeping a history of the input the
+server hasn't yet acknowledged. Jumps and dashes are predicted too. When the server's state arrives, the prediction
+is rolled back to it and the unacknowledged input re-simulated through the same
+force and clamp logic, with any difference smoothed out over the next few frames.
+Vertical movement is left to the local physics. Try it with Net PktLag=150.
+
 *********************************************************************************/
 
 #pragma once
@@ -12,9 +25,63 @@ Current maintainer: Rob Baker.
 #include "BallBearing.h"
 #include "GameFramework/SpringArmComponent.h"
 #include "Camera/CameraComponent.h"
+#include "Templates/Atomic.h"
+#include "Engine/NetSerialization.h"
+#include "BallBearingFixedStep.h"
 #include "PlayerBallBearing.generated.h"
 
 
+/**
+The authoritative state of a player ball bearing, replicated to its owning client.
+*********************************************************************************/
+
+USTRUCT()
+struct FPlayerBallBearingState
+{
+	GENERATED_BODY()
+
+	// The sequence number of the last input the server had received.
+	UPROPERTY()
+		uint16 InputSequence = 0;
+
+	// The location of the ball bearing.
+	UPROPERTY()
+		FVector_NetQuantize10 Location = FVector::ZeroVector;
+
+	// The linear velocity of the ball bearing.
+	UPROPERTY()
+		FVector_NetQuantize10 Velocity = FVector::ZeroVector;
+
+	// The dash timer of the ball bearing.
+	UPROPERTY()
+		float DashTimer = 0.0f;
+};
+
+
+/**
+A frame of player input, kept by the client until the server acknowledges it,
+and by the server until it has simulated it.
+*********************************************************************************/
+
+struct FPlayerBallBearingInput
+{
+	// The sequence number of the input.
+	uint16 Sequence = 0;
+
+	// The longitude input received from the player.
+	float InputLongitude = 0.0f;
+
+	// The latitude input received from the player.
+	float InputLatitude = 0.0f;
+
+	// The length of the frame the input was applied for.
+	float DeltaSeconds = 0.0f;
+
+	// Did the player dash during the frame?
+	bool Dashed = false;
+};
+
+
 /**
 Player ball bearing class, processes input and possesses a camera.
 *********************************************************************************/
@@ -29,6 +96,9 @@ public:
 	// Sets default values for this pawn's properties.
 	APlayerBallBearing();
 
+	// Reset the ball bearing's state, at rest at a given transform.
+	virtual void ResetToTransform(const FTransform& transform) override;
+
 	// Spring arm for positioning the camera above the ball bearing.
 	UPROPERTY(VisibleAnywhere, BlueprintReadOnly, Category = BallBearing)
 		USpringArmComponent* SpringArm = nullptr;
@@ -55,9 +125,18 @@ public:
 
 protected:
 
+	// Establish whether the ball bearing is to be controlled per physics step or deterministically.
+	virtual void BeginPlay() override;
+
 	// Control the movement of the ball bearing, called every frame.
 	virtual void Tick(float deltaSeconds) override;
 
+	// Establish the properties to be replicated.
+	virtual void GetLifetimeReplicatedProps(TArray<FLifetimeProperty>& outLifetimeProps) const override;
+
+	// Apply replicated movement, unless we're predicting it ourselves.
+	virtual void OnRep_ReplicatedMovement() override;
+
 	// Called to bind functionality to input.
 	virtual void SetupPlayerInputComponent(class UInputComponent* playerInputComponent) override;
 
@@ -67,20 +146,61 @@ private:
 	void MoveLongitudinally(float value)
 	{
 		InputLongitude = value;
+
+		PublishInput();
 	}
 
 	// Move the ball bearing with the given force longitudinally on the Y axis.
 	void MoveLaterally(float value)
 	{
 		InputLatitude = value;
+
+		PublishInput();
 	}
 
+	// Publish the current input for the physics steps to pick up.
+	void PublishInput();
+
+	// Get the velocity the ball bearing should be braked towards if it's over its maximum speed.
+	bool GetClampedVelocity(const FVector& velocity, float dashTimer, FVector& clampedVelocity) const;
+
+	// Apply the controller force, speed clamp and dash braking for one physics step.
+	void PhysicsStep(float deltaSeconds);
+
 	// Have the ball bearing perform a jump.
 	void Jump();
 
 	// Have the ball bearing perform a dash.
 	void Dash();
 
+	// Is this a client predicting the movement of its own ball bearing?
+	bool IsPredicting() const;
+
+	// Send this frame's input to the server, keeping it in the history if predicting.
+	void SendInputToServer(float deltaSeconds);
+
+	// Receive the player's input on the server, quantized to a byte per axis and the frame to a millisecond.
+	UFUNCTION(Server, Unreliable, WithValidation)
+		void ServerSetInput(uint16 sequence, int8 inputLongitude, int8 inputLatitude, uint8 deltaMilliseconds);
+
+	// Take as much of the queued input as the server's frame covers, for it to simulate.
+	void ConsumeServerInput(float deltaSeconds);
+
+	// Roll back to the authoritative state and re-simulate the unacknowledged input.
+	UFUNCTION()
+		void OnRep_AuthoritativeState();
+
+	// Move some of the way towards the last reconciled location and velocity.
+	void ApplyCorrection(float deltaSeconds);
+
+	// Have the ball bearing perform a jump on the server.
+	UFUNCTION(Server, Reliable, WithValidation)
+		void ServerJump();
+
+	// Have the ball bearing perform a dash on the server.
+	UFUNCTION(Server, Reliable, WithValidation)
+		void ServerDash();
+
 	// The current longitude input received from the player.
 	float InputLongitude = 0.0f;
 
@@ -90,6 +210,61 @@ private:
 	// Timer used to control the dashing of the ball bearing.
 	float DashTimer = 0.0f;
 
+	// Accumulator advancing the dash timer in fixed steps in deterministic mode.
+	FBallBearingFixedStep DashStep;
+
+	// The authoritative state of the ball bearing, replicated to its owning client.
+	UPROPERTY(ReplicatedUsing = OnRep_AuthoritativeState)
+		FPlayerBallBearingState AuthoritativeState;
+
+	// The input sent to the server that it hasn't yet acknowledged, oldest first.
+	TArray<FPlayerBallBearingInput> InputHistory;
+
+	// The sequence number of the last input sent to, or received by, the server.
+	uint16 InputSequence = 0;
+
+	// The input received by the server that it hasn't yet simulated, oldest first.
+	TArray<FPlayerBallBearingInput> ServerInputQueue;
+
+	// The time the server has simulated that the queued input is still to cover.
+	float ServerInputSeconds = 0.0f;
+
+	// The sequence number of the last input the server has simulated.
+	uint16 SimulatedInputSequence = 0;
+
+	// Did the player dash since the last input was sent?
+	bool PendingDash = false;
+
+	// The distance still to move to reach the last reconciled location.
+	FVector CorrectionOffset = FVector::ZeroVector;
+
+	// The velocity still to add to reach the last reconciled velocity.
+	FVector CorrectionVelocity = FVector::ZeroVector;
+
+	// The maximum number of frames of input to keep in the history.
+	static constexpr int32 MaxInputHistory = 120;
+
+	// The correction distance beyond which the ball bearing is snapped rather than smoothed.
+	static constexpr float CorrectionSnapDistance = 300.0f;
+
+	// The proportion of the outstanding correction applied per second.
+	static constexpr float CorrectionRate = 10.0f;
+
+	// Is the ball bearing being controlled per physics step rather than per frame?
+	bool UsePhysicsStep = false;
+
+	// The input for the physics steps, the longitude and latitude bits packed together.
+	TAtomic<uint64> PhysicsStepInput { 0 };
+
+	// The bits of the dash timer, counted down by the physics steps.
+	TAtomic<uint32> PhysicsStepDashTimer { 0 };
+
+	// Allow the ball bearing subsystem to run the physics steps.
+	friend class UBallBearingSubsystem;
+
+	// Allow replays to record and play back the input.
+	friend class UBallBearingReplaySubsystem;
+
 	// Allow the ball bearing HUD unfettered access to this class.
 	friend class ABallBearingHUD;
 };
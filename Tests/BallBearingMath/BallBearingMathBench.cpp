@@ -0,0 +1,121 @@
+/**
+
+Ball bearing math microbenchmarks for Metal in Motion.
+
+Original author: Rob Baker.
+Current maintainer: Rob Baker.
+
+Times the scalar and batch versions of the magnetism in BallBearingMath.h over
+the same pairings, along with the distance-only batch and the speed clamp, and
+reports the best time of a number of repeats in nanoseconds per pairing. Fails
+if the scalar and batch versions ever disagree, so it doubles as a test.
+
+	BallBearingMathBench [pairings, default 65536] [repeats, default 50]
+
+*********************************************************************************/
+
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include "BallBearingMath.h"
+#include "BallBearingMathPairings.h"
+
+// A sink for results, so the compiler can't optimize the work away.
+static volatile float Sink = 0.0f;
+
+
+/**
+Get the best time of a number of repeats of some work, in nanoseconds per pairing.
+*********************************************************************************/
+
+template <typename TWork>
+static double TimeBest(int count, int repeats, TWork&& work)
+{
+	double best = 1.e30;
+
+	for (int i = 0; i < repeats; i++)
+	{
+		auto start = std::chrono::steady_clock::now();
+
+		work();
+
+		auto end = std::chrono::steady_clock::now();
+
+		best = std::min(best, std::chrono::duration<double, std::nano>(end - start).count() / count);
+	}
+
+	return best;
+}
+
+
+/**
+Run the microbenchmarks, returning non-zero if the scalar and batch versions disagree.
+*********************************************************************************/
+
+int main(int argc, char** argv)
+{
+	int count = (argc > 1) ? std::max(std::atoi(argv[1]), 4) : 65536;
+	int repeats = (argc > 2) ? std::max(std::atoi(argv[2]), 1) : 50;
+
+	FMagnetismPairings scalar(count);
+	FMagnetismPairings batch(count);
+
+	count = scalar.Count;
+
+	double scalarTime = TimeBest(count, repeats, [&scalar]() { scalar.SolveScalar(); Sink = scalar.ForceX.back(); });
+	double batchTime = TimeBest(count, repeats, [&batch]() { batch.SolveBatch(); Sink = batch.ForceX.back(); });
+
+	double distancesTime = TimeBest(count, repeats, [&batch]()
+	{
+		FBallBearingMath::GetDistances(batch.Count, batch.DeltaX.data(), batch.DeltaY.data(), batch.DeltaZ.data(), batch.Distance.data());
+
+		Sink = batch.Distance.back();
+	});
+
+	// Use the deltas as velocities for the clamp, with the dash timer running through its range.
+
+	double clampTime = TimeBest(count, repeats, [&scalar]()
+	{
+		float sum = 0.0f;
+
+		for (int i = 0; i < scalar.Count; i++)
+		{
+			float clampedX, clampedY, clampedZ;
+
+			if (FBallBearingMath::GetClampedVelocity(scalar.DeltaX[i], scalar.DeltaY[i], scalar.DeltaZ[i], 500.0f, (float)(i & 7) * 0.25f, clampedX, clampedY, clampedZ) == true)
+			{
+				sum += clampedX;
+			}
+		}
+
+		Sink = sum;
+	});
+
+	// Solve once more each, as the distance-only batch overwrote the batch distances.
+
+	scalar.SolveScalar();
+	batch.SolveBatch();
+
+	int numMismatches = 0;
+
+	for (int i = 0; i < count; i++)
+	{
+		if (std::memcmp(&scalar.ForceX[i], &batch.ForceX[i], sizeof(float)) != 0 ||
+			std::memcmp(&scalar.ForceY[i], &batch.ForceY[i], sizeof(float)) != 0 ||
+			std::memcmp(&scalar.ForceZ[i], &batch.ForceZ[i], sizeof(float)) != 0 ||
+			std::memcmp(&scalar.Distance[i], &batch.Distance[i], sizeof(float)) != 0)
+		{
+			numMismatches++;
+		}
+	}
+
+	std::printf("Ball bearing math (%s), %d pairings, best of %d:\n", (BALL_BEARING_MATH_SSE != 0) ? "SSE" : "scalar", count, repeats);
+	std::printf("  magnetism scalar   %8.3f ns/pair\n", scalarTime);
+	std::printf("  magnetism batch    %8.3f ns/pair (%.2fx)\n", batchTime, scalarTime / batchTime);
+	std::printf("  distances batch    %8.3f ns/pair\n", distancesTime);
+	std::printf("  clamped velocity   %8.3f ns/pair\n", clampTime);
+	std::printf("  mismatches         %8d\n", numMismatches);
+
+	return (numMismatches == 0) ? 0 : 1;
+}
@@ -0,0 +1,137 @@
+/**
+
+Ball bearing math test pairings for Metal in Motion.
+
+Original author: Rob Baker.
+Current maintainer: Rob Baker.
+
+Batches of pseudo-random magnetism pairings, laid out as the solver lays them out,
+shared by the unit tests and the microbenchmarks. The generator is seeded, so the
+same pairings come out on every run and every platform.
+
+*********************************************************************************/
+
+#pragma once
+
+#include <cstdint>
+#include <vector>
+#include "BallBearingMath.h"
+
+
+/**
+A vector of floats aligned to 16 bytes, as the batch math requires.
+*********************************************************************************/
+
+template <typename T>
+struct FAlignedAllocator
+{
+	typedef T value_type;
+
+	FAlignedAllocator() = default;
+
+	template <typename U>
+	FAlignedAllocator(const FAlignedAllocator<U>&)
+	{ }
+
+	// Allocate a number of elements, aligned to 16 bytes.
+	T* allocate(std::size_t count)
+	{
+		return static_cast<T*>(::operator new(count * sizeof(T), std::align_val_t(16)));
+	}
+
+	// Free elements allocated by allocate.
+	void deallocate(T* pointer, std::size_t)
+	{
+		::operator delete(pointer, std::align_val_t(16));
+	}
+
+	template <typename U>
+	bool operator == (const FAlignedAllocator<U>&) const
+	{
+		return true;
+	}
+
+	template <typename U>
+	bool operator != (const FAlignedAllocator<U>&) const
+	{
+		return false;
+	}
+};
+
+typedef std::vector<float, FAlignedAllocator<float>> FAlignedFloats;
+
+
+/**
+A batch of magnetism pairings, and the outputs for them, as separate arrays of components.
+*********************************************************************************/
+
+struct FMagnetismPairings
+{
+	// Create a number of pseudo-random pairings, rounded up to a multiple of 4.
+	explicit FMagnetismPairings(int count, uint32_t seed = 0x4d494d31u)
+		: Count((count + 3) & ~3)
+		, DeltaX(Count), DeltaY(Count), DeltaZ(Count), InverseRadius(Count), Magnetism(Count)
+		, ForceX(Count), ForceY(Count), ForceZ(Count), Distance(Count)
+	{
+		// Deltas range over twice a goal's radius so plenty are out of range, and every
+		// 16th pairing is exactly on the center.
+
+		for (int i = 0; i < Count; i++)
+		{
+			float radius = 200.0f + 800.0f * Random(seed);
+
+			if ((i & 15) == 0)
+			{
+				DeltaX[i] = DeltaY[i] = DeltaZ[i] = 0.0f;
+			}
+			else
+			{
+				DeltaX[i] = (Random(seed) * 2.0f - 1.0f) * radius * 2.0f;
+				DeltaY[i] = (Random(seed) * 2.0f - 1.0f) * radius * 2.0f;
+				DeltaZ[i] = (Random(seed) * 2.0f - 1.0f) * radius * 0.5f;
+			}
+
+			InverseRadius[i] = 1.0f / radius;
+			Magnetism[i] = -(1000.0f + 9000.0f * Random(seed));
+		}
+	}
+
+	// Compute the outputs for all the pairings one at a time.
+	void SolveScalar()
+	{
+		for (int i = 0; i < Count; i++)
+		{
+			FBallBearingMath::GetMagnetismForce(DeltaX[i], DeltaY[i], DeltaZ[i], InverseRadius[i], Magnetism[i], ForceX[i], ForceY[i], ForceZ[i], Distance[i]);
+		}
+	}
+
+	// Compute the outputs for all the pairings as a batch.
+	void SolveBatch()
+	{
+		FBallBearingMath::GetMagnetismForces(Count, DeltaX.data(), DeltaY.data(), DeltaZ.data(), InverseRadius.data(), Magnetism.data(), ForceX.data(), ForceY.data(), ForceZ.data(), Distance.data());
+	}
+
+	// Get a pseudo-random number from 0 to 1 from a seed, advancing it.
+	static float Random(uint32_t& seed)
+	{
+		seed = seed * 1664525u + 1013904223u;
+
+		return (float)(seed >> 8) * (1.0f / 16777216.0f);
+	}
+
+	// The number of pairings, a multiple of 4.
+	int Count = 0;
+
+	// The inputs.
+	FAlignedFloats DeltaX;
+	FAlignedFloats DeltaY;
+	FAlignedFloats DeltaZ;
+	FAlignedFloats InverseRadius;
+	FAlignedFloats Magnetism;
+
+	// The outputs.
+	FAlignedFloats ForceX;
+	FAlignedFloats ForceY;
+	FAlignedFloats ForceZ;
+	FAlignedFloats Distance;
+};
@@ -0,0 +1,233 @@
+/**
+
+Ball bearing math unit tests for Metal in Motion.
+
+Original author: Rob Baker.
+Current maintainer: Rob Baker.
+
+Tests the engine-free math in BallBearingMath.h: the magnetism force law against
+values worked out by hand, its behavior on a goal's center and outside its radius,
+the agreement of the scalar and batch versions to the bit, the settle distance and
+the speed clamp's braking while dashing. Returns the number of failed checks.
+
+*********************************************************************************/
+
+#include <cstdio>
+#include <cstring>
+#include "BallBearingMath.h"
+#include "BallBearingMathPairings.h"
+
+// The number of checks that have failed.
+static int NumFailures = 0;
+
+// Check a condition, reporting it if it fails.
+#define CHECK_MATH(condition) CheckMath((condition), #condition, __FILE__, __LINE__)
+
+// Check two floats are equal to within a tolerance, reporting them if they aren't.
+#define CHECK_MATH_NEAR(value, expected, tolerance) CheckMathNear((value), (expected), (tolerance), #value, __FILE__, __LINE__)
+
+
+/**
+Check a condition, reporting it if it fails.
+*********************************************************************************/
+
+static void CheckMath(bool condition, const char* text, const char* file, int line)
+{
+	if (condition == false)
+	{
+		std::printf("%s(%d): check failed: %s\n", file, line, text);
+
+		NumFailures++;
+	}
+}
+
+
+/**
+Check two floats are equal to within a tolerance, reporting them if they aren't.
+*********************************************************************************/
+
+static void CheckMathNear(float value, float expected, float tolerance, const char* text, const char* file, int line)
+{
+	if (std::fabs(value - expected) > tolerance)
+	{
+		std::printf("%s(%d): check failed: %s is %.9g, expected %.9g\n", file, line, text, value, expected);
+
+		NumFailures++;
+	}
+}
+
+
+/**
+Test the magnetism force law against values worked out by hand.
+*********************************************************************************/
+
+static void TestMagnetismForce()
+{
+	float forceX, forceY, forceZ, distance;
+
+	// 50 from the center of a goal with a radius of 100 is a ratio of 0.5, so a
+	// magnetism of 1000 gives a force of 500 along the delta, (0.6, 0.8, 0).
+
+	FBallBearingMath::GetMagnetismForce(30.0f, 40.0f, 0.0f, 0.01f, 1000.0f, forceX, forceY, forceZ, distance);
+
+	CHECK_MATH_NEAR(distance, 50.0f, 1.e-5f);
+	CHECK_MATH_NEAR(forceX, 300.0f, 1.e-3f);
+	CHECK_MATH_NEAR(forceY, 400.0f, 1.e-3f);
+	CHECK_MATH_NEAR(forceZ, 0.0f, 0.0f);
+
+	// 56 from the center, (2, 6, 3) * 8, of a goal with a radius of 128 is a ratio
+	// of 0.4375, so a magnetism of -1024 gives a force of -576 along (2, 6, 3) / 7.
+
+	FBallBearingMath::GetMagnetismForce(16.0f, 48.0f, 24.0f, 1.0f / 128.0f, -1024.0f, forceX, forceY, forceZ, distance);
+
+	CHECK_MATH_NEAR(distance, 56.0f, 1.e-5f);
+	CHECK_MATH_NEAR(forceX, -576.0f * 2.0f / 7.0f, 1.e-3f);
+	CHECK_MATH_NEAR(forceY, -576.0f * 6.0f / 7.0f, 1.e-3f);
+	CHECK_MATH_NEAR(forceZ, -576.0f * 3.0f / 7.0f, 1.e-3f);
+}
+
+
+/**
+Test the magnetism force law exactly on a goal's center and outside its radius.
+*********************************************************************************/
+
+static void TestMagnetismForceLimits()
+{
+	float forceX, forceY, forceZ, distance;
+
+	// Exactly on the center, and close enough to count, there's no force and no distance.
+
+	FBallBearingMath::GetMagnetismForce(0.0f, 0.0f, 0.0f, 0.01f, 1000.0f, forceX, forceY, forceZ, distance);
+
+	CHECK_MATH(distance == 0.0f);
+	CHECK_MATH(forceX == 0.0f && forceY == 0.0f && forceZ == 0.0f);
+
+	FBallBearingMath::GetMagnetismForce(1.e-5f, 0.0f, 0.0f, 0.01f, 1000.0f, forceX, forceY, forceZ, distance);
+
+	CHECK_MATH(distance == 0.0f);
+	CHECK_MATH(forceX == 0.0f && forceY == 0.0f && forceZ == 0.0f);
+
+	// At and beyond the radius the ratio is clamped to 1, so there's no force but the
+	// distance is still given.
+
+	FBallBearingMath::GetMagnetismForce(100.0f, 0.0f, 0.0f, 1.0f / 100.0f, 1000.0f, forceX, forceY, forceZ, distance);
+
+	CHECK_MATH_NEAR(distance, 100.0f, 1.e-5f);
+	CHECK_MATH_NEAR(forceX, 0.0f, 1.e-3f);
+
+	FBallBearingMath::GetMagnetismForce(0.0f, -300.0f, 400.0f, 0.01f, 1000.0f, forceX, forceY, forceZ, distance);
+
+	CHECK_MATH_NEAR(distance, 500.0f, 1.e-4f);
+	CHECK_MATH(forceX == 0.0f && forceY == 0.0f && forceZ == 0.0f);
+
+	CHECK_MATH(FBallBearingMath::GetRatio(50.0f, 0.01f) == 0.5f);
+	CHECK_MATH(FBallBearingMath::GetRatio(500.0f, 0.01f) == 1.0f);
+}
+
+
+/**
+Test the scalar and batch versions of the magnetism agree to the bit.
+*********************************************************************************/
+
+static void TestMagnetismBatch()
+{
+	FMagnetismPairings scalar(4096);
+	FMagnetismPairings batch(4096);
+
+	scalar.SolveScalar();
+	batch.SolveBatch();
+
+	int numMismatches = 0;
+
+	for (int i = 0; i < scalar.Count; i++)
+	{
+		if (std::memcmp(&scalar.ForceX[i], &batch.ForceX[i], sizeof(float)) != 0 ||
+			std::memcmp(&scalar.ForceY[i], &batch.ForceY[i], sizeof(float)) != 0 ||
+			std::memcmp(&scalar.ForceZ[i], &batch.ForceZ[i], sizeof(float)) != 0 ||
+			std::memcmp(&scalar.Distance[i], &batch.Distance[i], sizeof(float)) != 0)
+		{
+			numMismatches++;
+		}
+	}
+
+	CHECK_MATH(numMismatches == 0);
+
+	// The batch distances on their own agree too.
+
+	FMagnetismPairings distances(4096);
+
+	FBallBearingMath::GetDistances(distances.Count, distances.DeltaX.data(), distances.DeltaY.data(), distances.DeltaZ.data(), distances.Distance.data());
+
+	CHECK_MATH(std::memcmp(distances.Distance.data(), scalar.Distance.data(), sizeof(float) * scalar.Count) == 0);
+}
+
+
+/**
+Test a ball bearing is settled in a goal only within 75 of its center.
+*********************************************************************************/
+
+static void TestSettling()
+{
+	CHECK_MATH(FBallBearingMath::IsSettled(0.0f) == true);
+	CHECK_MATH(FBallBearingMath::IsSettled(std::nextafter(75.0f, 0.0f)) == true);
+	CHECK_MATH(FBallBearingMath::IsSettled(75.0f) == false);
+	CHECK_MATH(FBallBearingMath::IsSettled(std::nextafter(75.0f, 100.0f)) == false);
+}
+
+
+/**
+Test the maximum speed clamp and its braking while dashing.
+*********************************************************************************/
+
+static void TestClampedVelocity()
+{
+	float clampedX = 0.0f, clampedY = 0.0f, clampedZ = 0.0f;
+
+	// Under the maximum speed nothing is clamped, and vertical speed doesn't count.
+
+	CHECK_MATH(FBallBearingMath::GetClampedVelocity(60.0f, 80.0f, 1000.0f, 100.0f, 0.0f, clampedX, clampedY, clampedZ) == false);
+
+	// A planar speed of 500 clamped to 100 is a scale of 0.2, with the vertical left alone.
+	// Not dashing, braking is in full.
+
+	CHECK_MATH(FBallBearingMath::GetBrakingRatio(0.0f) == 1.0f);
+	CHECK_MATH(FBallBearingMath::GetClampedVelocity(300.0f, 400.0f, 7.0f, 100.0f, 0.0f, clampedX, clampedY, clampedZ) == true);
+	CHECK_MATH_NEAR(clampedX, 60.0f, 1.e-4f);
+	CHECK_MATH_NEAR(clampedY, 80.0f, 1.e-4f);
+	CHECK_MATH(clampedZ == 7.0f);
+
+	// Halfway through a dash, braking is at (1 - 0.5)^2, a quarter.
+
+	CHECK_MATH(FBallBearingMath::GetBrakingRatio(0.5f) == 0.25f);
+	CHECK_MATH(FBallBearingMath::GetClampedVelocity(300.0f, 400.0f, 7.0f, 100.0f, 0.5f, clampedX, clampedY, clampedZ) == true);
+	CHECK_MATH_NEAR(clampedX, 240.0f, 1.e-4f);
+	CHECK_MATH_NEAR(clampedY, 320.0f, 1.e-4f);
+	CHECK_MATH(clampedZ == 7.0f);
+
+	// At the start of a dash, and beyond, there's no braking at all.
+
+	for (float dashTimer : { 1.0f, 2.0f })
+	{
+		CHECK_MATH(FBallBearingMath::GetBrakingRatio(dashTimer) == 0.0f);
+		CHECK_MATH(FBallBearingMath::GetClampedVelocity(300.0f, 400.0f, 7.0f, 100.0f, dashTimer, clampedX, clampedY, clampedZ) == true);
+		CHECK_MATH(clampedX == 300.0f && clampedY == 400.0f && clampedZ == 7.0f);
+	}
+}
+
+
+/**
+Run all of the tests, returning the number of failed checks.
+*********************************************************************************/
+
+int main()
+{
+	TestMagnetismForce();
+	TestMagnetismForceLimits();
+	TestMagnetismBatch();
+	TestSettling();
+	TestClampedVelocity();
+
+	std::printf("Ball bearing math (%s): %d failed checks\n", (BALL_BEARING_MATH_SSE != 0) ? "SSE" : "scalar", NumFailures);
+
+	return NumFailures;
+}